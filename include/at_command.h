@@ -65,8 +65,10 @@ extern "C" {
  * All other commands are provided by plugins.
  *
  * Plugins are loaded when the modem instance is created.
- * At that point, each plugin's at_plugin_register() function is invoked.
- * Plugins can register which commands they handle with at_register_ext().
+ * At that point, each plugin's at_plugin_register() function is invoked,
+ * unless the plugin provides an at_plugin_table of commands.
+ * Plugins can register which commands they handle with at_register_ext(),
+ * or declare their extended commands statically in at_plugin_table.
  *
  * This defines the interface between the core and plugins that implement
  * one or more AT commands.
@@ -138,11 +140,11 @@ enum at_error
 typedef unsigned at_error_t;
 
 /**
- * Each plugin must provide this entry point.
- * It will be called when a modem instance is created. This is a good time
- * to perform some initialization, and register supported commands with
- * at_register_ext(), at_register_alpha(), at_register_ampersand(),
- * at_register_dial() and/or at_register_s().
+ * Each plugin must provide this entry point, unless it provides
+ * at_plugin_table. It will be called when a modem instance is created.
+ * This is a good time to perform some initialization, and register
+ * supported commands with at_register_ext(), at_register_alpha(),
+ * at_register_ampersand(), at_register_dial() and/or at_register_s().
  *
  * @param set AT commands set to pass to at_register_ext() and the like.
  *
@@ -159,6 +161,19 @@ void *at_plugin_register (at_commands_t *set);
  */
 void at_plugin_unregister (void *opaque);
 
+/**
+ * This is an optional entry point to restore the default values of the
+ * session parameters of a plugin, on ATZ or AT&F. Commands remain
+ * registered. This is a good time to stop any unsolicited result code.
+ *
+ * If a plugin returned non-NULL from at_plugin_register() but does not
+ * provide this function, the plugins are all unregistered and registered
+ * again instead, which is much slower.
+ *
+ * @param opaque opaque data returned from at_plugin_register()
+ */
+void at_plugin_reset (void *opaque);
+
 /**
  * Retrieves the AT modem that the AT commands list belongs to.
  *
@@ -206,6 +221,34 @@ typedef at_error_t (*at_get_cb) (at_modem_t *m, void *ctx);
 int at_register_ext (at_commands_t *set, const char *name, at_set_cb setter,
                  at_get_cb getter, at_get_cb tester, void *opaque);
 
+/**
+ * Static registration of an extended AT command (see at_plugin_table).
+ */
+typedef struct at_command
+{
+	const char *name; /**< name of the AT command */
+	at_set_cb set; /**< execution callback (mandatory) */
+	at_get_cb get; /**< query callback (or NULL) */
+	at_get_cb test; /**< test callback (or NULL) */
+	void *data; /**< data pointer for the callbacks, or NULL for the value
+	                 returned by at_plugin_register() */
+} at_command_t;
+
+/**
+ * This is an optional table of the extended AT commands of a plugin,
+ * terminated by an entry with a NULL name. The tables of all plugins are
+ * merged into a single lookup table, once per process rather than once per
+ * modem instance; invalid and duplicate entries are ignored with a warning.
+ *
+ * If a plugin provides this table, at_plugin_register() is optional, and
+ * it is only invoked the first time one of the commands is executed, so that
+ * expensive initialization does not delay the modem. It then returns the
+ * per-modem data of the plugin, or NULL on error, in which case the commands
+ * fail until the next attempt. Such a plugin must not emit unsolicited
+ * result codes before any of its commands has executed.
+ */
+extern const at_command_t at_plugin_table[];
+
 /**
  * Callback prototype to execute an AT alpha or ampersand command
  * (except for ATD and ATS).
@@ -331,7 +374,37 @@ int at_intermediatev (at_modem_t *, const char *fmt, va_list args);
 char *at_read_text (at_modem_t *, const char *prompt);
 
 /**
- * Sends an unsolicited message.
+ * Callback prototype for at_read_text_spans().
+ * @param span pointer to the first byte of a span of text
+ * @param len byte length of the span (non-zero)
+ * @return 0 to continue, or a positive value to ignore the rest of the text
+ */
+typedef int (*at_text_cb) (void *, const char *span, size_t len);
+
+/**
+ * Reads text from the DTE (in commands mode) until Ctrl+Z or ESC, like
+ * at_read_text(), but without accumulating it. Instead, the text is passed
+ * to a callback as contiguous spans straight from the DTE input buffer.
+ * A span ends at each new line (CR included), at the final Ctrl+Z, and
+ * every 1024 bytes without new line. A span cannot be edited any longer
+ * once it has been passed, so Backspace only affects the current span.
+ *
+ * @param prompt text sent to DTE at the beginning of each new line
+ * @param cb callback for each span of text
+ * @param opaque data pointer for the callback
+ *
+ * @return 0 on success, -1 on error or if ESC is received, or the value
+ * returned by the callback if it was not zero. Even then, input is read
+ * until Ctrl+Z or ESC.
+ */
+int at_read_text_spans (at_modem_t *, const char *prompt,
+                        at_text_cb cb, void *opaque);
+
+/**
+ * Sends an unsolicited message. While a command line is executing or in
+ * data mode, the message is held back and sent afterwards. If the modem has
+ * its own thread (see at_modem_start()), the message is queued and sent by
+ * that thread, so the caller never waits for the DTE.
  * @param fmt format string
  * @return 0 on success, -1 on error
  */
@@ -353,6 +426,19 @@ int at_unsolicited_blob (at_modem_t *, const void *blob, size_t len);
  */
 int at_unsolicitedv (at_modem_t *, const char *fmt, va_list args);
 
+/**
+ * Sends an unsolicited state report, such as a registration status.
+ * Reports with the same key supersede one another: only the latest one is
+ * delivered, and at most once per coalescing window (AT_URC_WINDOW
+ * environment variable, in milliseconds, 100 by default). Superseded
+ * reports are counted in the command statistics (see AT@PERF).
+ * @param key report type (e.g. "+CREG")
+ * @param fmt format string
+ * @return 0 on success, -1 on error
+ */
+int at_unsolicited_state (at_modem_t *, const char *key,
+                          const char *fmt, ...) AT_FORMAT(3, 4);
+
 /**
  * Sends an unsolicited RING message, depending on verbosity.
  */
@@ -360,8 +446,9 @@ int at_ring (at_modem_t *);
 
 /**
  * Enter data mode and transmit raw data, usually for PPP emulation.
- * While in this mode, any attempt to write with at_unsolicited(),
- * at_unsolicitedv() or at_unsolicited_blob() will fail (i.e. return -1).
+ * While in this mode, messages sent with at_unsolicited(),
+ * at_unsolicitedv() or at_unsolicited_blob() are held back until the end of
+ * the data mode, or discarded (returning -1) if too many are pending.
  * This function will automatically print the "CONNECT" AT command result.
  * Then it will forward data between the DTE and the provided file descriptor.
  * If end-of-stream or an error occurs on either side, or if "+++" is received
@@ -423,6 +510,51 @@ typedef at_error_t (*at_get_t) (at_modem_t *, void *);
  */
 typedef at_error_t (*at_list_t) (at_modem_t *, void *);
 
+/**
+ * Types of AT command parameters
+ */
+enum at_param_type
+{
+	AT_PARAM_OMITTED, /**< Empty parameter (e.g. between two commas) */
+	AT_PARAM_NUMBER, /**< Decimal numeric constant */
+	AT_PARAM_STRING, /**< Double-quoted string constant */
+	AT_PARAM_TOKEN, /**< Other unquoted value (e.g. hexadecimal) */
+};
+
+/**
+ * View of one AT command parameter within the command string.
+ * Nothing is copied: the view is only valid as long as the string.
+ */
+typedef struct at_param
+{
+	unsigned type; /**< parameter type (see @ref at_param_type) */
+	unsigned number; /**< value (AT_PARAM_NUMBER only) */
+	const char *str; /**< first character, without quotes or blanks */
+	size_t len; /**< byte length, without quotes or blanks */
+} at_param_t;
+
+/**
+ * Splits a comma-separated list of AT command parameters, e.g. the string
+ * passed to an @ref at_set_cb callback. This neither allocates memory nor
+ * depends on the locale. Escape sequences within strings are left as is.
+ * @param str nul-terminated parameters list
+ * @param params table of parameter views to fill
+ * @param max number of entries in the table
+ * @return the number of parameters (zero if the list is blank),
+ * or -1 if there are more than max, or on syntax error.
+ */
+int at_tokenize (const char *str, at_param_t *params, unsigned max);
+
+/**
+ * Copies a string or token parameter as a nul-terminated string.
+ * An omitted parameter yields the empty string.
+ * @param p parameter view from at_tokenize()
+ * @param buf destination buffer
+ * @param size byte size of the destination buffer
+ * @return buf, or NULL if the parameter is a number or does not fit.
+ */
+char *at_param_copy (const at_param_t *p, char *buf, size_t size);
+
 /** @} */
 
 /**
@@ -531,12 +663,58 @@ char *at_to_utf8 (at_modem_t *, const char *str);
 
 /**
  * Converts a string to the AT+CSCS character set from UTF-8.
+ * In the "GSM" character set, characters not in the GSM 7-bit default
+ * alphabet are replaced with '?', and '@' (septet 0x00) is encoded as 0x80,
+ * so that it does not terminate the string; at_to_utf8() decodes it back.
  * @param str string to convert from UTF-8
  * @return a nul-terminated string on success (use free() to destroy it)
  * or NULL on error.
  */
 char *at_from_utf8 (at_modem_t *, const char *str);
 
+/**
+ * Converts GSM 7-bit default alphabet text (3GPP TS 23.038) to UTF-8.
+ * Escape sequences to the extension table are supported.
+ * @param septets unpacked septets (one per byte)
+ * @param len number of septets
+ * @return a nul-terminated UTF-8 string on success (use free() to destroy it)
+ * or NULL on error.
+ */
+char *at_gsm7_decode (const void *septets, size_t len);
+
+/**
+ * Converts a string from UTF-8 to the GSM 7-bit default alphabet, with
+ * escape sequences for the extension table.
+ * @param str nul-terminated UTF-8 string to convert
+ * @param lenp [OUT] number of septets
+ * @return unpacked septets (one per byte) on success (use free() to destroy
+ * them), or NULL if a character cannot be represented or on error.
+ */
+void *at_gsm7_encode (const char *str, size_t *lenp);
+
+/**
+ * Packs septets into octets (3GPP TS 23.038 §6.1.2.1).
+ * @param buf output buffer for (shift + 7 * len + 7) / 8 octets
+ * @param septets unpacked septets (one per byte)
+ * @param len number of septets
+ * @param shift number of fill bits before the first septet (0-6),
+ *              e.g. after a user data header
+ * @return the number of octets written.
+ */
+size_t at_gsm7_pack (void *buf, const void *septets, size_t len,
+                     unsigned shift);
+
+/**
+ * Unpacks septets from octets (3GPP TS 23.038 §6.1.2.1).
+ * @param buf output buffer for len septets (one per byte)
+ * @param packed packed septets, (shift + 7 * len + 7) / 8 octets
+ * @param len number of septets
+ * @param shift number of fill bits before the first septet (0-6)
+ * @return the number of octets read.
+ */
+size_t at_gsm7_unpack (void *buf, const void *packed, size_t len,
+                       unsigned shift);
+
 /** @} */
 
 /**
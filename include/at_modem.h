@@ -44,6 +44,8 @@
 #ifndef MATD_MODEM_H
 # define MATD_MODEM_H 1
 
+# include <sys/types.h> /* ssize_t */
+
 # ifdef __cplusplus
 extern "C" {
 #endif
@@ -81,6 +83,72 @@ struct at_modem *at_modem_start (int ifd, int ofd, at_hangup_cb cb,
  */
 void at_modem_stop (struct at_modem *m);
 
+/**
+ * Callback prototype for output to the DTE (@ref at_modem_create()).
+ * It has the same semantics as write(); it may be called from any thread
+ * that sends output to the DTE, but never from two threads at once.
+ * @return the number of bytes written, or -1 on error
+ */
+typedef ssize_t (*at_sink_cb) (void *, const void *, size_t);
+
+/**
+ * Creates an AT modem without a thread, for use in an event loop.
+ * Input is passed with at_modem_feed() or at_modem_ready(), and commands
+ * are executed by the calling thread.
+ * Text input (e.g. AT+CMGS), data mode and the multiplexer read from and
+ * write to the DTE file descriptors directly, and block the caller
+ * meanwhile. They are not available without file descriptors.
+ * @param ifd file descriptor for input from the DTE (for at_modem_ready()),
+ *            or -1 if all input is passed with at_modem_feed()
+ * @param ofd file descriptor for output to the DTE, or -1 if sink is set
+ * @param sink callback for output to the DTE instead of ofd (or NULL)
+ * @param opaque data pointer for the sink callback
+ * @return NULL on error
+ */
+struct at_modem *at_modem_create (int ifd, int ofd, at_sink_cb sink,
+                                  void *opaque);
+
+/**
+ * Processes input bytes from the DTE for an AT modem created with
+ * at_modem_create(). Any complete command line is executed before this
+ * function returns.
+ * @return 0 on success, -1 if the modem hung up (see at_hangup()).
+ */
+int at_modem_feed (struct at_modem *m, const void *buf, size_t len);
+
+/**
+ * Reads and processes input from the DTE file descriptor of an AT modem
+ * created with at_modem_create(). This is meant to be called whenever the
+ * file descriptor is readable. It can be non-blocking.
+ * @return 0 on success, -1 at the end of the input stream, on error or if
+ * the modem hung up.
+ */
+int at_modem_ready (struct at_modem *m);
+
+/**
+ * Returns a file descriptor that becomes readable when unsolicited results
+ * are queued for an AT modem created with at_modem_create(). Unsolicited
+ * results are never written by the thread that produces them: they are sent
+ * by at_modem_flush(), at_modem_feed() and at_modem_ready().
+ */
+int at_modem_urc_fd (const struct at_modem *m);
+
+/**
+ * Sends the queued unsolicited results of an AT modem created with
+ * at_modem_create(). This is meant to be called whenever the file
+ * descriptor from at_modem_urc_fd() is readable, and when the returned
+ * timeout expires.
+ * @return the time in milliseconds until the next coalesced state report is
+ * due, or -1 if there are none.
+ */
+int at_modem_flush (struct at_modem *m);
+
+/**
+ * Destroys an AT modem created with at_modem_create().
+ * @param m AT modem (no-op if NULL)
+ */
+void at_modem_destroy (struct at_modem *m);
+
 /**
  * Preloads AT modem plugins. This is not required, but it makes
  * at_modem_start() and at_modem_stop() faster, especially if they are used
@@ -94,6 +162,13 @@ int at_load_plugins (void);
  */
 void at_unload_plugins (void);
 
+/**
+ * Logs the execution statistics of AT commands, if they are recorded.
+ * Recording is enabled with AT@PERF=1, or if the AT_PERF environment
+ * variable is set to 1 when the first AT modem is started.
+ */
+void at_log_command_stats (void);
+
 /** @} */
 
 # ifdef __cplusplus
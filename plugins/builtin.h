@@ -0,0 +1,61 @@
+/**
+ * @file builtin.h
+ * @brief Entry points renaming for plugins linked into libmatd
+ * @ingroup internal
+ */
+
+/* ***** BEGIN LICENSE BLOCK *****
+ * Version: MPL 1.1/GPL 2.0/LGPL 2.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is matd.
+ *
+ * The Initial Developer of the Original Code is
+ * remi.denis-courmont@nokia.com.
+ * Portions created by the Initial Developer are
+ * Copyright (C) 2012 Nokia Corporation and/or its subsidiary(-ies).
+ * All Rights Reserved.
+ *
+ * Contributor(s):
+ *
+ * Alternatively, the contents of this file may be used under the terms of
+ * either the GNU General Public License Version 2 or later (the "GPL"), or
+ * the GNU Lesser General Public License Version 2.1 or later (the "LGPL"),
+ * in which case the provisions of the GPL or the LGPL are applicable instead
+ * of those above. If you wish to allow use of your version of this file only
+ * under the terms of either the GPL or the LGPL, and not to allow others to
+ * use your version of this file under the terms of the MPL, indicate your
+ * decision by deleting the provisions above and replace them with the notice
+ * and other provisions required by the GPL or the LGPL. If you do not delete
+ * the provisions above, a recipient may use your version of this file under
+ * the terms of any one of the MPL, the GPL or the LGPL.
+ *
+ * ***** END LICENSE BLOCK ***** */
+
+/*
+ * This header is forcibly included by plugins built with
+ * --enable-builtin-plugins. AT_PLUGIN is the plugin name, as found in the
+ * generated table of built-in plugins.
+ */
+
+#ifndef AT_BUILTIN_H
+# define AT_BUILTIN_H 1
+
+# define AT_BUILTIN_CONCAT(name, sym) at_builtin_##name##_##sym
+# define AT_BUILTIN_SYMBOL(name, sym) AT_BUILTIN_CONCAT(name, sym)
+
+# define at_plugin_register   AT_BUILTIN_SYMBOL(AT_PLUGIN, register)
+# define at_plugin_unregister AT_BUILTIN_SYMBOL(AT_PLUGIN, unregister)
+# define at_plugin_reset      AT_BUILTIN_SYMBOL(AT_PLUGIN, reset)
+# define at_plugin_table      AT_BUILTIN_SYMBOL(AT_PLUGIN, table)
+
+#endif
@@ -105,11 +105,8 @@ static at_error_t set_cclk (at_modem_t *modem, const char *req, void *data)
 	return AT_OK;
 }
 
-void *at_plugin_register (at_commands_t *set)
-{
-	at_register_ext (set, "+CCLK", set_cclk, get_cclk, NULL,
-	                 (void *)(intptr_t)'+');
-	at_register_ext (set, "$CCLK", set_cclk, get_cclk, NULL,
-	                 (void *)(intptr_t)'$'); /* AT&T */
-	return NULL;
-}
+const at_command_t at_plugin_table[] = {
+	{ "+CCLK", set_cclk, get_cclk, NULL, (void *)(intptr_t)'+' },
+	{ "$CCLK", set_cclk, get_cclk, NULL, (void *)(intptr_t)'$' }, /* AT&T */
+	{ NULL, NULL, NULL, NULL, NULL },
+};
@@ -298,6 +298,21 @@ static void at_register_zero (at_commands_t *set, const char *cmd)
 	at_register_ext (set, cmd, set_zero, get_zero, list_zero, (void *)cmd);
 }
 
+/** Sets the default values (as after ATZ) */
+static void dummy_defaults (dummy_t *d)
+{
+	d->s6 = 2; /* pause before blind calling */
+	d->s7 = 50; /* fake: call answering/alerting timeout */
+	d->s8 = 2; /* fake: dial string comma duration */
+	d->s10 = 2; /* fake: disconnection timeout */
+	d->cpnstat = 0;
+	d->dr = 0;
+	d->ds_dir = 3;
+	d->ds_nego = 0;
+	d->ds_dict = 512;
+	d->ds_string = 6;
+}
+
 void *at_plugin_register (at_commands_t *set)
 {
 	dummy_t *d = malloc  (sizeof (*d));
@@ -313,18 +328,15 @@ void *at_plugin_register (at_commands_t *set)
 	at_register_alpha (set, 'T', alpha_nothing, NULL);
 	if (d != NULL)
 	{
+		dummy_defaults (d);
 		/* pause before blind calling */
-		d->s6 = 2;
 		at_register_s (set, 6, set_s6, get_s6, d);
 
 		/* fake: call answering/alerting timeout */
-		d->s7 = 50;
 		at_register_s (set, 7, set_byte, get_byte, &d->s7);
 		/* fake: dial string comma duration */
-		d->s8 = 2;
 		at_register_s (set, 8, set_byte, get_byte, &d->s8);
 		/* fake: disconnection timeout */
-		d->s10 = 2;
 		at_register_s (set, 10, set_byte, get_byte, &d->s10);
 	}
 
@@ -342,7 +354,6 @@ void *at_plugin_register (at_commands_t *set)
 
 	if (d != NULL)
 	{
-		d->cpnstat = 0;
 		at_register_ext (set, "+CPNSTAT", set_cpnstat, get_cpnstat,
 		                 list_cpnstat, d);
 	}
@@ -351,13 +362,20 @@ void *at_plugin_register (at_commands_t *set)
 
 	if (d != NULL)
 	{
-		d->dr = 0;
 		at_register_ext (set, "+DR", set_dr, get_dr, list_dr, d);
-		d->ds_dir = 3;
-		d->ds_nego = 0;
-		d->ds_dict = 512;
-		d->ds_string = 6;
 		at_register_ext (set, "+DS", set_ds, get_ds, list_ds, d);
 	}
 	return d;
 }
+
+void at_plugin_unregister (void *opaque)
+{
+	free (opaque);
+}
+
+void at_plugin_reset (void *opaque)
+{
+	dummy_t *d = opaque;
+	if (d != NULL)
+		dummy_defaults (d);
+}
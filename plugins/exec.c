@@ -81,12 +81,9 @@ static at_error_t start (at_modem_t *modem, const char *req, void *data)
 }
 
 
-void *at_plugin_register (at_commands_t *set)
-{
-	at_register_ext (set, "@HALT", start, NULL, NULL, (void *)"/sbin/halt");
-	at_register_ext (set, "@POWEROFF", start, NULL, NULL,
-	                 (void *)"/sbin/poweroff");
-	at_register_ext (set, "@REBOOT", start, NULL, NULL,
-	                 (void *)"/sbin/reboot");
-	return NULL;
-}
+const at_command_t at_plugin_table[] = {
+	{ "@HALT", start, NULL, NULL, (void *)"/sbin/halt" },
+	{ "@POWEROFF", start, NULL, NULL, (void *)"/sbin/poweroff" },
+	{ "@REBOOT", start, NULL, NULL, (void *)"/sbin/reboot" },
+	{ NULL, NULL, NULL, NULL, NULL },
+};
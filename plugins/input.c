@@ -324,6 +324,11 @@ static at_error_t list_cmer (at_modem_t *m, void *opaque)
 	return AT_OK;
 }
 
+const at_command_t at_plugin_table[] = {
+	{ "+CMER", set_cmer, get_cmer, list_cmer, NULL },
+	{ NULL, NULL, NULL, NULL, NULL },
+};
+
 void *at_plugin_register (at_commands_t *set)
 {
 	cmer_t *cmer = malloc (sizeof (*cmer));
@@ -335,8 +340,7 @@ void *at_plugin_register (at_commands_t *set)
 	cmer->enabled = false;
 	cmer->depressed = false;
 	cmer->x = cmer->y = 0;
-
-	at_register_ext (set, "+CMER", set_cmer, get_cmer, list_cmer, cmer);
+	(void) set;
 	return cmer;
 }
 
@@ -350,3 +354,14 @@ void at_plugin_unregister (void *opaque)
 	set_cmer (NULL, "0,0,0,0,0,0", cmer);
 	free (cmer);
 }
+
+void at_plugin_reset (void *opaque)
+{
+	cmer_t *cmer = opaque;
+	if (cmer == NULL)
+		return;
+
+	set_cmer (NULL, "0,0,0,0,0,0", cmer);
+	cmer->depressed = false;
+	cmer->x = cmer->y = 0;
+}
@@ -430,3 +430,12 @@ void at_plugin_unregister (void *data)
 {
 	free (data);
 }
+
+void at_plugin_reset (void *data)
+{
+	plugin_t *p = data;
+	if (p == NULL)
+		return;
+
+	p->fc[0] = p->fc[1] = 2;
+}
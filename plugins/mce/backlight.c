@@ -316,6 +316,11 @@ static at_error_t list_bklt (at_modem_t *modem, void *opaque)
 
 /*** Plugin registration ***/
 
+const at_command_t at_plugin_table[] = {
+	{ "+CBKLT", set_bklt, get_bklt, list_bklt, NULL },
+	{ NULL, NULL, NULL, NULL, NULL },
+};
+
 void *at_plugin_register (at_commands_t *set)
 {
 	backlight_t *backlight = malloc (sizeof (*backlight));
@@ -323,9 +328,7 @@ void *at_plugin_register (at_commands_t *set)
 		return NULL;
 
 	backlight->active = false;
-
-	at_register_ext (set, "+CBKLT", set_bklt, get_bklt, list_bklt, backlight);
-
+	(void) set;
 	return backlight;
 }
 
@@ -334,8 +337,17 @@ void at_plugin_unregister (void *opaque)
 	backlight_t *backlight = opaque;
 
 	if (backlight == NULL)
-		return; /* TODO: error value for at_plugin_register() */
+		return;
 
 	disable_bklt (backlight);
 	free (backlight);
 }
+
+void at_plugin_reset (void *opaque)
+{
+	backlight_t *backlight = opaque;
+	if (backlight == NULL)
+		return;
+
+	disable_bklt (backlight);
+}
@@ -63,7 +63,8 @@ static void ccm_callback (plugin_t *p, DBusMessageIter *value, void *data)
 	dbus_uint32_t ccm;
 
 	dbus_message_iter_get_basic (value, &ccm);
-	at_unsolicited (modem, "\r\n+CCCM: \"%06"PRIX32"\"\r\n", ccm);
+	at_unsolicited_state (modem, "+CCCM", "\r\n+CCCM: \"%06"PRIX32"\"\r\n",
+	                      ccm);
 	(void) p;
 }
 
@@ -328,3 +329,10 @@ void call_meter_unregister (plugin_t *p)
 	if (p->caoc_filter != NULL)
 		ofono_prop_unwatch (p->caoc_filter);
 }
+
+void call_meter_reset (plugin_t *p)
+{
+	call_meter_unregister (p);
+	p->caoc_filter = NULL;
+	p->ccwe_filter = NULL;
+}
@@ -413,6 +413,15 @@ static at_error_t list_ccwa (at_modem_t *modem, void *data)
 
 /*** Registration ***/
 
+void call_settings_reset (plugin_t *p)
+{
+	p->clip = false;
+	p->colp = false;
+	p->cdip = false;
+	p->cnap = false;
+	p->ccwa = false;
+}
+
 void call_settings_register (at_commands_t *set, plugin_t *p)
 {
 	p->clip = false;
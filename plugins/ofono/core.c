@@ -211,6 +211,7 @@ at_error_t ofono_request (const char *path, const char *subif,
 DBusMessage *modem_req_new (const plugin_t *p, const char *subif,
                             const char *method)
 {
+	manager_wait (p);
 	if (!p->modemc)
 		return NULL;
 
@@ -223,6 +224,7 @@ at_error_t modem_request (const plugin_t *p, const char *subif,
 	at_error_t ret;
 	va_list ap;
 
+	manager_wait (p);
 	if (!p->modemc)
 		return AT_CME_ERROR_0;
 
@@ -393,6 +395,7 @@ out:
 at_error_t voicecall_request (const plugin_t *p, unsigned callid,
                               const char *method, int first, ...)
 {
+	manager_wait (p);
 	if (!p->modemc)
 		return AT_CME_ERROR_0;
 
@@ -496,7 +499,7 @@ static char *manager_find (char ***modemlist, unsigned *modemcount)
 
 static const char csus_path[] = STATEDIR"/csus";
 
-static unsigned modem_read_current (const plugin_t *p)
+static unsigned modem_read_current (char **modemv, unsigned modemc)
 {
 	int fd = open (csus_path, O_RDONLY | O_CLOEXEC);
 	if (fd == -1)
@@ -521,8 +524,8 @@ static unsigned modem_read_current (const plugin_t *p)
 	}
 	buf[val] = '\0';
 
-	for (unsigned id = 0; id < p->modemc; id++)
-		if (!strcmp (buf, p->modemv[id]))
+	for (unsigned id = 0; id < modemc; id++)
+		if (!strcmp (buf, modemv[id]))
 		{
 			debug ("Saved modem %s found (AT+CSUS=%u)", buf, id);
 			return id;
@@ -532,6 +535,152 @@ static unsigned modem_read_current (const plugin_t *p)
 	return 0;
 }
 
+/**
+ * oFono modems, shared by all plugin instances. They are looked up once per
+ * process, in the background, rather than delay every AT modem.
+ */
+static struct
+{
+	pthread_mutex_t use; /**< serializes starting and joining the lookup */
+	unsigned refs; /**< plugin instances */
+	pthread_t thread;
+	bool joinable; /**< whether the lookup thread was started */
+
+	pthread_mutex_t lock;
+	pthread_cond_t wait;
+	bool ready; /**< whether the lookup is complete */
+	char *name; /**< oFono daemon D-Bus name, NULL if not found */
+	char **modemv;
+	unsigned modemc;
+	unsigned saved; /**< saved modem selection (AT+CSUS) */
+} manager = {
+	PTHREAD_MUTEX_INITIALIZER, 0, 0, false,
+	PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, false, NULL, NULL,
+	0, 0,
+};
+
+static void *manager_thread (void *data)
+{
+	char **modemv;
+	unsigned modemc;
+
+	at_cancel_disable ();
+
+	char *name = manager_find (&modemv, &modemc);
+	if (name == NULL)
+		error ("Not using oFono");
+	else
+		debug ("Using oFono %s", name);
+	for (unsigned i = 0; i < modemc; i++)
+		debug (" modem %u: %s", i, modemv[i]);
+
+	unsigned saved = modem_read_current (modemv, modemc);
+
+	pthread_mutex_lock (&manager.lock);
+	manager.name = name;
+	manager.modemv = modemv;
+	manager.modemc = modemc;
+	manager.saved = saved;
+	manager.ready = true;
+	pthread_cond_broadcast (&manager.wait);
+	pthread_mutex_unlock (&manager.lock);
+	(void) data;
+	return NULL;
+}
+
+static void manager_free (void)
+{
+	for (unsigned i = 0; i < manager.modemc; i++)
+		free (manager.modemv[i]);
+	free (manager.modemv);
+	free (manager.name);
+	manager.name = NULL;
+	manager.modemv = NULL;
+	manager.modemc = 0;
+	manager.ready = false;
+}
+
+static void manager_stop (void)
+{
+	if (manager.joinable)
+		pthread_join (manager.thread, NULL);
+	manager.joinable = false;
+	pthread_mutex_lock (&manager.lock);
+	manager_free ();
+	pthread_mutex_unlock (&manager.lock);
+}
+
+/**
+ * Starts looking the oFono modems up, unless already done or in progress.
+ * The lookup is retried if oFono was not found before.
+ */
+static void manager_hold (void)
+{
+	pthread_mutex_lock (&manager.use);
+	if (manager.refs++ > 0)
+	{
+		pthread_mutex_lock (&manager.lock);
+		bool retry = manager.ready && manager.name == NULL;
+		pthread_mutex_unlock (&manager.lock);
+
+		if (!retry)
+			goto out;
+		/* Instances already using the empty list keep it */
+		manager_stop ();
+	}
+
+	manager.joinable = !at_thread_create (&manager.thread, manager_thread,
+	                                      NULL);
+	if (!manager.joinable)
+	{	/* Carry on without oFono rather than wait forever */
+		pthread_mutex_lock (&manager.lock);
+		manager.ready = true;
+		pthread_cond_broadcast (&manager.wait);
+		pthread_mutex_unlock (&manager.lock);
+	}
+out:
+	pthread_mutex_unlock (&manager.use);
+}
+
+static void manager_release (void)
+{
+	pthread_mutex_lock (&manager.use);
+	assert (manager.refs > 0);
+	if (--manager.refs == 0)
+		manager_stop ();
+	pthread_mutex_unlock (&manager.use);
+}
+
+/**
+ * Waits until the oFono modems are known, and selects the saved modem for
+ * the plugin instance the first time.
+ */
+void manager_wait (const plugin_t *cp)
+{
+	plugin_t *p = (plugin_t *)cp;
+
+	if (__atomic_load_n (&p->manager_ready, __ATOMIC_ACQUIRE))
+		return;
+
+	int canc = at_cancel_disable ();
+
+	pthread_mutex_lock (&manager.lock);
+	while (!manager.ready)
+		pthread_cond_wait (&manager.wait, &manager.lock);
+	pthread_mutex_lock (&p->modem_lock);
+	if (!p->manager_ready)
+	{
+		p->name = manager.name;
+		p->modemv = manager.modemv;
+		p->modemc = manager.modemc;
+		p->modem = (manager.saved < p->modemc) ? manager.saved : 0;
+		__atomic_store_n (&p->manager_ready, true, __ATOMIC_RELEASE);
+	}
+	pthread_mutex_unlock (&p->modem_lock);
+	pthread_mutex_unlock (&manager.lock);
+	at_cancel_enable (canc);
+}
+
 void modem_write_current (const plugin_t *p)
 {
 	assert (p->modem < p->modemc);
@@ -544,6 +693,12 @@ void modem_write_current (const plugin_t *p)
 		return;
 	}
 
+	/* Later plugin instances select the same modem */
+	pthread_mutex_lock (&manager.lock);
+	if (manager.modemv == p->modemv)
+		manager.saved = p->modem;
+	pthread_mutex_unlock (&manager.lock);
+
 	const char *str = p->modemv[p->modem];
 	size_t len = strlen (str);
 	ssize_t val;
@@ -589,9 +744,7 @@ static DBusHandlerResult ofono_signal_matcher (DBusConnection *conn,
 	plugin_t *p = s->p;
 	const char *data;
 
-	if (dbus_message_get_type (msg) != DBUS_MESSAGE_TYPE_SIGNAL
-	 || p->name == NULL
-	 || !dbus_message_has_sender (msg, s->p->name))
+	if (dbus_message_get_type (msg) != DBUS_MESSAGE_TYPE_SIGNAL)
 		return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
 
 	(void)conn;
@@ -609,6 +762,14 @@ static DBusHandlerResult ofono_signal_matcher (DBusConnection *conn,
 	  || strcmp (s->arg0, data)))
 		return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
 
+	/* A signal may arrive (e.g. an incoming call) before the modem list is
+	 * known. Wait for it rather than lose the signal. The lookup does not
+	 * depend on this thread: the D-Bus reply is read by the waiting caller. */
+	manager_wait (p);
+	if (p->name == NULL
+	 || !dbus_message_has_sender (msg, p->name))
+		return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+
 	switch (s->object)
 	{
 		case OFONO_ANY:
@@ -774,22 +935,13 @@ void *at_plugin_register (at_commands_t *set)
 	if (p == NULL)
 		return NULL;
 
-	p->name = manager_find (&p->modemv, &p->modemc);
-	if (p->name == NULL)
-	{
-#if 0
-		free (p);
-		return NULL;
-#else
-		error ("Not using oFono");
-#endif
-	}
-	else
-		debug ("Using oFono %s", p->name);
-	for (unsigned i = 0; i < p->modemc; i++)
-		debug (" modem %u: %s", i, p->modemv[i]);
-	p->modem = modem_read_current (p);
+	p->name = NULL;
+	p->modemv = NULL;
+	p->modemc = 0;
+	p->modem = 0;
+	p->manager_ready = false;
 	pthread_mutex_init (&p->modem_lock, NULL);
+	manager_hold ();
 
 	modem_register (set, p);
 	agps_register (set, p);
@@ -812,15 +964,30 @@ void at_plugin_unregister (void *opaque)
 	if (p == NULL)
 		return;
 
+	/* Let signal filters blocked on the lookup return before freeing */
+	manager_wait (p);
 	call_meter_unregister (p);
 	gprs_unregister (p);
 	network_unregister (p);
 	ss_unregister (p);
 	voicecallmanager_unregister (p);
 	pthread_mutex_destroy (&p->modem_lock);
-	for (unsigned i = 0; i < p->modemc; i++)
-		free (p->modemv[i]);
-	free (p->modemv);
-	free (p->name);
 	free (p);
+	manager_release ();
+}
+
+void at_plugin_reset (void *opaque)
+{
+	plugin_t *p = opaque;
+	if (p == NULL)
+		return;
+
+	/* Restore session parameters, keep the oFono modem selection */
+	call_meter_reset (p);
+	call_settings_reset (p);
+	gprs_reset (p);
+	network_reset (p);
+	sms_reset (p);
+	ss_reset (p);
+	voicecallmanager_reset (p);
 }
@@ -42,11 +42,12 @@
 
 struct plugin
 {
-	char *name; /**< oFono daemon D-Bus name */
-	char **modemv; /**< List of oFono modems */
+	char *name; /**< oFono daemon D-Bus name (shared) */
+	char **modemv; /**< List of oFono modems (shared) */
 	unsigned modemc; /**< Number of modems */
 	unsigned modem; /**< Index of currently selected modem */
 	pthread_mutex_t modem_lock;
+	bool manager_ready; /**< Whether the modem list is known */
 
 	unsigned char vhu; /**< AT+CVHU */
 	bool cring; /**< AT+CRC */
@@ -77,4 +78,5 @@ struct plugin
 	ofono_watch_t *ussd_filter; /**< AT+CUSD */
 };
 
+void manager_wait (const plugin_t *);
 void modem_write_current (const plugin_t *);
@@ -102,7 +102,7 @@ static void gprs_att_cb (plugin_t *p, DBusMessageIter *value, void *data)
 	if (attach)
 		ofono_netreg_print (m, p, "+CGREG", -1);
 	else
-		at_unsolicited (m, "\r\n+CGREG: 0\r\n");
+		at_unsolicited_state (m, "+CGREG", "\r\n+CGREG: 0\r\n");
 }
 
 static void gprs_reg_cb (plugin_t *p, DBusMessage *msg, void *data)
@@ -110,8 +110,8 @@ static void gprs_reg_cb (plugin_t *p, DBusMessage *msg, void *data)
 	at_modem_t *m = data;
 	const char *prop;
 
-	/* FIXME: We should only print one message if several details change
-	 * at once. */
+	/* Several details often change at once: only the last report is
+	 * delivered (see at_unsolicited_state()). */
 	if (!dbus_message_get_args (msg, NULL, DBUS_TYPE_STRING, &prop,
 				    DBUS_TYPE_INVALID)
 	 || (strcmp (prop, "Status") && strcmp (prop, "CellId")
@@ -122,7 +122,7 @@ static void gprs_reg_cb (plugin_t *p, DBusMessage *msg, void *data)
 	if (modem_prop_get_bool (p, "ConnectionManager", "Attached") == 1)
 		ofono_netreg_print (m, p, "+CGREG", -1);
 	else
-		at_unsolicited (m, "\r\n+CGREG: 0\r\n");
+		at_unsolicited_state (m, "+CGREG", "\r\n+CGREG: 0\r\n");
 }
 
 static at_error_t set_cgreg (at_modem_t *modem, const char *req, void *data)
@@ -195,3 +195,11 @@ void gprs_unregister (plugin_t *p)
 	if (p->cgatt_filter)
 		ofono_prop_unwatch (p->cgatt_filter);
 }
+
+void gprs_reset (plugin_t *p)
+{
+	gprs_unregister (p);
+	p->cgreg = 0;
+	p->cgreg_filter = NULL;
+	p->cgatt_filter = NULL;
+}
@@ -563,8 +563,9 @@ at_error_t ofono_netreg_print (at_modem_t *modem, plugin_t *p,
 			at_intermediate (modem, "\r\n%s: %d,%u,\"%04X\",\"%X\",%u", prefix,
 			                 n, status, lac, cellid, tech);
 		else
-			at_unsolicited (modem, "\r\n%s: %u,\"%04X\",\"%X\",%u\r\n", prefix,
-			                status, lac, cellid, tech);
+			at_unsolicited_state (modem, prefix,
+			                      "\r\n%s: %u,\"%04X\",\"%X\",%u\r\n",
+			                      prefix, status, lac, cellid, tech);
 	}
 	else
 	{
@@ -572,7 +573,8 @@ at_error_t ofono_netreg_print (at_modem_t *modem, plugin_t *p,
 		if (n >= 0)
 			at_intermediate (modem, "\r\n%s: %d,%u", prefix, n, status);
 		else
-			at_unsolicited (modem, "\r\n%s: %u\r\n", prefix, status);
+			at_unsolicited_state (modem, prefix, "\r\n%s: %u\r\n", prefix,
+			                      status);
 	}
 
 	if (msg != NULL)
@@ -586,8 +588,8 @@ static void unsoli_creg (plugin_t *p, DBusMessage *msg, void *data)
 	at_modem_t *m = data;
 	const char *prop;
 
-	/* FIXME: We should only print one message if several details change
-	 * at once. */
+	/* Several details often change at once: only the last report is
+	 * delivered (see at_unsolicited_state()). */
 
 	if (!dbus_message_get_args (msg, NULL, DBUS_TYPE_STRING, &prop,
 				    DBUS_TYPE_INVALID)
@@ -708,3 +710,11 @@ void network_unregister (plugin_t *p)
 	if (p->creg_filter)
 		ofono_signal_unwatch (p->creg_filter);
 }
+
+void network_reset (plugin_t *p)
+{
+	network_unregister (p);
+	p->cops = 2;
+	p->creg = 0;
+	p->creg_filter = NULL;
+}
@@ -265,16 +265,23 @@ void agps_register (at_commands_t *, plugin_t *);
 void call_forwarding_register (at_commands_t *, plugin_t *);
 void call_meter_register (at_commands_t *, plugin_t *);
 void call_meter_unregister (plugin_t *);
+void call_meter_reset (plugin_t *);
 void call_settings_register (at_commands_t *, plugin_t *);
+void call_settings_reset (plugin_t *);
 void gprs_register (at_commands_t *, plugin_t *);
 void gprs_unregister (plugin_t *);
+void gprs_reset (plugin_t *);
 void network_register (at_commands_t *, plugin_t *);
 void network_unregister (plugin_t *);
+void network_reset (plugin_t *);
 void sim_register (at_commands_t *, plugin_t *);
 void sms_register (at_commands_t *, plugin_t *);
+void sms_reset (plugin_t *);
 void ss_register (at_commands_t *, plugin_t *);
 void ss_unregister (plugin_t *);
+void ss_reset (plugin_t *);
 void voicecallmanager_register (at_commands_t *, plugin_t *);
 void voicecallmanager_unregister (plugin_t *);
+void voicecallmanager_reset (plugin_t *);
 at_error_t set_cnti (at_modem_t *, const char *, void *);
 at_error_t list_cnti (at_modem_t *, void *);
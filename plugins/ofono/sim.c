@@ -576,6 +576,7 @@ static at_error_t set_csus (at_modem_t *modem, const char *req, void *data)
 
 	if (sscanf (req, "%u", &slot) != 1)
 		return AT_CME_EINVAL;
+	manager_wait (p);
 	if (slot >= p->modemc)
 		return AT_CME_EINVAL;
 
@@ -590,6 +591,7 @@ static at_error_t get_csus (at_modem_t *modem, void *data)
 {
 	plugin_t *p = data;
 
+	manager_wait (p);
 	if (!p->modemc)
 		return AT_CME_ERROR_0;
 	return at_intermediate (modem, "\r\n+CSUS: %u", p->modem);
@@ -599,6 +601,7 @@ static at_error_t list_csus (at_modem_t *modem, void *data)
 {
 	plugin_t *p = data;
 
+	manager_wait (p);
 	switch (p->modemc)
 	{
 		case 0:
@@ -291,6 +291,40 @@ static int hexdigit (char c)
 	return -1;
 }
 
+/** Hexadecimal PDU decoder state (see at_read_text_spans()) */
+struct pdu_decoder
+{
+	uint8_t *buf;
+	size_t size, bytes;
+	int hinib; /**< Pending high nibble, -1 if none */
+	bool done; /**< Reached the end of the hexadecimal PDU */
+};
+
+static int decode_pdu (void *opaque, const char *span, size_t len)
+{
+	struct pdu_decoder *d = opaque;
+
+	for (size_t i = 0; i < len && !d->done; i++)
+	{
+		int nib = hexdigit (span[i]);
+
+		if (d->hinib < 0)
+		{
+			if (nib < 0)
+				d->done = true; /* ignore trailing garbage */
+			else
+				d->hinib = nib;
+			continue;
+		}
+
+		if (nib < 0 || d->bytes >= d->size)
+			return 1;
+		d->buf[d->bytes++] = (d->hinib << 4) | nib;
+		d->hinib = -1;
+	}
+	return 0;
+}
+
 static at_error_t send_pdu (at_modem_t *m, const char *req, void *data)
 {
 	at_error_t ret = AT_CMS_ENOMEM;
@@ -300,30 +334,36 @@ static at_error_t send_pdu (at_modem_t *m, const char *req, void *data)
 		return AT_CMS_PDU_EINVAL;
 
 	plugin_t *p = data;
-	/* Read hexadecimal PDU */
-	char *pdu = at_read_text (m, "\r\n> ");
+	/* SMSC address (up to 255 bytes with its length) and TPDU */
+	struct pdu_decoder d = {
+		.buf = malloc (256 + len), .size = 256 + len, .bytes = 0,
+		.hinib = -1, .done = false,
+	};
+	uint8_t *pdu = d.buf;
 	if (pdu == NULL)
-		return AT_OK;
+		return AT_CMS_ENOMEM;
 
-	ret = AT_CMS_PDU_EINVAL;
-	/* Convert to binary */
-	dbus_uint32_t bytes = 0;
-	for (char *in = pdu, *out = pdu; *in; bytes++)
+	/* Read and convert hexadecimal PDU to binary */
+	switch (at_read_text_spans (m, "\r\n> ", decode_pdu, &d))
 	{
-		int hinib = hexdigit (*(in++));
-		if (hinib < 0)
-			break;
-		int lonib = hexdigit (*(in++));
-
-		if (lonib < 0)
+		case -1:
+			free (pdu);
+			return AT_OK;
+		case 0:
+			if (d.done || d.hinib < 0)
+				break;
+			/* odd number of hexadecimal digits */
+			/* fallthrough */
+		default:
+			ret = AT_CMS_PDU_EINVAL;
 			goto err;
-
-		*(out++) = (hinib << 4) | lonib;
 	}
 
+	dbus_uint32_t bytes = d.bytes;
 	if (bytes < 1u || bytes != 1u + pdu[0] + len)
 	{
 		warning ("discarded invalid SMS PDU (%u bytes)", (unsigned)bytes);
+		ret = AT_CMS_PDU_EINVAL;
 		goto err;
 	}
 
@@ -417,6 +457,11 @@ static at_error_t list_mms (at_modem_t *m, void *data)
 
 /*** Registration ***/
 
+void sms_reset (plugin_t *p)
+{
+	p->text_mode = false;
+}
+
 void sms_register (at_commands_t *set, plugin_t *p)
 {
 	at_register_ext (set, "+CGSMS", set_cgsms, get_cgsms, list_cgsms, p);
@@ -322,3 +322,9 @@ void ss_unregister (plugin_t *p)
 	if (p->ussd_filter != NULL)
 		ofono_signal_unwatch (p->ussd_filter);
 }
+
+void ss_reset (plugin_t *p)
+{
+	ss_unregister (p);
+	p->ussd_filter = NULL;
+}
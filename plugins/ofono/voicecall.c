@@ -670,6 +670,7 @@ static at_error_t set_chld (at_modem_t *modem, const char *value, void *data)
 				char *call;
 				at_error_t ret;
 
+				manager_wait (p);
 				if (!p->modemc)
 					return AT_CME_ERROR_0;
 				if (asprintf (&call, "%s/voicecall%u", p->modemv[p->modem],
@@ -1073,7 +1074,7 @@ void voicecallmanager_register (at_commands_t *set, plugin_t *p)
 	                                     AT_COMMANDS_MODEM(set));
 }
 
-void voicecallmanager_unregister (plugin_t *p)
+void voicecallmanager_reset (plugin_t *p)
 {
 	if (p->barring_filter != NULL)
 		ofono_signal_unwatch (p->barring_filter);
@@ -1083,7 +1084,19 @@ void voicecallmanager_unregister (plugin_t *p)
 		ofono_prop_unwatch (p->mpty_filter);
 	if (p->fwd_filter != NULL)
 		ofono_signal_unwatch (p->fwd_filter);
-	ofono_signal_unwatch (p->ring_filter);
 	if (p->vhu == 2)
 		handle_hangup (NULL, 'H', p);
+
+	p->cring = false;
+	p->barring_filter = NULL;
+	p->hold_filter = NULL;
+	p->mpty_filter = NULL;
+	p->fwd_filter = NULL;
+	p->vhu = 0;
+}
+
+void voicecallmanager_unregister (plugin_t *p)
+{
+	voicecallmanager_reset (p);
+	ofono_signal_unwatch (p->ring_filter);
 }
@@ -74,8 +74,11 @@ QTM_USE_NAMESPACE
 class QATPhonebook
 {
 	private:
+		QString mgrName;
 		QContactManager *mgr;
 
+		QContactManager *manager();
+
 		static at_error_t readCb(at_modem_t *, unsigned, unsigned, void *);
 		at_error_t read(at_modem_t *, unsigned, unsigned);
 		static at_error_t rangeCb(unsigned *, unsigned *, void *);
@@ -94,17 +97,33 @@ class QATPhonebook
 
 	public:
 		QATPhonebook(const QString& name = QString());
+		~QATPhonebook();
 		int registerPhonebook(at_commands_t *set, const char *id);
 };
 
 QATPhonebook::QATPhonebook(const QString& name)
+	: mgrName(name), mgr(NULL)
+{
+}
+
+QATPhonebook::~QATPhonebook()
+{
+	delete mgr;
+}
+
+/* Opening the contacts backend is slow: defer it until the phonebook is
+ * actually used, rather than delay the AT modem. Commands are serialized,
+ * so this needs no locking. */
+QContactManager *QATPhonebook::manager()
 {
-	this->mgr = new QContactManager (name);
+	if (mgr == NULL)
+		mgr = new QContactManager (mgrName);
+	return mgr;
 }
 
 at_error_t QATPhonebook::read(at_modem_t *m, unsigned start, unsigned end)
 {
-	QList<QContactLocalId> list = mgr->contactIds();
+	QList<QContactLocalId> list = manager()->contactIds();
 
 	end++;
 	if (end > list.count())
@@ -115,7 +134,7 @@ at_error_t QATPhonebook::read(at_modem_t *m, unsigned start, unsigned end)
 	for (unsigned i = start; i < end; i++)
 	{
 		QContactLocalId id = list.at(i);
-		QContact contact = mgr->contact(id);
+		QContact contact = manager()->contact(id);
 
 		QString name = contact.displayLabel();
 
@@ -150,7 +169,7 @@ at_error_t QATPhonebook::read(at_modem_t *m, unsigned start, unsigned end)
 
 at_error_t QATPhonebook::range(unsigned *startp, unsigned *endp)
 {
-	QList<QContactLocalId> list = mgr->contactIds();
+	QList<QContactLocalId> list = manager()->contactIds();
 	unsigned count = list.count();
 
 	if (count == 0)
@@ -187,10 +206,10 @@ at_error_t QATPhonebook::add(unsigned *idxp, const QString& phone,
 	address.setEmailAddress(email);
 	contact.saveDetail(&address);
 
-	if (!mgr->saveContact(&contact))
+	if (!manager()->saveContact(&contact))
 		return AT_CME_UNKNOWN;
 
-	QList<QContactLocalId> list = mgr->contactIds();
+	QList<QContactLocalId> list = manager()->contactIds();
 	unsigned count = list.count();
 
 	if (count == 0)
@@ -211,12 +230,12 @@ at_error_t QATPhonebook::edit(unsigned idx, const QString& num,
 
 at_error_t QATPhonebook::remove(unsigned idx)
 {
-	QList<QContactLocalId> list = mgr->contactIds();
+	QList<QContactLocalId> list = manager()->contactIds();
 
 	if (idx >= list.count())
 		return AT_CME_ENOENT;
 
-	return mgr->removeContact(list.at(idx)) ? AT_OK : AT_CME_UNKNOWN;
+	return manager()->removeContact(list.at(idx)) ? AT_OK : AT_CME_UNKNOWN;
 }
 
 /*** AT command callbacks ***/
@@ -292,3 +311,9 @@ void at_plugin_unregister(void *data)
 	QATPhonebook *pb = static_cast<QATPhonebook *>(data);
 	delete pb;
 }
+
+void at_plugin_reset(void *data)
+{
+	/* No session parameters */
+	(void) data;
+}
@@ -172,14 +172,12 @@ static at_error_t login (at_modem_t *modem, const char *req, void *data)
 }
 
 
-void *at_plugin_register (at_commands_t *set)
-{
-	at_register_ext (set, "@SH", sh, NULL, NULL, NULL);
-	at_register_ext (set, "@SHELL", shell, NULL, NULL, NULL);
-	at_register_ext (set, "@LOGIN", login, NULL, NULL, NULL);
-
-	return NULL;
-}
+const at_command_t at_plugin_table[] = {
+	{ "@SH", sh, NULL, NULL, NULL },
+	{ "@SHELL", shell, NULL, NULL, NULL },
+	{ "@LOGIN", login, NULL, NULL, NULL },
+	{ NULL, NULL, NULL, NULL, NULL },
+};
 
 #if 0
 void at_plugin_unregister (void *data)
@@ -1,5 +1,5 @@
 /**
- * @file pref.c
+ * @file perf.c
  * @brief AT commands for data performance stress test
  */
 
@@ -45,6 +45,11 @@
 #endif
 
 #include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <sys/un.h>
@@ -55,42 +60,162 @@
 #include <at_thread.h>
 
 #define BUFSIZE 4096
+/** Largest accepted MTU */
+#define MTU_MAX 65536
+
+/** Payload patterns */
+enum
+{
+	PATTERN_COUNTER, /**< Byte counter (0 to 255) */
+	PATTERN_TEXT, /**< RFC 864 character generator lines */
+	PATTERN_ZERO, /**< Null bytes */
+	PATTERN_RANDOM, /**< Pseudo-random bytes */
+	PATTERN_MAX = PATTERN_RANDOM
+};
+
+/** Data source or sink parameters */
+struct perf
+{
+	int fd; /**< Data mode socket */
+	unsigned pattern; /**< Payload pattern */
+	unsigned rate; /**< Maximum bytes per second, or 0 for unlimited */
+	uint64_t pos; /**< Pattern position */
+	uint32_t seed; /**< Pseudo-random generator state */
+	struct timespec start; /**< Start of rate limiting */
+	uint64_t bytes; /**< Bytes transferred since start */
+};
+
+/** Generates the next len bytes of the payload pattern. */
+static void pattern_fill (struct perf *p, unsigned char *buf, size_t len)
+{
+	switch (p->pattern)
+	{
+		case PATTERN_COUNTER:
+			for (size_t i = 0; i < len; i++)
+				buf[i] = p->pos + i;
+			break;
+
+		case PATTERN_TEXT:
+			/* 72 printable characters rotating per line, then CR LF */
+			for (size_t i = 0; i < len; i++)
+			{
+				uint64_t pos = p->pos + i;
+				unsigned col = pos % 74;
+
+				if (col < 72)
+					buf[i] = ' ' + ((pos / 74) + col) % 95;
+				else
+					buf[i] = (col == 72) ? '\r' : '\n';
+			}
+			break;
+
+		case PATTERN_ZERO:
+			memset (buf, 0, len);
+			break;
+
+		case PATTERN_RANDOM:
+			/* xorshift32 */
+			for (size_t i = 0; i < len; i++)
+			{
+				p->seed ^= p->seed << 13;
+				p->seed ^= p->seed >> 17;
+				p->seed ^= p->seed << 5;
+				buf[i] = p->seed;
+			}
+			break;
+	}
+	p->pos += len;
+}
+
+/** Bytes per system call, such that rate-limited traffic is smooth. */
+static size_t perf_chunk (const struct perf *p)
+{
+	size_t chunk = p->rate / 100;
+
+	if (p->rate == 0 || chunk > BUFSIZE)
+		return BUFSIZE;
+	return chunk ? chunk : 1;
+}
+
+/** Waits until transferring len more bytes complies with the rate. */
+static void perf_throttle (struct perf *p, size_t len)
+{
+	if (p->rate == 0)
+		return;
+
+	p->bytes += len;
+
+	uint64_t ns = p->bytes * UINT64_C(1000000000) / p->rate;
+	struct timespec ts = {
+		.tv_sec = p->start.tv_sec + ns / 1000000000,
+		.tv_nsec = p->start.tv_nsec + ns % 1000000000,
+	};
+
+	if (ts.tv_nsec >= 1000000000)
+	{
+		ts.tv_sec++;
+		ts.tv_nsec -= 1000000000;
+	}
+	while (clock_nanosleep (CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL)
+	        == EINTR);
+}
 
 static void *chargen (void *data)
 {
-	int fd = (intptr_t)data;
+	struct perf *p = data;
 	unsigned char buf[BUFSIZE];
+	size_t len = perf_chunk (p);
+	bool fixed = p->pattern == PATTERN_ZERO
+	          || (p->pattern == PATTERN_COUNTER && (len % 256) == 0);
 
-	for (size_t i = 0; i < sizeof (buf); i++)
-		buf[i] = i;
-
-	while (send (fd, buf, sizeof (buf), MSG_NOSIGNAL) >= 0);
+	pattern_fill (p, buf, len);
+	for (;;)
+	{
+		if (send (p->fd, buf, len, MSG_NOSIGNAL) < 0)
+			break;
+		perf_throttle (p, len);
+		if (!fixed)
+			pattern_fill (p, buf, len);
+	}
 
 	return NULL;
 }
 
 static void *discard (void *data)
 {
-	int fd = (intptr_t)data;
+	struct perf *p = data;
 	unsigned char buf[BUFSIZE];
+	size_t len = perf_chunk (p);
 
-	while (recv (fd, buf, sizeof (buf), 0) >= 0);
+	for (;;)
+	{
+		ssize_t val = recv (p->fd, buf, len, 0);
+		if (val < 0)
+			break;
+		perf_throttle (p, val);
+	}
 
 	return NULL;
 }
 
 static void *echo (void *data)
 {
-	int fd = (intptr_t)data;
+	struct perf *p = data;
 	unsigned char buf[BUFSIZE];
+	size_t len = perf_chunk (p);
 
 	for (;;)
 	{
-		ssize_t len = recv (fd, buf, sizeof (buf), 0);
-		if (len < 0)
+		ssize_t val = recv (p->fd, buf, len, 0);
+		if (val < 0)
 			break;
-		if (send (fd, buf, len, MSG_NOSIGNAL) < 0)
+		/* Reply with as many bytes of the pattern, unless it is the
+		 * (default) counter pattern, in which case echo verbatim. */
+		if (p->pattern != PATTERN_COUNTER)
+			pattern_fill (p, buf, val);
+		if (send (p->fd, buf, val, MSG_NOSIGNAL) < 0)
 			break;
+		perf_throttle (p, val);
 	}
 
 	return NULL;
@@ -113,12 +238,29 @@ static void cleanup_thread (void *data)
 }
 
 
+/** Data mode test command */
+struct perf_cmd
+{
+	const char *name;
+	void *(*func) (void *);
+};
+
+static const struct perf_cmd cmds[] = {
+	{ "@CHARGEN", chargen },
+	{ "@DISCARD", discard },
+	{ "@ECHO", echo },
+};
+
 static at_error_t forward (at_modem_t *modem, const char *req, void *data)
 {
-	void *(*func) (void *) = data;
+	const struct perf_cmd *cmd = data;
+	unsigned pattern = PATTERN_COUNTER, rate = 0, mtu = 0;
 	int fds[2];
 
-	if (*req)
+	/* AT@CMD[=<pattern>[,<rate>[,<mtu>]]] */
+	if (*req && sscanf (req, " %u , %u , %u", &pattern, &rate, &mtu) < 1)
+		return AT_CME_EINVAL;
+	if (pattern > PATTERN_MAX || mtu > MTU_MAX)
 		return AT_CME_EINVAL;
 
 #ifdef SOCK_CLOEXEC
@@ -132,9 +274,18 @@ static at_error_t forward (at_modem_t *modem, const char *req, void *data)
 		fcntl (fds[1], F_SETFD, FD_CLOEXEC);
 	}
 
+	struct perf p = {
+		.fd = fds[1],
+		.pattern = pattern,
+		.rate = rate,
+		.pos = 0,
+		.seed = 2463534242,
+		.bytes = 0,
+	};
 	pthread_t th;
 
-	if (at_thread_create (&th, func, (void *)(intptr_t)fds[1]))
+	clock_gettime (CLOCK_MONOTONIC, &p.start);
+	if (at_thread_create (&th, cmd->func, &p))
 	{
 		int canc = at_cancel_disable ();
 		close (fds[1]);
@@ -145,19 +296,28 @@ static at_error_t forward (at_modem_t *modem, const char *req, void *data)
 
 	pthread_cleanup_push (cleanup_fds, fds);
 	pthread_cleanup_push (cleanup_thread, &th);
-	at_connect (modem, fds[0]);
+	if (mtu)
+		at_connect_mtu (modem, fds[0], mtu);
+	else
+		at_connect (modem, fds[0]);
 	pthread_cleanup_pop (1);
 	pthread_cleanup_pop (1);
 
-	(void) req;
 	return AT_NO_CARRIER;
 }
 
-void *at_plugin_register (at_commands_t *set)
+static at_error_t list_forward (at_modem_t *modem, void *data)
 {
-	at_register_ext (set, "@CHARGEN", forward, NULL, NULL, chargen);
-	at_register_ext (set, "@DISCARD", forward, NULL, NULL, discard);
-	at_register_ext (set, "@ECHO", forward, NULL, NULL, echo);
+	const struct perf_cmd *cmd = data;
 
-	return NULL;
+	at_intermediate (modem, "\r\n%s: (0-%u),(0-4294967295),(0-%u)",
+	                 cmd->name, PATTERN_MAX, MTU_MAX);
+	return AT_OK;
 }
+
+const at_command_t at_plugin_table[] = {
+	{ "@CHARGEN", forward, NULL, list_forward, (void *)(cmds + 0) },
+	{ "@DISCARD", forward, NULL, list_forward, (void *)(cmds + 1) },
+	{ "@ECHO", forward, NULL, list_forward, (void *)(cmds + 2) },
+	{ NULL, NULL, NULL, NULL, NULL },
+};
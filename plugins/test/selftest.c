@@ -46,6 +46,8 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
 
 #include <at_command.h>
 
@@ -84,6 +86,72 @@ static at_error_t handle_error (at_modem_t *m, const char *req, void *data)
 	return err;
 }
 
+static at_error_t handle_urc (at_modem_t *m, const char *req, void *data)
+{
+	unsigned count, state = 0;
+
+	if (sscanf (req, " %u , %u", &count, &state) < 1)
+		return AT_ERROR;
+
+	/* Unsolicited results are held back until the final result */
+	for (unsigned i = 1; i <= count; i++)
+		if (state)
+			at_unsolicited_state (m, "@URC", "\r\n@URC: %u\r\n", i);
+		else
+			at_unsolicited (m, "\r\n@URC: %u\r\n", i);
+	at_intermediate (m, "\r\n@URC: 0");
+	(void) data;
+	return AT_OK;
+}
+
+static at_error_t handle_gsm7 (at_modem_t *m, const char *req, void *data)
+{
+	char text[64];
+	unsigned shift = 0;
+
+	if (sscanf (req, " \"%63[^\"]\" , %u", text, &shift) < 1 || shift > 6)
+		return AT_CME_EINVAL;
+
+	char *u8 = at_to_utf8 (m, text);
+	if (u8 == NULL)
+		return AT_CME_EINVAL;
+
+	size_t len;
+	uint8_t *septets = at_gsm7_encode (u8, &len);
+	free (u8);
+	if (septets == NULL)
+		return AT_CME_ENOTSUP;
+
+	/* Pack, then unpack and convert back to the AT+CSCS character set */
+	uint8_t packed[(6 + 7 * 2 * sizeof (text)) / 8 + 1];
+	uint8_t unpacked[2 * sizeof (text)];
+	char hex[2 * sizeof (packed) + 1], *str = NULL;
+	at_error_t ret = AT_ERROR;
+	size_t n = at_gsm7_pack (packed, septets, len, shift);
+
+	if (at_gsm7_unpack (unpacked, packed, len, shift) != n
+	 || memcmp (unpacked, septets, len))
+		goto out;
+
+	u8 = at_gsm7_decode (unpacked, len);
+	if (u8 != NULL)
+	{
+		str = at_from_utf8 (m, u8);
+		free (u8);
+	}
+	if (str == NULL || strcmp (str, text))
+		goto out;
+
+	for (size_t i = 0; i < n; i++)
+		sprintf (hex + 2 * i, "%02X", packed[i]);
+	hex[2 * n] = '\0';
+	ret = at_intermediate (m, "\r\n@GSM7: %zu,\"%s\"", len, hex);
+out:
+	free (str);
+	free (septets);
+	(void) data;
+	return ret;
+}
 
 void *at_plugin_register (at_commands_t *set)
 {
@@ -105,6 +173,9 @@ void *at_plugin_register (at_commands_t *set)
 	                     NULL) == 0)
 		abort ();
 
+	at_register_ext (set, "@URC", handle_urc, NULL, NULL, NULL);
+	at_register_ext (set, "@GSM7", handle_gsm7, NULL, NULL, NULL);
+
 	/* Too big ATS value - should fail */
 	if (at_register_s (set, 4000000000, fail_set, fail_get, NULL) == 0)
 		abort ();
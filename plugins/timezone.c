@@ -169,6 +169,11 @@ static at_error_t list_ctzr (at_modem_t *m, void *opaque)
 	return AT_OK;
 }
 
+const at_command_t at_plugin_table[] = {
+	{ "+CTZR", set_ctzr, get_ctzr, list_ctzr, NULL },
+	{ NULL, NULL, NULL, NULL, NULL },
+};
+
 void *at_plugin_register (at_commands_t *set)
 {
 	ctzr_t *ctzr = malloc (sizeof (*ctzr));
@@ -176,8 +181,7 @@ void *at_plugin_register (at_commands_t *set)
 		return NULL;
 
 	ctzr->enabled = false;
-
-	at_register_ext (set, "+CTZR", set_ctzr, get_ctzr, list_ctzr, ctzr);
+	(void) set;
 	return ctzr;
 }
 
@@ -190,3 +194,12 @@ void at_plugin_unregister (void *opaque)
 	set_ctzr (NULL, "0", ctzr);
 	free (ctzr);
 }
+
+void at_plugin_reset (void *opaque)
+{
+	ctzr_t *ctzr = opaque;
+	if (ctzr == NULL)
+		return;
+
+	set_ctzr (NULL, "0", ctzr);
+}
@@ -172,9 +172,7 @@ static at_error_t list_cbc (at_modem_t *m, void *data)
 	return AT_OK;
 }
 
-void *at_plugin_register (at_commands_t *set)
-{
-	at_register_ext (set, "+CBC", do_cbc, NULL, list_cbc, NULL);
-
-	return NULL;
-}
+const at_command_t at_plugin_table[] = {
+	{ "+CBC", do_cbc, NULL, list_cbc, NULL },
+	{ NULL, NULL, NULL, NULL, NULL },
+};
@@ -343,7 +343,7 @@ static int setup_touchscreen (int fd)
 static at_error_t set_ctsa (at_modem_t *m, const char *req, void *data)
 {
 	const struct timeval delay = { 0, 100000 };
-	uinput_t *uinput = data;
+	uinput_t *uinput = (uinput_t *)data + 1;
 	unsigned action, x, y;
 
 	if (!uinput->cmec)
@@ -518,22 +518,25 @@ static at_error_t list_cmec (at_modem_t *m, void *data)
 
 /*** Registration ***/
 
+const at_command_t at_plugin_table[] = {
+	{ "+CKPD", handle_keypad, NULL, NULL, NULL },
+	{ "+CTSA", set_ctsa, NULL, list_ctsa, NULL },
+	{ "+CSS", handle_css, NULL, NULL, NULL },
+	{ "+CMEC", set_cmec, get_cmec, list_cmec, NULL },
+	{ NULL, NULL, NULL, NULL, NULL },
+};
+
 void *at_plugin_register (at_commands_t *set)
 {
 	uinput_t *input = malloc (2 * sizeof (*input));
 	if (input == NULL)
 		return NULL;
 
-	input[0].fd = -1;
+	input[0].fd = -1; /* keypad */
 	input[0].cmec = 2;
-	at_register_ext (set, "+CKPD", handle_keypad, NULL, NULL, input + 0);
-
-	input[1].fd = -1;
+	input[1].fd = -1; /* touchscreen */
 	input[1].cmec = 2;
-	at_register_ext (set, "+CTSA", set_ctsa, NULL, list_ctsa, input + 1);
-	at_register_ext (set, "+CSS", handle_css, NULL, NULL, NULL);
-
-	at_register_ext (set, "+CMEC", set_cmec, get_cmec, list_cmec, input);
+	(void) set;
 	return input;
 }
 
@@ -547,3 +550,17 @@ void at_plugin_unregister (void *opaque)
 	destroy_uinput (input + 1);
 	free (input);
 }
+
+void at_plugin_reset (void *opaque)
+{
+	uinput_t *input = opaque;
+	if (input == NULL)
+		return;
+
+	for (unsigned i = 0; i < 2; i++)
+	{
+		destroy_uinput (input + i);
+		input[i].fd = -1;
+		input[i].cmec = 2;
+	}
+}
@@ -53,8 +53,11 @@
 #include <errno.h>
 #include <locale.h>
 #include <unistd.h>
+#include <poll.h>
 #include <termios.h>
 #include <sys/ioctl.h>
+#include <sys/uio.h>
+#include <sys/eventfd.h>
 
 #include <at_modem.h>
 #include <at_command.h>
@@ -63,6 +66,10 @@
 #include "error.h"
 #include "parser.h"
 #include "commands.h"
+#include "data.h"
+#include "cmux.h"
+#include "format.h"
+#include "urc.h"
 
 #if 0 //ndef NDEBUG
 #include <inttypes.h>
@@ -116,30 +123,67 @@ struct at_modem
 	unsigned hungup:1; /**< Forcefully hung up on DCE side */
 	unsigned reset:1; /**< ATZ: plugins re-init pending */
 	unsigned charset:6; /**< AT+CSCS */
-	/* one bit left */
+	unsigned mux:1; /**< AT+CMUX: multiplexer start pending */
 	uint16_t in_size; /**< Input buffer fill length */
 	uint16_t in_offset; /**< Input buffer read offset */
 	uint8_t  in_buf[1024]; /**< Input buffer */
+	bool cork; /**< Command line in progress: buffer output */
+	uint16_t out_size; /**< Output buffer fill length */
+	uint8_t  out_buf[4096]; /**< Output buffer (while corked) */
+	int urc_fd; /**< Signals queued URCs to the DTE thread or event loop */
+	at_urc_queue_t urc; /**< Unsolicited results held back */
+	at_urc_states_t states; /**< Latest unsolicited state reports */
+	uint64_t urc_due; /**< When pending state reports are due, or 0 */
 
 	struct
 	{
 		void	(*cb) (at_modem_t *, void *);
 		void	*opaque;
 	} hangup; /**< DTE hangup callback */
+	struct
+	{
+		at_sink_cb cb;
+		void	*opaque;
+	} sink; /**< Output callback used instead of fd_out (if not NULL) */
 
 	pthread_mutex_t lock; /**< Serializer for output to DTE */
 	pthread_t reader; /**< Thread handling data from the DTE */
 	locale_t locale; /**< C locale for formatted DTE input/output */
 
+	at_parser_t parser; /**< Command line parser state */
 	at_commands_t *commands; /**< Registered commands */
+	at_data_history_t data_history; /**< Data mode statistics */
+	at_mux_config_t mux_config; /**< AT+CMUX parameters */
 };
 
-static int at_write_unlocked (at_modem_t *m,
-                              const unsigned char *blob, size_t len)
+/**
+ * Writes buffered output, if any, then the given data to the DTE, with a
+ * single system call whenever possible.
+ */
+static int at_write_unlocked (at_modem_t *m, const void *blob, size_t len)
 {
-	while (len > 0)
+	struct iovec iov[2] = {
+		{ m->out_buf, m->out_size },
+		{ (void *)blob, len },
+	}, *v = iov;
+	int count = 2;
+
+	m->out_size = 0;
+	while (count > 0)
 	{
-		ssize_t val = write (m->fd_out, blob, len);
+		ssize_t val;
+
+		if (v->iov_len == 0)
+		{
+			v++;
+			count--;
+			continue;
+		}
+
+		if (m->sink.cb != NULL)
+			val = m->sink.cb (m->sink.opaque, v->iov_base, v->iov_len);
+		else
+			val = writev (m->fd_out, v, count);
 		if (val == -1)
 		{
 			if (errno == EINTR)
@@ -150,42 +194,203 @@ static int at_write_unlocked (at_modem_t *m,
 		if (val == 0)
 			return -1;
 
-		at_log_dump (blob, val, true);
-		blob += val;
-		len -= val;
+		while (val > 0)
+		{
+			size_t n = ((size_t)val < v->iov_len) ? (size_t)val : v->iov_len;
+
+			at_log_dump (v->iov_base, n, true);
+			v->iov_base = (uint8_t *)v->iov_base + n;
+			v->iov_len -= n;
+			val -= n;
+			if (v->iov_len == 0)
+			{
+				v++;
+				count--;
+			}
+		}
 	}
 	return 0;
 }
 
+/**
+ * Formats output at the end of the output buffer, flushing the buffer first
+ * if needed. The buffer thus serves as a scratch area for the command line.
+ * @return 0 on success, -1 if the output is too long or if the format is
+ * not supported (see at_vformat()).
+ */
+static int at_format_unlocked (at_modem_t *m, const char *fmt, va_list ap)
+{
+	for (;;)
+	{
+		size_t room = sizeof (m->out_buf) - m->out_size;
+		int len = at_vformat ((char *)m->out_buf + m->out_size, room, fmt, ap);
+
+		if (len == -1 || (size_t)len > sizeof (m->out_buf))
+			return -1;
+		if ((size_t)len <= room)
+		{
+			m->out_size += len;
+			return 0;
+		}
+		if (at_write_unlocked (m, NULL, 0))
+			return -1;
+	}
+}
+
+/**
+ * Outputs data to the DTE, or buffers it until the end of the command line.
+ * The buffer is flushed early if it would overflow.
+ */
+static int at_queue_unlocked (at_modem_t *m, const void *blob, size_t len)
+{
+	if (!m->cork || len > sizeof (m->out_buf) - m->out_size)
+		return at_write_unlocked (m, blob, len);
+
+	memcpy (m->out_buf + m->out_size, blob, len);
+	m->out_size += len;
+	return 0;
+}
+
 static void cleanup_unlock (void *data)
 {
 	pthread_mutex_unlock (data);
 }
 
+/**
+ * Sends buffered output, queued unsolicited results and due state reports
+ * to the DTE, in as few writes as possible.
+ */
+static int at_urc_flush_unlocked (at_modem_t *m)
+{
+	const void *blob;
+	size_t len;
+	uint64_t due;
+
+	while ((blob = at_urc_peek (&m->urc, &len)) != NULL)
+	{
+		if (len > sizeof (m->out_buf) - m->out_size)
+			at_write_unlocked (m, NULL, 0);
+		memcpy (m->out_buf + m->out_size, blob, len);
+		m->out_size += len;
+		at_urc_pop (&m->urc);
+	}
+
+	/* State reports come last: they must not delay other results */
+	if (sizeof (m->out_buf) - m->out_size < AT_URC_KEYS * AT_URC_MAX)
+		at_write_unlocked (m, NULL, 0);
+	m->out_size += at_urc_states_take (&m->states,
+	                                   at_data_timestamp (CLOCK_MONOTONIC),
+	                                   m->out_buf + m->out_size,
+	                                   sizeof (m->out_buf) - m->out_size,
+	                                   &due);
+	__atomic_store_n (&m->urc_due, due, __ATOMIC_RELAXED);
+	return at_write_unlocked (m, NULL, 0);
+}
+
+/**
+ * Returns the time in milliseconds until the next pending state report is
+ * due, or -1 if there are none.
+ */
+static int at_urc_timeout (at_modem_t *m)
+{
+	uint64_t due = __atomic_load_n (&m->urc_due, __ATOMIC_RELAXED);
+
+	if (due == 0)
+		return -1;
+
+	uint64_t now = at_data_timestamp (CLOCK_MONOTONIC);
+
+	return (due > now) ? (due - now + 999999) / 1000000 : 0;
+}
+
+/**
+ * Starts or stops buffering intermediate responses. Buffered output and
+ * held back unsolicited results are flushed when buffering stops.
+ */
+static void at_cork (at_modem_t *m, bool on)
+{
+	pthread_mutex_lock (&m->lock);
+	pthread_cleanup_push (cleanup_unlock, &m->lock);
+	m->cork = on;
+	if (!on)
+		at_urc_flush_unlocked (m);
+	pthread_cleanup_pop (1);
+}
+
+/** Sends buffered output before waiting for the DTE. */
+static void at_flush (at_modem_t *m)
+{
+	pthread_mutex_lock (&m->lock);
+	pthread_cleanup_push (cleanup_unlock, &m->lock);
+	if (m->out_size > 0)
+		at_write_unlocked (m, NULL, 0);
+	pthread_cleanup_pop (1);
+}
+
 int at_unsolicited_blob (at_modem_t *m, const void *blob, size_t len)
 {
 	int ret;
 
+	/* The DTE thread or the event loop sends the result. The producer does
+	 * not wait for a slow DTE, nor for the command in progress. */
+	if (at_urc_push (&m->urc, blob, len) == 0)
+	{
+		eventfd_write (m->urc_fd, 1);
+		return 0;
+	}
+
 	pthread_mutex_lock (&m->lock);
 	pthread_cleanup_push (cleanup_unlock, &m->lock);
-	if (!m->data)
-		ret = at_write_unlocked (m, blob, len);
-	else
+	if (m->data)
 	{
 		warning ("Discarded message while in data mode");
 		ret = -1;
 	}
+	else
+	{	/* Queue full, or result too long: send it straight away */
+		at_urc_flush_unlocked (m);
+		ret = at_write_unlocked (m, blob, len);
+	}
 	pthread_cleanup_pop (1);
 
 	return ret;
 }
 
+int at_unsolicited_state (at_modem_t *m, const char *key,
+                          const char *fmt, ...)
+{
+	char buf[AT_URC_MAX];
+	va_list ap;
+	int len;
+
+	va_start (ap, fmt);
+	len = at_vformat (buf, sizeof (buf), fmt, ap);
+	if (len < 0 || (size_t)len > sizeof (buf))
+	{	/* Too long to be coalesced */
+		len = at_unsolicitedv (m, fmt, ap);
+		va_end (ap);
+		return len;
+	}
+	va_end (ap);
+
+	if (at_urc_states_update (&m->states, key, buf, len))
+		return at_unsolicited_blob (m, buf, len);
+
+	eventfd_write (m->urc_fd, 1);
+	return 0;
+}
+
 int at_unsolicitedv (at_modem_t *m, const char *fmt, va_list ap)
 {
-	char *ptr;
+	char buf[AT_URC_MAX], *ptr;
 	volatile int val;
 	locale_t locale;
 
+	val = at_vformat (buf, sizeof (buf), fmt, ap);
+	if (val >= 0 && (size_t)val <= sizeof (buf))
+		return at_unsolicited_blob (m, buf, val);
+
+	/* Slow path: long output or unusual format */
 	locale = uselocale (m->locale);
 	val = vasprintf (&ptr, fmt, ap);
 	uselocale (locale);
@@ -213,100 +418,232 @@ int at_unsolicited (at_modem_t *m, const char *fmt, ...)
 }
 
 /**
- * Reads a character from the DTE (text mode).
- * Implements echo.
+ * Takes new input from the DTE into account. Implements echo.
+ * @param off offset of the new input in the input buffer
  */
-static int at_getchar (at_modem_t *m)
+static void at_input (at_modem_t *m, size_t off, size_t len)
 {
-	if (m->in_offset >= m->in_size)
-	{
-		ssize_t val;
+	m->in_size = off + len;
+	m->in_offset = off;
+	at_log_dump (m->in_buf + off, len, false);
+
+	/* Some stupid terminals expect to receive their own echo in a single
+	 * read. So we have to echo everything at once, not byte per byte.
+	 * Some even stupider terminals (e.g. Apple iSync) send an extra
+	 * garbage line feeds at the end of line.
+	 * To satisfy all, we need to echo any received data immediately.
+	 * Fortunately ITU TR V.250 forbids pipe-lining subsequent AT commands
+	 * (sending a command before the previous one completed should abort
+	 * the first one and return ERROR). */
+	if (at_get_echo (m))
+		at_intermediate_blob (m, m->in_buf + off, len);
+}
+
+/**
+ * Reads data from the DTE into the input buffer.
+ * @param off offset in the input buffer to read to
+ * @param wait whether to wait for data if the DTE file is non-blocking
+ * @return the number of bytes read, 0 if nothing was available (only if
+ * wait is false), -1 at the end of the input stream or on error.
+ */
+static ssize_t at_read (at_modem_t *m, size_t off, bool wait)
+{
+	ssize_t val;
 
-		do
-			val = read (m->fd_in, m->in_buf, sizeof (m->in_buf));
-		while (val == -1 && errno == EINTR);
+	if (m->fd_in == -1)
+		return -1; /* input is fed by the owner */
 
-		switch (val)
+	for (;;)
+	{
+		/* Send queued unsolicited results while waiting, unless a command
+		 * is in progress (text input) */
+		if (wait && !m->cork && !m->data)
 		{
-			case -1:
-				warning ("DTE read error (%m)");
-				return -1;
-			case 0:
-				debug ("DTE at end of input stream");
+			struct pollfd ufd[2] = {
+				{ .fd = m->fd_in, .events = POLLIN },
+				{ .fd = m->urc_fd, .events = POLLIN },
+			};
+
+			/* Wake up for the next pending state report */
+			val = poll (ufd, 2, at_urc_timeout (m));
+			if (val == -1)
+			{
+				if (errno == EINTR)
+					continue;
+				warning ("DTE poll error (%m)");
 				return -1;
+			}
+			if (ufd[1].revents || val == 0)
+			{
+				eventfd_t n;
+
+				if (ufd[1].revents)
+					eventfd_read (m->urc_fd, &n);
+				pthread_mutex_lock (&m->lock);
+				pthread_cleanup_push (cleanup_unlock, &m->lock);
+				at_urc_flush_unlocked (m);
+				pthread_cleanup_pop (1);
+			}
+			if (!ufd[0].revents)
+				continue;
 		}
 
-		m->in_size = val;
-		m->in_offset = 0;
-		at_log_dump (m->in_buf, val, false);
-
-		/* Some stupid terminals expect to receive their own echo in a single
-		 * read. So we have to echo everything at once, not byte per byte.
-		 * Some even stupider terminals (e.g. Apple iSync) send an extra
-		 * garbage line feeds at the end of line.
-		 * To satisfy all, we need to echo any received data immediately.
-		 * Fortunately ITU TR V.250 forbids pipe-lining subsequent AT commands
-		 * (sending a command before the previous one completed should abort
-		 * the first one and return ERROR). */
-		if (at_get_echo (m))
-			at_intermediate_blob (m, m->in_buf, val);
+		val = read (m->fd_in, m->in_buf + off, sizeof (m->in_buf) - off);
+		if (val != -1)
+			break;
+
+		if (errno == EINTR)
+			continue;
+		if (errno == EAGAIN)
+		{
+			if (!wait)
+				return 0;
+			poll (&(struct pollfd){ .fd = m->fd_in, .events = POLLIN }, 1,
+			      -1);
+			continue;
+		}
+		warning ("DTE read error (%m)");
+		return -1;
 	}
 
-	return m->in_buf[m->in_offset++];
+	if (val == 0)
+	{
+		debug ("DTE at end of input stream");
+		return -1;
+	}
+
+	at_input (m, off, val);
+	return val;
 }
 
-char *at_read_text (at_modem_t *m, const char *prompt)
+int at_read_text_spans (at_modem_t *m, const char *prompt,
+                        at_text_cb cb, void *opaque)
 {
-	char *buf = NULL;
-	size_t size = 0, len = 0;
 	const size_t prompt_len = strlen (prompt);
+	/* Text is edited in place: [base, w) is pending (not yet passed to the
+	 * callback) and the input is read from r onward. */
+	size_t base = m->in_offset, w = base, r = base;
+	int ret = 0;
 
 	at_intermediate_blob (m, prompt, prompt_len);
-	pthread_cleanup_push (free, buf);
 	for (;;)
 	{
-		int c = at_getchar (m);
-		if (c == -1 /* I/O error */ || c == 27 /* escape */)
+		if (r >= m->in_size)
+		{	/* Move pending text to the front and read more after it */
+			if (w - base == sizeof (m->in_buf))
+			{	/* Line too long to be kept for Backspace: deliver it */
+				if (ret == 0)
+					ret = cb (opaque, (char *)m->in_buf + base, w - base);
+				w = base;
+			}
+			memmove (m->in_buf, m->in_buf + base, w - base);
+			w -= base;
+			base = 0;
+
+			at_flush (m);
+			if (at_read (m, w, true) <= 0)
+				return -1;
+			r = m->in_offset;
+			continue;
+		}
+
+		size_t n = at_span_text (m->in_buf + r, m->in_size - r);
+		if (n > 0)
 		{
-			free (buf);
-			buf = NULL;
-			break;
+			if (w != r)
+				memmove (m->in_buf + w, m->in_buf + r, n);
+			w += n;
+			r += n;
+			continue;
 		}
 
-		if (len >= size)
+		unsigned char c = m->in_buf[r++];
+		switch (c)
 		{
-			size_t newsize = size ? (2 * size) : 256;
-			char *newbuf = realloc (buf, newsize);
+			case 27: /* escape */
+				m->in_offset = r;
+				return -1;
 
-			if (newbuf == NULL)
+			case 26: /* Ctrl+Z: done */
+				m->in_offset = r;
+				if (ret == 0 && w > base)
+					ret = cb (opaque, (char *)m->in_buf + base, w - base);
+				return ret;
+
+			case '\b': /* Backspace (standard) */
+			case 127: /* Delete (non-standard) */
+				if (w > base)
+					w--;
 				break;
-			buf = newbuf;
-			size = newsize;
-		}
 
-		// Ctrl+Z: done
-		if (c == 26)
-		{
-			buf[len] = '\0';
-			break;
+			case '\r': /* New line */
+				m->in_buf[w++] = c;
+				if (ret == 0)
+					ret = cb (opaque, (char *)m->in_buf + base, w - base);
+				base = w;
+				at_intermediate_blob (m, prompt, prompt_len);
+				break;
+
+			default: /* other control characters are text */
+				m->in_buf[w++] = c;
 		}
+	}
+}
 
-		// Backspace (standard) and Delete (non-standard)
-		if (c == '\b' || c == 127)
-		{
-			if (len > 0)
-				len--;
-			continue;
+struct at_text
+{
+	char *buf;
+	size_t len, size;
+};
 
-		}
-		buf[len++] = c;
+static int at_text_append (void *opaque, const char *span, size_t len)
+{
+	struct at_text *t = opaque;
+
+	if (t->size - t->len <= len)
+	{
+		size_t size = t->size ? t->size : 256;
+
+		while (size - t->len <= len)
+			size *= 2;
+
+		char *buf = realloc (t->buf, size);
+		if (buf == NULL)
+			return 1;
+		t->buf = buf;
+		t->size = size;
+	}
+
+	memcpy (t->buf + t->len, span, len);
+	t->len += len;
+	return 0;
+}
+
+static void at_text_cleanup (void *data)
+{
+	struct at_text *t = data;
 
-		// New line
-		if (c == '\r')
-			at_intermediate_blob (m, prompt, prompt_len);
+	free (t->buf);
+}
+
+char *at_read_text (at_modem_t *m, const char *prompt)
+{
+	struct at_text t = { NULL, 0, 0 };
+	int val;
+
+	pthread_cleanup_push (at_text_cleanup, &t);
+	val = at_read_text_spans (m, prompt, at_text_append, &t);
+	if (val == 0 && t.buf == NULL)
+		val = at_text_append (&t, "", 0); /* empty text */
+	if (val)
+	{
+		free (t.buf);
+		t.buf = NULL;
 	}
+	else
+		t.buf[t.len] = '\0';
 	pthread_cleanup_pop (0);
-	return buf;
+	return t.buf;
 }
 
 int at_intermediate_blob (at_modem_t *m, const void *blob, size_t len)
@@ -316,7 +653,7 @@ int at_intermediate_blob (at_modem_t *m, const void *blob, size_t len)
 	pthread_mutex_lock (&m->lock);
 	pthread_cleanup_push (cleanup_unlock, &m->lock);
 	assert (!m->data);
-	ret = at_write_unlocked (m, blob, len);
+	ret = at_queue_unlocked (m, blob, len);
 	pthread_cleanup_pop (1);
 	return ret;
 }
@@ -324,9 +661,19 @@ int at_intermediate_blob (at_modem_t *m, const void *blob, size_t len)
 int at_intermediatev (at_modem_t *m, const char *fmt, va_list ap)
 {
 	char *ptr;
-	volatile int val;
+	volatile int val = 1;
 	locale_t locale;
 
+	pthread_mutex_lock (&m->lock);
+	pthread_cleanup_push (cleanup_unlock, &m->lock);
+	assert (!m->data);
+	if (at_format_unlocked (m, fmt, ap) == 0)
+		val = m->cork ? 0 : at_write_unlocked (m, NULL, 0);
+	pthread_cleanup_pop (1);
+	if (val <= 0)
+		return val;
+
+	/* Slow path: long output or unusual format */
 	locale = uselocale (m->locale);
 	val = vasprintf (&ptr, fmt, ap);
 	uselocale (locale);
@@ -356,40 +703,16 @@ int at_intermediate (at_modem_t *m, const char *fmt, ...)
 
 
 #include <fcntl.h>
-#include <poll.h>
-
-#define PERF_COUNT 1
-
-static uint64_t timestamp (clockid_t clk)
-{
-	struct timespec now;
-
-	clock_gettime (clk, &now);
-	return now.tv_sec * UINT64_C(1000000000) + now.tv_nsec;
-}
 
 void at_connect_mtu (at_modem_t *m, int dce, size_t mtu)
 {
-	uint64_t last_rx = 0;
-#if PERF_COUNT
-	struct
-	{
-		uint64_t bytes;
-		uint64_t idle;
-		uint64_t congest;
-	} stats[2] = { { 0, 0, 0 }, { 0, 0, 0 } };
-	struct
-	{
-		uint64_t thread;
-		uint64_t process;
-		uint64_t real;
-	} stamp;
-#endif
-	size_t len[2] = { 0, 0 }, offset[2] = { 0, 0 };
+	at_data_history_t *h = &m->data_history;
 
-	uint8_t *bufs = malloc (2 * mtu);
-	if (bufs == NULL)
+	if (m->fd_in == -1 || m->sink.cb != NULL)
+	{
+		error ("Data mode requires DTE file descriptors");
 		return;
+	}
 
 	pthread_mutex_lock (&m->lock);
 	assert (!m->data);
@@ -401,140 +724,22 @@ void at_connect_mtu (at_modem_t *m, int dce, size_t mtu)
 
 	at_print_rate (m);
 	at_print_reply (m, AT_CONNECT);
+	at_write_unlocked (m, NULL, 0);
 	m->data = true;
 
 	fcntl (m->fd_out, F_SETFL, fcntl (m->fd_out, F_GETFL) | O_NONBLOCK);
 	fcntl (dce, F_SETFL, fcntl (dce, F_GETFL) | O_NONBLOCK);
-#if PERF_COUNT
-	stamp.real = timestamp (CLOCK_MONOTONIC);
-	stamp.process = timestamp (CLOCK_PROCESS_CPUTIME_ID);
-	stamp.thread = timestamp (CLOCK_THREAD_CPUTIME_ID);
-#endif
-
-	struct pollfd ufd[4];
-	ufd[0].fd = m->fd_in;
-	ufd[1].fd = dce;
-	ufd[2].fd = m->fd_out;
-	ufd[3].fd = dce;
 
-	for (;;)
-	{
-		uint64_t delay;
+	at_data_bridge (m->fd_in, m->fd_out, dce, mtu, &h->last);
 
-		for (int i = 0; i < 2; i++)
-			if (len[i] > 0)
-			{
-				ufd[i].events = 0;
-				ufd[3 - i].events = POLLOUT;
-			}
-			else
-			{
-				ufd[i].events = POLLIN;
-				ufd[3 - i].events = 0;
-			}
-#if PERF_COUNT
-		delay = timestamp (CLOCK_MONOTONIC);
-#endif
-		while (poll (ufd, 4, -1) < 0);
-#if PERF_COUNT
-		delay = timestamp (CLOCK_MONOTONIC) - delay;
-		for (int i = 0; i < 2; i++)
-			if (len[i] > 0)
-				stats[i].congest += delay;
-			else
-				stats[i].idle += delay;
-#endif
-		for (int i = 0; i < 2; i++)
-		{
-			if (ufd[i].revents & (POLLIN|POLLERR|POLLHUP))
-			{
-				uint8_t *buf = bufs + (i * mtu);
-				uint64_t now = timestamp (CLOCK_MONOTONIC);
-				ssize_t val = read (ufd[i].fd, buf, mtu);
-				if (val == -1)
-				{
-					if (errno == EINTR || errno == EAGAIN)
-						continue;
-					warning ("%s data read error (%m)", i ? "DCE" : "DTE");
-					goto out;
-				}
-				if (val == 0)
-				{
-					notice ("%s data stream end", i ? "DCE" : "DTE");
-					goto out;
-				}
-
-				at_log_dump (buf[i], val, i);
-
-				/* +++ escape handling */
-				if (i == 0 && val == 3 && !memcmp (buf, "+++", 3)
-				 && ((now - last_rx) >= 1000000000))
-				{
-					debug ("Caught +++ escape sequence");
-					goto out;
-				}
-				last_rx = now;
-
-				len[i] = val;
-				offset[i] = 0;
-			}
-			if (ufd[i + 2].revents & (POLLOUT|POLLERR|POLLHUP))
-			{
-				const uint8_t *buf = bufs + ((!i) * mtu);
-				ssize_t val = write (ufd[i + 2].fd, buf + offset[!i], len[!i]);
-				if (val == -1)
-				{
-					if (errno == EINTR || errno == EAGAIN)
-						continue;
-					warning ("%s data write error (%m)", i ? "DCE" : "DTE");
-					goto out;
-				}
-				len[1 - i] -= val;
-				offset[1 - i] += val;
-				stats[i].bytes += val;
-			}
-		}
-	}
-
-out:
-#if PERF_COUNT
-	stamp.thread = timestamp (CLOCK_THREAD_CPUTIME_ID) - stamp.thread;
-	stamp.process = timestamp (CLOCK_PROCESS_CPUTIME_ID) - stamp.process;
-	stamp.real = timestamp (CLOCK_MONOTONIC) - stamp.real;
-#endif
 	fcntl (m->fd_out, F_SETFL, fcntl (m->fd_out, F_GETFL) & ~O_NONBLOCK);
 	fcntl (dce, F_SETFL, fcntl (dce, F_GETFL) & ~O_NONBLOCK);
 	m->data = false;
 	pthread_cleanup_pop (1);
-	free (bufs);
-#if PERF_COUNT
-	lldiv_t d;
-
-	d = lldiv (stamp.real, 1000000000);
-	notice ("In %llu.%09llu seconds:", d.quot, d.rem);
-	notice (" transmitted %"PRIu64" bytes at %.0f bps", stats[1].bytes,
-	        (8000000000. * stats[1].bytes) / stamp.real);
-	d = lldiv (stats[1].idle, 1000000000);
-	notice ("  idle      %llu.%09llu seconds (%3"PRIu64"%%)", d.quot, d.rem,
-	        100 * stats[1].idle / stamp.real);
-	d = lldiv (stats[1].congest, 1000000000);
-	notice ("  congested %llu.%09llu seconds (%3"PRIu64"%%)", d.quot, d.rem,
-	        100 * stats[1].congest / stamp.real);
-	notice (" received    %"PRIu64" bytes at %.0f bps", stats[0].bytes,
-	        (8000000000. * stats[0].bytes) / stamp.real);
-	d = lldiv (stats[0].idle, 1000000000);
-	notice ("  idle      %llu.%09llu seconds (%3"PRIu64"%%)", d.quot, d.rem,
-	        100 * stats[0].idle / stamp.real);
-	d = lldiv (stats[0].congest, 1000000000);
-	notice ("  congested %llu.%09llu seconds (%3"PRIu64"%%)", d.quot, d.rem,
-	        100 * stats[0].congest / stamp.real);
-	d = lldiv (stamp.thread, 1000000000);
-	notice (" thread  consumed %llu.%09llu seconds (%3"PRIu64"%%)",
-	        d.quot, d.rem, 100 * stamp.thread / stamp.real);
-	d = lldiv (stamp.process, 1000000000);
-	notice (" process consumed %llu.%09llu seconds (%3"PRIu64"%%)",
-	        d.quot, d.rem, 100 * stamp.process / stamp.real);
-#endif
+
+	at_data_session_add (&h->total, &h->last);
+	h->sessions++;
+	at_data_session_log (&h->last);
 }
 
 void at_connect (at_modem_t *m, int dce)
@@ -545,17 +750,26 @@ void at_connect (at_modem_t *m, int dce)
 static void process_line (struct at_modem *m, char *line, size_t linelen)
 {
 	unsigned res = AT_OK;
-	size_t reqlen;
 
 	debug ("Processing command \"%s\" ...", line);
-	for (char *req = at_iterate_first (&line, &linelen, &reqlen);
-	     (req != NULL) && (res == AT_OK);
-	     req = at_iterate_next (&line, &linelen, &reqlen))
+	at_cork (m, true);
+
+	const at_plan_t *plan = at_commands_compile (m->commands, line, linelen);
+	if (plan == NULL)
 	{
+		res = AT_ERROR;
+		goto out;
+	}
+
+	for (unsigned i = 0; i < plan->count; i++)
+	{
+		char *req = line + plan->steps[i].offset;
+		size_t reqlen = plan->steps[i].length;
 		char buf = req[reqlen];
+
 		req[reqlen] = '\0';
 		debug ("Executing \"AT%s\" ...", req);
-		res = at_execute_string (m, req);
+		res = at_commands_run (m->commands, m, plan, i, req);
 		req[reqlen] = buf;
 
 		at_cancel_assert (true);
@@ -568,50 +782,91 @@ static void process_line (struct at_modem *m, char *line, size_t linelen)
 		}
 		debug ("Request \"AT%s\" completed", req);
 	}
-	if (linelen > 0)
+	if (plan->rest < linelen)
 	{
-		warning ("Malformatted command \"AT%s\"", line);
+		warning ("Malformatted command \"AT%s\"", line + plan->rest);
 		res = AT_ERROR;
 	}
 
 out:
 	/* Print command line result */
 	at_print_reply (m, res);
+	at_cork (m, false);
 }
 
-static void dte_cleanup (void *data)
+/**
+ * Runs the multiplexer requested by AT+CMUX, once its result was sent.
+ * The DTE stays in data mode until the multiplexer is closed down.
+ */
+static void run_mux (struct at_modem *m)
 {
-	struct at_modem *m = data;
-
-	at_commands_deinit (m->commands);
+	pthread_mutex_lock (&m->lock);
+	pthread_cleanup_push (cleanup_unlock, &m->lock);
+	m->mux = false;
+	m->data = true;
+	at_mux_run (m->fd_in, m->fd_out, &m->mux_config,
+	            m->in_buf + m->in_offset, m->in_size - m->in_offset);
+	m->in_size = 0;
+	m->in_offset = 0;
+	m->data = false;
+	at_urc_flush_unlocked (m);
+	pthread_cleanup_pop (1);
 }
 
-static void *dte_thread (void *data)
+/**
+ * Resets the commands after ATZ, or initializes them the first time.
+ * Commands are only re-initialized if some plugin cannot be reset.
+ */
+static void at_apply_reset (struct at_modem *m)
 {
-	struct at_modem *m = data;
-	at_parser_t parser;
-
-	pthread_cleanup_push (dte_cleanup, m);
-	at_parser_init (&parser);
-
-	while (!m->hungup)
+	if (m->reset)
 	{
-		if (m->reset)
+		if (at_commands_reset (m->commands))
 		{
 			at_commands_deinit (m->commands);
 			m->commands = at_commands_init (m);
-			m->reset = false;
 		}
+		m->reset = false;
+	}
+}
 
-		int c = at_getchar (m);
-		if (c == -1)
-			break;
+/**
+ * Runs buffered DTE input through the parser, and executes any complete
+ * command line. Commands may consume further input themselves.
+ */
+static void at_process (struct at_modem *m)
+{
+	while (m->in_offset < m->in_size && !m->hungup)
+	{
+		at_apply_reset (m);
 
-		size_t linelen;
-		char *line = at_parser_push (&parser, c, &linelen);
+		size_t count = m->in_size - m->in_offset, linelen;
+		char *line = at_parser_scan (&m->parser, m->in_buf + m->in_offset,
+		                             &count, &linelen);
+		m->in_offset += count;
 		if (line != NULL)
 			process_line (m, line, linelen);
+		if (m->mux)
+			run_mux (m);
 	}
+}
+
+static void dte_cleanup (void *data)
+{
+	struct at_modem *m = data;
+
+	at_commands_deinit (m->commands);
+}
+
+static void *dte_thread (void *data)
+{
+	struct at_modem *m = data;
+
+	pthread_cleanup_push (dte_cleanup, m);
+	at_apply_reset (m);
+
+	while (!m->hungup && at_read (m, 0, true) > 0)
+		at_process (m);
 
 	if (m->hangup.cb)
 		m->hangup.cb (m, m->hangup.opaque);
@@ -630,13 +885,27 @@ void at_reset (at_modem_t *m)
 	m->hungup = false;
 	m->reset = true;
 	m->charset = 0;
+	m->mux = false;
+	at_mux_config_init (&m->mux_config);
 }
 
 static const int dsr = TIOCM_LE;
 
-/*** Main thread ***/
-struct at_modem *at_modem_start (int ifd, int ofd, at_hangup_cb cb,
-                                 void *opaque)
+/**
+ * Coalescing window for unsolicited state reports in nanoseconds, from the
+ * AT_URC_WINDOW environment variable (milliseconds, default 100).
+ */
+static uint64_t at_urc_window (void)
+{
+	const char *str = getenv ("AT_URC_WINDOW");
+	unsigned long ms = 100;
+
+	if (str != NULL)
+		ms = strtoul (str, NULL, 10);
+	return ms * UINT64_C(1000000);
+}
+
+static struct at_modem *at_modem_new (int ifd, int ofd)
 {
 	struct at_modem *m = malloc (sizeof (*m));
 	if (m == NULL)
@@ -645,10 +914,24 @@ struct at_modem *at_modem_start (int ifd, int ofd, at_hangup_cb cb,
 	m->fd_in = ifd;
 	m->fd_out = ofd;
 	at_reset (m);
-	m->hangup.cb = cb;
-	m->hangup.opaque = opaque;
+	m->hangup.cb = NULL;
+	m->hangup.opaque = NULL;
+	m->sink.cb = NULL;
+	m->sink.opaque = NULL;
 	m->in_size = 0;
 	m->in_offset = 0;
+	m->cork = false;
+	m->out_size = 0;
+	m->urc_fd = eventfd (0, EFD_CLOEXEC|EFD_NONBLOCK);
+	if (m->urc_fd == -1)
+	{
+		free (m);
+		return NULL;
+	}
+	at_urc_init (&m->urc);
+	at_urc_states_init (&m->states, at_urc_window ());
+	m->urc_due = 0;
+	at_parser_init (&m->parser);
 
 	pthread_mutexattr_t attr;
 
@@ -659,18 +942,110 @@ struct at_modem *at_modem_start (int ifd, int ofd, at_hangup_cb cb,
 
 	m->locale = newlocale (LC_NUMERIC_MASK, "C", NULL);
 	m->commands = NULL;
-
-	if (at_thread_create (&m->reader, dte_thread, m))
-		goto error;
-	ioctl (m->fd_in, TIOCMBIS, &dsr);
+	memset (&m->data_history, 0, sizeof (m->data_history));
 	return m;
+}
 
-error:
+static void at_modem_free (struct at_modem *m)
+{
+	if (m->fd_in != -1)
+		ioctl (m->fd_in, TIOCMBIC, &dsr);
 	if (m->locale != (locale_t)0)
 		freelocale (m->locale);
-	pthread_mutexattr_destroy (&attr);
+	close (m->urc_fd);
+	at_urc_states_deinit (&m->states);
+	pthread_mutex_destroy (&m->lock);
 	free (m);
-	return NULL;
+}
+
+/*** Event-driven interface ***/
+struct at_modem *at_modem_create (int ifd, int ofd, at_sink_cb sink,
+                                  void *opaque)
+{
+	struct at_modem *m = at_modem_new (ifd, ofd);
+	if (m == NULL)
+		return NULL;
+
+	m->sink.cb = sink;
+	m->sink.opaque = opaque;
+	at_apply_reset (m);
+	if (ifd != -1)
+		ioctl (ifd, TIOCMBIS, &dsr);
+	return m;
+}
+
+int at_modem_feed (struct at_modem *m, const void *buf, size_t len)
+{
+	const uint8_t *p = buf;
+
+	while (len > 0 && !m->hungup)
+	{
+		size_t n = (len < sizeof (m->in_buf)) ? len : sizeof (m->in_buf);
+
+		memcpy (m->in_buf, p, n);
+		at_input (m, 0, n);
+		at_process (m);
+		p += n;
+		len -= n;
+	}
+	at_modem_flush (m);
+	return m->hungup ? -1 : 0;
+}
+
+int at_modem_ready (struct at_modem *m)
+{
+	ssize_t val = at_read (m, 0, false);
+	if (val > 0)
+		at_process (m);
+	at_modem_flush (m);
+	return (val == -1 || m->hungup) ? -1 : 0;
+}
+
+int at_modem_urc_fd (const struct at_modem *m)
+{
+	return m->urc_fd;
+}
+
+int at_modem_flush (struct at_modem *m)
+{
+	eventfd_t n;
+
+	eventfd_read (m->urc_fd, &n); /* non-blocking */
+	pthread_mutex_lock (&m->lock);
+	pthread_cleanup_push (cleanup_unlock, &m->lock);
+	if (!m->cork && !m->data)
+		at_urc_flush_unlocked (m);
+	pthread_cleanup_pop (1);
+	return at_urc_timeout (m);
+}
+
+void at_modem_destroy (struct at_modem *m)
+{
+	if (m == NULL)
+		return;
+
+	at_commands_deinit (m->commands);
+	at_modem_free (m);
+}
+
+/*** Main thread ***/
+struct at_modem *at_modem_start (int ifd, int ofd, at_hangup_cb cb,
+                                 void *opaque)
+{
+	struct at_modem *m = at_modem_new (ifd, ofd);
+	if (m == NULL)
+		return NULL;
+
+	m->hangup.cb = cb;
+	m->hangup.opaque = opaque;
+
+	if (at_thread_create (&m->reader, dte_thread, m))
+	{
+		at_modem_free (m);
+		return NULL;
+	}
+	ioctl (m->fd_in, TIOCMBIS, &dsr);
+	return m;
 }
 
 void at_modem_stop (struct at_modem *m)
@@ -678,14 +1053,9 @@ void at_modem_stop (struct at_modem *m)
 	if (m == NULL)
 		return;
 
-	ioctl (m->fd_in, TIOCMBIC, &dsr);
 	pthread_cancel (m->reader);
 	pthread_join (m->reader, NULL);
-	if (m->locale != (locale_t)0)
-		freelocale (m->locale);
-	pthread_mutex_destroy (&m->lock);
-
-	free (m);
+	at_modem_free (m);
 }
 
 at_error_t at_execute_string (at_modem_t *m, const char *cmd)
@@ -695,10 +1065,17 @@ at_error_t at_execute_string (at_modem_t *m, const char *cmd)
 
 at_error_t at_executev (at_modem_t *m, const char *fmt, va_list args)
 {
-	char *cmd;
+	char buf[256], *cmd;
 	int len;
 	locale_t locale;
 
+	len = at_vformat (buf, sizeof (buf) - 1, fmt, args);
+	if (len >= 0 && (size_t)len < sizeof (buf))
+	{
+		buf[len] = '\0';
+		return at_execute_string (m, buf);
+	}
+
 	locale = uselocale (m->locale);
 	len = vasprintf (&cmd, fmt, args);
 	uselocale (locale);
@@ -790,6 +1167,21 @@ void at_hangup (at_modem_t *m)
 	m->hungup = 1;
 }
 
+at_data_history_t *at_get_data_history (at_modem_t *m)
+{
+	return &m->data_history;
+}
+
+at_mux_config_t *at_get_mux_config (at_modem_t *m)
+{
+	return &m->mux_config;
+}
+
+void at_start_mux (at_modem_t *m)
+{
+	m->mux = true;
+}
+
 unsigned at_get_charset (at_modem_t *m)
 {
 	return m->charset;
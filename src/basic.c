@@ -139,6 +139,9 @@ void at_register_basic (at_commands_t *set)
 	at_register_s (set, 12, handle_set, handle_get, (void *)(uintptr_t)50);
 
 	at_register_ampersand (set, 'F', handle_reset, NULL);
-
-	at_register_ext (set, "+CMEE", set_cmee, get_cmee, list_cmee, NULL);
 }
+
+const at_command_t at_basic_commands[] = {
+	{ "+CMEE", set_cmee, get_cmee, list_cmee, NULL },
+	{ NULL, NULL, NULL, NULL, NULL },
+};
@@ -44,10 +44,13 @@
 # include <config.h>
 #endif
 
+#include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <iconv.h>
+#include <pthread.h>
 #include <at_command.h>
 #include "commands.h"
 
@@ -124,6 +127,98 @@ static char *at_hex_encode (const unsigned char *in, size_t len)
 	return out;
 }
 
+/*** iconv descriptors cache ***/
+
+/** Number of conversion descriptors cached per thread */
+#define AT_ICONV_CACHE 4
+
+struct at_iconv_cache
+{
+	struct
+	{
+		const char *tocode;
+		const char *fromcode;
+		iconv_t hd;
+	} slots[AT_ICONV_CACHE];
+	unsigned next; /**< next slot to evict */
+};
+
+static pthread_key_t at_iconv_key;
+
+static void at_iconv_cache_destroy (void *data)
+{
+	struct at_iconv_cache *c = data;
+
+	for (unsigned i = 0; i < AT_ICONV_CACHE; i++)
+		if (c->slots[i].hd != (iconv_t)(-1))
+			iconv_close (c->slots[i].hd);
+	free (c);
+}
+
+static void at_iconv_cache_init (void)
+{
+	if (pthread_key_create (&at_iconv_key, at_iconv_cache_destroy))
+		abort ();
+}
+
+/**
+ * Gets a conversion descriptor in its initial state, from the calling thread
+ * cache if possible. Character set names must be static strings.
+ */
+static iconv_t at_iconv_get (const char *tocode, const char *fromcode)
+{
+	static pthread_once_t once = PTHREAD_ONCE_INIT;
+
+	pthread_once (&once, at_iconv_cache_init);
+
+	struct at_iconv_cache *c = pthread_getspecific (at_iconv_key);
+	if (c == NULL)
+	{
+		c = malloc (sizeof (*c));
+		if (c == NULL)
+			return iconv_open (tocode, fromcode);
+		for (unsigned i = 0; i < AT_ICONV_CACHE; i++)
+			c->slots[i].hd = (iconv_t)(-1);
+		c->next = 0;
+		pthread_setspecific (at_iconv_key, c);
+	}
+
+	for (unsigned i = 0; i < AT_ICONV_CACHE; i++)
+		if (c->slots[i].hd != (iconv_t)(-1)
+		 && c->slots[i].tocode == tocode && c->slots[i].fromcode == fromcode)
+		{
+			iconv (c->slots[i].hd, NULL, NULL, NULL, NULL);
+			return c->slots[i].hd;
+		}
+
+	iconv_t hd = iconv_open (tocode, fromcode);
+	if (hd == (iconv_t)(-1))
+		return hd;
+
+	unsigned i = c->next;
+	c->next = (i + 1) % AT_ICONV_CACHE;
+	if (c->slots[i].hd != (iconv_t)(-1))
+		iconv_close (c->slots[i].hd);
+	c->slots[i].tocode = tocode;
+	c->slots[i].fromcode = fromcode;
+	c->slots[i].hd = hd;
+	return hd;
+}
+
+/** Releases a descriptor from at_iconv_get(). */
+static void at_iconv_put (iconv_t hd)
+{
+	struct at_iconv_cache *c = pthread_getspecific (at_iconv_key);
+
+	if (c != NULL)
+		for (unsigned i = 0; i < AT_ICONV_CACHE; i++)
+			if (c->slots[i].hd == hd)
+				return; /* cached */
+	iconv_close (hd);
+}
+
+static const char at_utf8[] = "UTF-8";
+
 #define ICONV_CONST
 /**
  * Converts an array of bytes to a nul-terminated UTF-8 string.
@@ -138,13 +233,13 @@ static char *at_cset_decode (const char *cp, const void *in, size_t len)
 	ICONV_CONST char *inp = (ICONV_CONST char *)in;
 	char *outp = out;
 
-	iconv_t hd = iconv_open ("UTF-8", cp);
+	iconv_t hd = at_iconv_get (at_utf8, cp);
 	if (hd == (iconv_t)(-1))
 		goto error;
 
 	size_t ret = iconv (hd, &inp, &inlen, &outp, &outlen);
 
-	iconv_close (hd);
+	at_iconv_put (hd);
 	if (ret == (size_t)(-1) || inlen > 0)
 		goto error;
 	*outp = '\0';
@@ -170,13 +265,13 @@ static void *at_cset_encode (const char *tocode, const char *in,
 	ICONV_CONST char *inp = (ICONV_CONST char *)in;
 	char *outp = out;
 
-	iconv_t hd = iconv_open (tocode, "UTF-8");
+	iconv_t hd = at_iconv_get (tocode, at_utf8);
 	if (hd == (iconv_t)(-1))
 		goto error;
 
 	size_t ret = iconv (hd, &inp, &inlen, &outp, &outlen);
 
-	iconv_close (hd);
+	at_iconv_put (hd);
 	if (ret == (size_t)(-1) || inlen > 0)
 		goto error;
 
@@ -188,42 +283,572 @@ error:
 	return NULL;
 }
 
+/*** Native conversions ***/
+
+/** Character sets converted without iconv */
+enum
+{
+	AT_CS_ICONV,
+	AT_CS_UTF8,
+	AT_CS_IRA,
+	AT_CS_UCS2,
+	AT_CS_LATIN1,
+	AT_CS_GSM,
+};
+
+/** Returns the length of the leading run of ASCII characters. */
+static size_t at_ascii_span (const unsigned char *in, size_t len)
+{
+	size_t i = 0;
+
+	/* Check eight bytes at a time */
+	for (; i + 8 <= len; i += 8)
+	{
+		uint64_t w;
+
+		memcpy (&w, in + i, 8);
+		if (w & UINT64_C(0x8080808080808080))
+			break;
+	}
+	while (i < len && in[i] < 0x80)
+		i++;
+	return i;
+}
+
+/**
+ * Decodes one UTF-8 character, rejecting overlong forms, surrogates and
+ * code points beyond U+10FFFF (like iconv).
+ * @return the code point, or -1 if the sequence is invalid.
+ */
+static int32_t at_utf8_get (const unsigned char **restrict pp,
+                            const unsigned char *end)
+{
+	const unsigned char *p = *pp;
+	uint32_t cp = *(p++), min;
+	unsigned n;
+
+	if (cp < 0x80)
+	{
+		*pp = p;
+		return cp;
+	}
+	if (cp < 0xC2)
+		return -1;
+	if (cp < 0xE0)
+		n = 1, min = 0x80, cp &= 0x1F;
+	else if (cp < 0xF0)
+		n = 2, min = 0x800, cp &= 0x0F;
+	else if (cp < 0xF5)
+		n = 3, min = 0x10000, cp &= 0x07;
+	else
+		return -1;
+
+	if ((size_t)(end - p) < n)
+		return -1;
+	while (n-- > 0)
+	{
+		if ((*p & 0xC0) != 0x80)
+			return -1;
+		cp = (cp << 6) | (*(p++) & 0x3F);
+	}
+	if (cp < min || cp > 0x10FFFF || (cp >= 0xD800 && cp < 0xE000))
+		return -1;
+	*pp = p;
+	return cp;
+}
+
+/** Encodes one character in UTF-8. */
+static char *at_utf8_put (char *out, uint32_t cp)
+{
+	if (cp < 0x80)
+		*(out++) = cp;
+	else if (cp < 0x800)
+	{
+		*(out++) = 0xC0 | (cp >> 6);
+		*(out++) = 0x80 | (cp & 0x3F);
+	}
+	else if (cp < 0x10000)
+	{
+		*(out++) = 0xE0 | (cp >> 12);
+		*(out++) = 0x80 | ((cp >> 6) & 0x3F);
+		*(out++) = 0x80 | (cp & 0x3F);
+	}
+	else
+	{
+		*(out++) = 0xF0 | (cp >> 18);
+		*(out++) = 0x80 | ((cp >> 12) & 0x3F);
+		*(out++) = 0x80 | ((cp >> 6) & 0x3F);
+		*(out++) = 0x80 | (cp & 0x3F);
+	}
+	return out;
+}
+
+/**
+ * Checks UTF-8 text.
+ * @param max [OUT] highest code point in the text
+ * @param units [OUT] number of UTF-16 code units for the text
+ * @return 0 if valid, -1 if not.
+ */
+static int at_utf8_check (const unsigned char *in, size_t len,
+                          uint32_t *restrict max, size_t *restrict units)
+{
+	const unsigned char *end = in + len;
+	uint32_t hi = 0;
+	size_t n = 0;
+
+	while (in < end)
+	{
+		size_t ascii = at_ascii_span (in, end - in);
+
+		if (ascii > 0)
+		{
+			if (hi < 0x7F)
+				hi = 0x7F;
+			in += ascii;
+			n += ascii;
+			continue;
+		}
+
+		int32_t cp = at_utf8_get (&in, end);
+		if (cp < 0)
+			return -1;
+		if ((uint32_t)cp > hi)
+			hi = cp;
+		n += (cp >= 0x10000) ? 2 : 1;
+	}
+	*max = hi;
+	*units = n;
+	return 0;
+}
+
+/*** GSM 7-bit default alphabet ***/
+
+/**
+ * GSM 7-bit default alphabet (3GPP TS 23.038 §6.2.1).
+ * The escape to the extension table (0x1B) is shown as a space on its own.
+ */
+static const uint16_t at_gsm7_base[128] = {
+	0x0040, 0x00A3, 0x0024, 0x00A5, 0x00E8, 0x00E9, 0x00F9, 0x00EC,
+	0x00F2, 0x00C7, 0x000A, 0x00D8, 0x00F8, 0x000D, 0x00C5, 0x00E5,
+	0x0394, 0x005F, 0x03A6, 0x0393, 0x039B, 0x03A9, 0x03A0, 0x03A8,
+	0x03A3, 0x0398, 0x039E, 0x0020, 0x00C6, 0x00E6, 0x00DF, 0x00C9,
+	0x0020, 0x0021, 0x0022, 0x0023, 0x00A4, 0x0025, 0x0026, 0x0027,
+	0x0028, 0x0029, 0x002A, 0x002B, 0x002C, 0x002D, 0x002E, 0x002F,
+	0x0030, 0x0031, 0x0032, 0x0033, 0x0034, 0x0035, 0x0036, 0x0037,
+	0x0038, 0x0039, 0x003A, 0x003B, 0x003C, 0x003D, 0x003E, 0x003F,
+	0x00A1, 0x0041, 0x0042, 0x0043, 0x0044, 0x0045, 0x0046, 0x0047,
+	0x0048, 0x0049, 0x004A, 0x004B, 0x004C, 0x004D, 0x004E, 0x004F,
+	0x0050, 0x0051, 0x0052, 0x0053, 0x0054, 0x0055, 0x0056, 0x0057,
+	0x0058, 0x0059, 0x005A, 0x00C4, 0x00D6, 0x00D1, 0x00DC, 0x00A7,
+	0x00BF, 0x0061, 0x0062, 0x0063, 0x0064, 0x0065, 0x0066, 0x0067,
+	0x0068, 0x0069, 0x006A, 0x006B, 0x006C, 0x006D, 0x006E, 0x006F,
+	0x0070, 0x0071, 0x0072, 0x0073, 0x0074, 0x0075, 0x0076, 0x0077,
+	0x0078, 0x0079, 0x007A, 0x00E4, 0x00F6, 0x00F1, 0x00FC, 0x00E0,
+};
+
+/** GSM 7-bit default alphabet extension table (3GPP TS 23.038 §6.2.1.1) */
+static const uint16_t at_gsm7_ext[128] = {
+	[0x0A] = 0x000C, [0x14] = 0x005E, [0x28] = 0x007B, [0x29] = 0x007D,
+	[0x2F] = 0x005C, [0x3C] = 0x005B, [0x3D] = 0x007E, [0x3E] = 0x005D,
+	[0x40] = 0x007C, [0x65] = 0x20AC,
+};
+
+#define AT_GSM7_ESC  0x1B
+#define AT_GSM7_NONE 0xFF
+
+/**
+ * Reverse of the GSM 7-bit tables for code points below U+0400: a septet,
+ * an extension table septet with the high bit set, or AT_GSM7_NONE.
+ */
+static uint8_t at_gsm7_rev[0x400];
+
+static void at_gsm7_init (void)
+{
+	memset (at_gsm7_rev, AT_GSM7_NONE, sizeof (at_gsm7_rev));
+
+	for (unsigned i = 0; i < 128; i++)
+	{
+		uint16_t cp = at_gsm7_ext[i];
+
+		if (cp != 0 && cp < sizeof (at_gsm7_rev))
+			at_gsm7_rev[cp] = 0x80 | i;
+	}
+	for (unsigned i = 0; i < 128; i++)
+		if (i != AT_GSM7_ESC)
+			at_gsm7_rev[at_gsm7_base[i]] = i;
+}
+
+/**
+ * Converts UTF-8 to unpacked GSM septets, with a nul terminator.
+ * @param translit whether to replace unsupported characters with '?'
+ */
+static uint8_t *at_gsm7_from_utf8 (const char *str, size_t *restrict lenp,
+                                   bool translit)
+{
+	static pthread_once_t once = PTHREAD_ONCE_INIT;
+	const unsigned char *in = (const unsigned char *)str;
+	const unsigned char *end = in + strlen (str);
+
+	pthread_once (&once, at_gsm7_init);
+
+	/* At most two septets per byte (escaped characters) */
+	uint8_t *out = malloc (2 * (end - in) + 1), *p = out;
+	if (out == NULL)
+		return NULL;
+
+	while (in < end)
+	{
+		int32_t cp = at_utf8_get (&in, end);
+		if (cp < 0)
+			goto error;
+
+		unsigned c = AT_GSM7_NONE;
+		if ((uint32_t)cp < sizeof (at_gsm7_rev))
+			c = at_gsm7_rev[cp];
+		else if (cp == 0x20AC) /* euro sign */
+			c = 0x80 | 0x65;
+
+		if (c == AT_GSM7_NONE)
+		{
+			if (!translit)
+				goto error;
+			c = '?';
+		}
+		if (c & 0x80)
+			*(p++) = AT_GSM7_ESC;
+		*(p++) = c & 0x7F;
+	}
+	*p = '\0';
+	*lenp = p - out;
+	return out;
+
+error:
+	free (out);
+	return NULL;
+}
+
+char *at_gsm7_decode (const void *septets, size_t len)
+{
+	const uint8_t *in = septets;
+	/* At most two bytes per septet (the euro sign takes two septets) */
+	char *out = malloc (2 * len + 1), *p = out;
+	if (out == NULL)
+		return NULL;
+
+	for (size_t i = 0; i < len; i++)
+	{
+		unsigned c = in[i];
+		if (c > 0x7F)
+			goto error;
+
+		uint32_t cp = at_gsm7_base[c];
+		if (c == AT_GSM7_ESC && i + 1 < len)
+		{
+			c = in[++i];
+			if (c > 0x7F)
+				goto error;
+			/* Unknown extensions are shown as in the default alphabet */
+			cp = at_gsm7_ext[c] ? at_gsm7_ext[c] : at_gsm7_base[c];
+		}
+		p = at_utf8_put (p, cp);
+	}
+	*p = '\0';
+	return out;
+
+error:
+	free (out);
+	return NULL;
+}
+
+void *at_gsm7_encode (const char *str, size_t *restrict lenp)
+{
+	return at_gsm7_from_utf8 (str, lenp, false);
+}
+
+size_t at_gsm7_pack (void *buf, const void *septets, size_t len,
+                     unsigned shift)
+{
+	const uint8_t *in = septets;
+	uint8_t *out = buf;
+	uint_fast16_t acc = 0;
+	unsigned bits = shift;
+	size_t n = 0;
+
+	for (size_t i = 0; i < len; i++)
+	{
+		acc |= (uint_fast16_t)(in[i] & 0x7F) << bits;
+		bits += 7;
+		if (bits >= 8)
+		{
+			out[n++] = acc;
+			acc >>= 8;
+			bits -= 8;
+		}
+	}
+	if (bits > 0)
+		out[n++] = acc;
+	return n;
+}
+
+size_t at_gsm7_unpack (void *buf, const void *packed, size_t len,
+                       unsigned shift)
+{
+	const uint8_t *in = packed;
+	uint8_t *out = buf;
+	uint_fast16_t acc = 0;
+	unsigned bits = 0;
+	size_t n = 0;
+
+	if (shift > 0)
+	{	/* Skip fill bits */
+		acc = in[n++] >> shift;
+		bits = 8 - shift;
+	}
+
+	for (size_t i = 0; i < len; i++)
+	{
+		if (bits < 7)
+		{
+			acc |= (uint_fast16_t)in[n++] << bits;
+			bits += 8;
+		}
+		out[i] = acc & 0x7F;
+		acc >>= 7;
+		bits -= 7;
+	}
+	return n;
+}
+
+static char *at_native_decode (unsigned cs, const char *str)
+{
+	const unsigned char *in = (const unsigned char *)str;
+	size_t len = strlen (str);
+	char *out, *p;
+
+	switch (cs)
+	{
+		case AT_CS_UTF8:
+		{
+			uint32_t max;
+			size_t units;
+
+			if (at_utf8_check (in, len, &max, &units))
+				return NULL;
+		}
+		/* fall through */
+		case AT_CS_IRA:
+			if (cs == AT_CS_IRA && at_ascii_span (in, len) < len)
+				return NULL;
+			out = malloc (len + 1);
+			if (out != NULL)
+				memcpy (out, in, len + 1);
+			return out;
+
+		case AT_CS_GSM:
+		{	/* '@' comes with the high-order bit set, as in at_native_encode() */
+			uint8_t *gsm = malloc (len + 1);
+			if (gsm == NULL)
+				return NULL;
+			for (size_t i = 0; i < len; i++)
+				gsm[i] = (in[i] == 0x80) ? 0x00 : in[i];
+			out = at_gsm7_decode (gsm, len);
+			free (gsm);
+			return out;
+		}
+
+		case AT_CS_LATIN1:
+		{
+			size_t extra = 0;
+
+			for (size_t i = 0; i < len; i++)
+				extra += in[i] >> 7;
+			out = malloc (len + extra + 1);
+			if (out == NULL)
+				return NULL;
+			p = out;
+			for (size_t i = 0; i < len; i++)
+				p = at_utf8_put (p, in[i]);
+			*p = '\0';
+			return out;
+		}
+
+		case AT_CS_UCS2:
+			/* Hexadecimal UTF-16BE (a trailing odd digit is ignored) */
+			len /= 2;
+			if (len & 1)
+				return NULL; /* incomplete code unit */
+			len /= 2;
+			out = malloc (3 * len + 1);
+			if (out == NULL)
+				return NULL;
+			p = out;
+			for (size_t i = 0; i < len; i++)
+			{
+				uint32_t cp = 0;
+
+				for (unsigned j = 0; j < 4; j++)
+				{
+					int d = hexdigit (str[4 * i + j]);
+					if (d < 0)
+						goto error;
+					cp = (cp << 4) | d;
+				}
+
+				if (cp >= 0xD800 && cp < 0xE000)
+				{	/* Surrogate pair */
+					uint32_t lo = 0;
+
+					if (cp >= 0xDC00 || ++i >= len)
+						goto error;
+					for (unsigned j = 0; j < 4; j++)
+					{
+						int d = hexdigit (str[4 * i + j]);
+						if (d < 0)
+							goto error;
+						lo = (lo << 4) | d;
+					}
+					if (lo < 0xDC00 || lo >= 0xE000)
+						goto error;
+					cp = 0x10000 + ((cp - 0xD800) << 10) + (lo - 0xDC00);
+				}
+				p = at_utf8_put (p, cp);
+			}
+			*p = '\0';
+			return out;
+	}
+	abort ();
+error:
+	free (out);
+	return NULL;
+}
+
+/**
+ * Converts a nul-terminated UTF-8 string natively if possible.
+ * @param ok [OUT] false if iconv is needed (for transliteration)
+ * @return the converted string (nul-terminated), or NULL.
+ */
+static char *at_native_encode (unsigned cs, const char *str, bool *ok)
+{
+	static const char tab[16] = {
+		'0','1','2','3','4','5','6','7','8','9','A','B','C','D','E','F'
+	};
+	const unsigned char *in = (const unsigned char *)str, *end;
+	size_t len = strlen (str), units;
+	uint32_t max;
+	char *out, *p;
+
+	*ok = true;
+	if (at_utf8_check (in, len, &max, &units))
+		return NULL;
+
+	switch (cs)
+	{
+		case AT_CS_IRA:
+		case AT_CS_LATIN1:
+			if (max > ((cs == AT_CS_IRA) ? 0x7F : 0xFF))
+			{
+				*ok = false;
+				return NULL;
+			}
+		/* fall through */
+		case AT_CS_UTF8:
+			out = malloc (((cs == AT_CS_UTF8) ? len : units) + 1);
+			if (out == NULL)
+				return NULL;
+			if (max <= 0x7F || cs == AT_CS_UTF8)
+			{
+				memcpy (out, in, len + 1);
+				return out;
+			}
+			p = out;
+			for (end = in + len; in < end;)
+				*(p++) = at_utf8_get (&in, end);
+			*p = '\0';
+			return out;
+
+		case AT_CS_GSM:
+		{	/* Unsupported characters are replaced as with //TRANSLIT. '@'
+			 * (0x00) cannot be represented in a nul-terminated string: it is
+			 * sent with the high-order bit set, which a 7-bit DTE ignores. */
+			uint8_t *gsm = at_gsm7_from_utf8 (str, &len, true);
+
+			if (gsm != NULL)
+				for (size_t i = 0; i < len; i++)
+					if (gsm[i] == 0x00)
+						gsm[i] = 0x80;
+			return (char *)gsm;
+		}
+
+		case AT_CS_UCS2:
+			out = malloc (4 * units + 1);
+			if (out == NULL)
+				return NULL;
+			p = out;
+			for (end = in + len; in < end;)
+			{
+				uint32_t cp = at_utf8_get (&in, end), u[2];
+				unsigned n = 1;
+
+				u[0] = cp;
+				if (cp >= 0x10000)
+				{
+					cp -= 0x10000;
+					u[0] = 0xD800 | (cp >> 10);
+					u[1] = 0xDC00 | (cp & 0x3FF);
+					n = 2;
+				}
+				for (unsigned k = 0; k < n; k++)
+				{
+					*(p++) = tab[u[k] >> 12];
+					*(p++) = tab[(u[k] >> 8) & 0xF];
+					*(p++) = tab[(u[k] >> 4) & 0xF];
+					*(p++) = tab[u[k] & 0xF];
+				}
+			}
+			*p = '\0';
+			return out;
+	}
+	abort ();
+}
+
 static const struct
 {
 	char gsm_name[8];
 	char iconv_name[21];
 	unsigned hex:2;
+	unsigned native:3;
 } at_cs_tab[] = {
 	/* First is default */
-	{ "UTF-8",   "UTF-8",                0 },
+	{ "UTF-8",   "UTF-8",                0, AT_CS_UTF8 },
 	/* Hex format should be GSM 7 bits for SMS sending mode */
 	/*{ "HEX",   "UTF-8",                1 },*/
-	{ "IRA",     "ASCII//TRANSLIT",      0 },
-	{ "UCS2",    "UTF-16BE",             2  },
-	{ "PCCP437", "IBM437//TRANSLIT",     0 },
-	{ "PCCP775", "IBM775//TRANSLIT",     0 },
-	{ "PCCP850", "IBM850//TRANSLIT",     0 },
-	{ "PCCP852", "IBM852//TRANSLIT",     0 },
-	{ "PCCP855", "IBM855//TRANSLIT",     0 },
-	{ "PCCP857", "IBM857//TRANSLIT",     0 },
-	{ "PCCP860", "IBM860//TRANSLIT",     0 },
-	{ "PCCP861", "IBM861//TRANSLIT",     0 },
-	{ "PCCP862", "IBM862//TRANSLIT",     0 },
-	{ "PCCP863", "IBM863//TRANSLIT",     0 },
-	{ "PCCP864", "IBM864//TRANSLIT",     0 },
-	{ "PCCP865", "IBM865//TRANSLIT",     0 },
-	{ "PCCP866", "IBM866//TRANSLIT",     0 },
-	{ "PCCP869", "IBM869//TRANSLIT",     0 },
-	{ "8859-1" , "ISO_8859-1//TRANSLIT", 0 },
-	{ "8859-2" , "ISO_8859-2//TRANSLIT", 0 },
-	{ "8859-3" , "ISO_8859-3//TRANSLIT", 0 },
-	{ "8859-4" , "ISO_8859-4//TRANSLIT", 0 },
-	{ "8859-5" , "ISO_8859-5//TRANSLIT", 0 },
-	{ "8859-6" , "ISO_8859-6//TRANSLIT", 0 },
-	{ "8859-C" , "ISO_8859-5//TRANSLIT", 0 },
-	{ "8859-A" , "ISO_8859-6//TRANSLIT", 0 },
-	{ "8859-G" , "ISO_8859-7//TRANSLIT", 0 },
-	{ "8859-H" , "ISO_8859-8//TRANSLIT", 0 },
+	{ "GSM",     "",                     0, AT_CS_GSM },
+	{ "IRA",     "ASCII//TRANSLIT",      0, AT_CS_IRA },
+	{ "UCS2",    "UTF-16BE",             2, AT_CS_UCS2 },
+	{ "PCCP437", "IBM437//TRANSLIT",     0, AT_CS_ICONV },
+	{ "PCCP775", "IBM775//TRANSLIT",     0, AT_CS_ICONV },
+	{ "PCCP850", "IBM850//TRANSLIT",     0, AT_CS_ICONV },
+	{ "PCCP852", "IBM852//TRANSLIT",     0, AT_CS_ICONV },
+	{ "PCCP855", "IBM855//TRANSLIT",     0, AT_CS_ICONV },
+	{ "PCCP857", "IBM857//TRANSLIT",     0, AT_CS_ICONV },
+	{ "PCCP860", "IBM860//TRANSLIT",     0, AT_CS_ICONV },
+	{ "PCCP861", "IBM861//TRANSLIT",     0, AT_CS_ICONV },
+	{ "PCCP862", "IBM862//TRANSLIT",     0, AT_CS_ICONV },
+	{ "PCCP863", "IBM863//TRANSLIT",     0, AT_CS_ICONV },
+	{ "PCCP864", "IBM864//TRANSLIT",     0, AT_CS_ICONV },
+	{ "PCCP865", "IBM865//TRANSLIT",     0, AT_CS_ICONV },
+	{ "PCCP866", "IBM866//TRANSLIT",     0, AT_CS_ICONV },
+	{ "PCCP869", "IBM869//TRANSLIT",     0, AT_CS_ICONV },
+	{ "8859-1" , "ISO_8859-1//TRANSLIT", 0, AT_CS_LATIN1 },
+	{ "8859-2" , "ISO_8859-2//TRANSLIT", 0, AT_CS_ICONV },
+	{ "8859-3" , "ISO_8859-3//TRANSLIT", 0, AT_CS_ICONV },
+	{ "8859-4" , "ISO_8859-4//TRANSLIT", 0, AT_CS_ICONV },
+	{ "8859-5" , "ISO_8859-5//TRANSLIT", 0, AT_CS_ICONV },
+	{ "8859-6" , "ISO_8859-6//TRANSLIT", 0, AT_CS_ICONV },
+	{ "8859-C" , "ISO_8859-5//TRANSLIT", 0, AT_CS_ICONV },
+	{ "8859-A" , "ISO_8859-6//TRANSLIT", 0, AT_CS_ICONV },
+	{ "8859-G" , "ISO_8859-7//TRANSLIT", 0, AT_CS_ICONV },
+	{ "8859-H" , "ISO_8859-8//TRANSLIT", 0, AT_CS_ICONV },
 };
 
 char *at_to_utf8 (at_modem_t *m, const char *in)
@@ -231,6 +856,9 @@ char *at_to_utf8 (at_modem_t *m, const char *in)
 	unsigned cs = at_get_charset (m);
 	const char *cp = at_cs_tab[cs].iconv_name;
 
+	if (at_cs_tab[cs].native != AT_CS_ICONV)
+		return at_native_decode (at_cs_tab[cs].native, in);
+
 	if (at_cs_tab[cs].hex)
 	{
 		size_t len;
@@ -250,6 +878,14 @@ char *at_from_utf8 (at_modem_t *m, const char *in)
 {
 	unsigned cs = at_get_charset (m);
 
+	if (at_cs_tab[cs].native != AT_CS_ICONV)
+	{
+		bool ok;
+		char *out = at_native_encode (at_cs_tab[cs].native, in, &ok);
+		if (ok)
+			return out;
+	}
+
 	size_t len;
 	void *out = at_cset_encode (at_cs_tab[cs].iconv_name, in, &len);
 	if (out == NULL)
@@ -286,10 +922,13 @@ char *at_from_utf8 (at_modem_t *m, const char *in)
 
 static at_error_t set_cscs (at_modem_t *m, const char *req, void *opaque)
 {
+	at_param_t p;
 	char buf[8];
 
-	if (sscanf (req, " \"%7[^\"]\"", buf) != 1)
+	if (at_tokenize (req, &p, 1) != 1 || p.type != AT_PARAM_STRING)
 		return AT_CME_EINVAL;
+	if (at_param_copy (&p, buf, sizeof (buf)) == NULL)
+		return AT_CME_ENOTSUP; /* too long to be supported */
 
 	for (size_t i = 0; i < sizeof (at_cs_tab) / sizeof (at_cs_tab[0]); i++)
 		if (!strcasecmp (buf, at_cs_tab[i].gsm_name))
@@ -323,7 +962,7 @@ static at_error_t list_cscs (at_modem_t *m, void *opaque)
 }
 
 
-void at_register_charset (at_commands_t *set)
-{
-	at_register_ext (set, "+CSCS", set_cscs, get_cscs, list_cscs, NULL);
-}
+const at_command_t at_charset_commands[] = {
+	{ "+CSCS", set_cscs, get_cscs, list_cscs, NULL },
+	{ NULL, NULL, NULL, NULL, NULL },
+};
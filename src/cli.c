@@ -113,11 +113,13 @@ int main (int argc, char *argv[])
 	sigaddset (&set, SIGQUIT);
 	sigaddset (&set, SIGTERM);
 	sigaddset (&set, SIGCHLD);
+	sigaddset (&set, SIGUSR1);
 	signal (SIGHUP, SIG_DFL);
 	signal (SIGINT, SIG_DFL);
 	signal (SIGQUIT, SIG_DFL);
 	signal (SIGTERM, SIG_DFL);
 	signal (SIGCHLD, SIG_DFL);
+	signal (SIGUSR1, SIG_DFL);
 	pthread_sigmask (SIG_UNBLOCK, &set, NULL);
 	sigdelset (&set, SIGCHLD);
 
@@ -249,7 +251,16 @@ done:
 		goto out;
 	}
 
-	while (sigwait (&set, &(int){ 0 }) == -1);
+	for (;;)
+	{
+		int sig;
+
+		if (sigwait (&set, &sig))
+			continue;
+		if (sig != SIGUSR1)
+			break;
+		at_log_command_stats ();
+	}
 
 	at_modem_stop (m);
 	ret = 0;
@@ -0,0 +1,743 @@
+/**
+ * @file cmux.c
+ * @brief 3GPP TS 27.010 multiplexer (AT+CMUX)
+ * @ingroup internal
+ */
+
+/* ***** BEGIN LICENSE BLOCK *****
+ * Version: MPL 1.1/GPL 2.0/LGPL 2.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is matd.
+ *
+ * The Initial Developer of the Original Code is
+ * remi.denis-courmont@nokia.com.
+ * Portions created by the Initial Developer are
+ * Copyright (C) 2012 Nokia Corporation and/or its subsidiary(-ies).
+ * All Rights Reserved.
+ *
+ * Contributor(s):
+ *
+ * Alternatively, the contents of this file may be used under the terms of
+ * either the GNU General Public License Version 2 or later (the "GPL"), or
+ * the GNU Lesser General Public License Version 2.1 or later (the "LGPL"),
+ * in which case the provisions of the GPL or the LGPL are applicable instead
+ * of those above. If you wish to allow use of your version of this file only
+ * under the terms of either the GPL or the LGPL, and not to allow others to
+ * use your version of this file under the terms of the MPL, indicate your
+ * decision by deleting the provisions above and replace them with the notice
+ * and other provisions required by the GPL or the LGPL. If you do not delete
+ * the provisions above, a recipient may use your version of this file under
+ * the terms of any one of the MPL, the GPL or the LGPL.
+ *
+ * ***** END LICENSE BLOCK ***** */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/socket.h>
+
+#include <at_command.h>
+#include <at_modem.h>
+#include <at_log.h>
+#include <at_thread.h>
+#include "commands.h"
+#include "cmux.h"
+
+/** Frame flag (basic option) */
+#define MUX_FLAG 0xF9
+/** Highest DLCI */
+#define MUX_DLCI_MAX 63
+/** Frames read from a DLC at once */
+#define MUX_BATCH 4
+
+/* Frame types (without the P/F bit) */
+#define MUX_SABM 0x2F
+#define MUX_UA   0x63
+#define MUX_DM   0x0F
+#define MUX_DISC 0x43
+#define MUX_UIH  0xEF
+#define MUX_UI   0x03
+#define MUX_PF   0x10
+
+/* Control channel message types */
+#define MUX_NSC   0x04
+#define MUX_TEST  0x08
+#define MUX_FCOFF 0x18
+#define MUX_PN    0x20
+#define MUX_FCON  0x28
+#define MUX_CLD   0x30
+#define MUX_MSC   0x38
+
+/* V.24 signals (MSC) */
+#define MUX_V24_FC  0x02
+#define MUX_V24_RTC 0x04
+#define MUX_V24_RTR 0x08
+#define MUX_V24_DV  0x80
+
+/** Internal state of a data link connection. */
+struct at_mux_dlc
+{
+	int fd; /**< Multiplexer end of the socket pair */
+	int peer; /**< AT modem end of the socket pair */
+	at_modem_t *modem; /**< AT modem of the DLC */
+	bool stopped; /**< Whether the DTE requested flow control */
+	bool throttled; /**< Whether flow control was requested to the DTE */
+	uint8_t *queue; /**< Data pending to the AT modem */
+	size_t queue_len;
+	size_t queue_size;
+};
+
+/** Internal state of the multiplexer. */
+struct at_mux
+{
+	int fd_in; /**< DTE input */
+	int fd_out; /**< DTE output */
+	size_t n1; /**< Maximum information field length */
+	bool stopped; /**< Whether the DTE requested aggregate flow control */
+	bool open; /**< Whether the control channel is open */
+
+	uint8_t *ibuf; /**< Frames received from the DTE */
+	size_t ilen;
+	size_t isize;
+	uint8_t *obuf; /**< Frames pending to the DTE */
+	size_t olen;
+	size_t osize;
+	uint8_t *tbuf; /**< Data read from a DLC */
+
+	struct at_mux_dlc *dlcs[MUX_DLCI_MAX + 1];
+};
+
+/** Computes the frame check sequence (reversed CRC-8, polynomial 0x07). */
+static uint8_t mux_fcs (const uint8_t *p, size_t len)
+{
+	uint8_t crc = 0xFF;
+
+	while (len-- > 0)
+	{
+		crc ^= *(p++);
+		for (unsigned i = 0; i < 8; i++)
+			crc = (crc & 1) ? ((crc >> 1) ^ 0xE0) : (crc >> 1);
+	}
+	return 0xFF - crc;
+}
+
+static int mux_reserve (struct at_mux *mx, size_t len)
+{
+	if (mx->olen + len <= mx->osize)
+		return 0;
+
+	size_t size = 2 * (mx->olen + len);
+	uint8_t *buf = realloc (mx->obuf, size);
+	if (buf == NULL)
+		return -1;
+	mx->obuf = buf;
+	mx->osize = size;
+	return 0;
+}
+
+/**
+ * Queues a frame to the DTE. Frames are sent together by mux_flush().
+ * @param cr command/response bit
+ */
+static void mux_frame (struct at_mux *mx, unsigned dlci, uint8_t ctrl,
+                       bool cr, const void *data, size_t len)
+{
+	uint8_t hdr[4];
+	size_t hlen = 0;
+
+	if (mux_reserve (mx, len + 7))
+		return;
+
+	hdr[hlen++] = (dlci << 2) | (cr << 1) | 1;
+	hdr[hlen++] = ctrl;
+	if (len <= 127)
+		hdr[hlen++] = (len << 1) | 1;
+	else
+	{
+		hdr[hlen++] = (len & 0x7F) << 1;
+		hdr[hlen++] = len >> 7;
+	}
+
+	uint8_t *p = mx->obuf + mx->olen;
+
+	*(p++) = MUX_FLAG;
+	memcpy (p, hdr, hlen);
+	p += hlen;
+	memcpy (p, data, len);
+	p += len;
+	*(p++) = mux_fcs (hdr, hlen);
+	*(p++) = MUX_FLAG;
+	mx->olen = p - mx->obuf;
+}
+
+/**
+ * Queues a control channel message. We are the responder: our commands
+ * have the C/R bit cleared, our responses have it set.
+ */
+static void mux_control (struct at_mux *mx, uint8_t type, bool command,
+                         const void *data, size_t len)
+{
+	uint8_t msg[2 + 8];
+
+	if (len > 8)
+		return;
+	msg[0] = (type << 2) | (command << 1) | 1;
+	msg[1] = (len << 1) | 1;
+	memcpy (msg + 2, data, len);
+	mux_frame (mx, 0, MUX_UIH, false, msg, 2 + len);
+}
+
+/** Sends flow control for a DLC to the DTE. */
+static void mux_throttle (struct at_mux *mx, unsigned dlci, bool on)
+{
+	uint8_t msg[4];
+
+	/* Modem status command (DLCI and V.24 signals), built in place: an
+	 * initialized array would be kept in registers across the cancellation
+	 * point setup of at_mux_run() (-Wclobbered). */
+	msg[0] = (MUX_MSC << 2) | (1 << 1) | 1;
+	msg[1] = (2 << 1) | 1;
+	msg[2] = (dlci << 2) | 3;
+	msg[3] = MUX_V24_RTC | MUX_V24_RTR | MUX_V24_DV | 1
+	       | (on ? MUX_V24_FC : 0);
+
+	mx->dlcs[dlci]->throttled = on;
+	mux_frame (mx, 0, MUX_UIH, false, msg, sizeof (msg));
+}
+
+/** Writes all pending frames to the DTE at once. */
+static int mux_flush (struct at_mux *mx)
+{
+	const uint8_t *p = mx->obuf;
+
+	while (mx->olen > 0)
+	{
+		ssize_t val = write (mx->fd_out, p, mx->olen);
+		if (val == -1)
+		{
+			if (errno == EINTR)
+				continue;
+			error ("DTE write error (%m)");
+			return -1;
+		}
+		p += val;
+		mx->olen -= val;
+	}
+	return 0;
+}
+
+static struct at_mux_dlc *dlc_open (unsigned dlci)
+{
+	struct at_mux_dlc *dlc = malloc (sizeof (*dlc));
+	int fds[2];
+
+	if (dlc == NULL)
+		return NULL;
+	if (socketpair (PF_LOCAL, SOCK_STREAM|SOCK_CLOEXEC, 0, fds))
+		goto error;
+
+	fcntl (fds[0], F_SETFL, fcntl (fds[0], F_GETFL) | O_NONBLOCK);
+	dlc->fd = fds[0];
+	dlc->peer = fds[1];
+	dlc->stopped = false;
+	dlc->throttled = false;
+	dlc->queue = NULL;
+	dlc->queue_len = 0;
+	dlc->queue_size = 0;
+	dlc->modem = at_modem_start (dlc->peer, dlc->peer, NULL, NULL);
+	if (dlc->modem == NULL)
+	{
+		close (fds[1]);
+		close (fds[0]);
+		goto error;
+	}
+	debug ("Multiplexer DLC %u opened", dlci);
+	return dlc;
+
+error:
+	warning ("Cannot open multiplexer DLC %u (%m)", dlci);
+	free (dlc);
+	return NULL;
+}
+
+static void dlc_close (struct at_mux_dlc *dlc)
+{
+	at_modem_stop (dlc->modem);
+	close (dlc->peer);
+	close (dlc->fd);
+	free (dlc->queue);
+	free (dlc);
+}
+
+/** Delivers data from the DTE to the AT modem of a DLC. */
+static void dlc_write (struct at_mux *mx, unsigned dlci,
+                       const uint8_t *data, size_t len)
+{
+	struct at_mux_dlc *dlc = mx->dlcs[dlci];
+
+	if (dlc->queue_len == 0)
+	{
+		ssize_t val = send (dlc->fd, data, len, MSG_NOSIGNAL);
+		if (val > 0)
+		{
+			data += val;
+			len -= val;
+		}
+	}
+	if (len == 0)
+		return;
+
+	if (dlc->queue_len + len > dlc->queue_size)
+	{
+		size_t size = 2 * (dlc->queue_len + len);
+		uint8_t *buf = realloc (dlc->queue, size);
+
+		if (buf == NULL)
+		{
+			warning ("Discarded data for multiplexer DLC %u", dlci);
+			return;
+		}
+		dlc->queue = buf;
+		dlc->queue_size = size;
+	}
+	memcpy (dlc->queue + dlc->queue_len, data, len);
+	dlc->queue_len += len;
+
+	/* The AT modem is lagging: ask the DTE to hold this DLC */
+	if (!dlc->throttled && dlc->queue_len >= MUX_BATCH * mx->n1)
+		mux_throttle (mx, dlci, true);
+}
+
+/** Retries delivering queued data to the AT modem of a DLC. */
+static void dlc_drain (struct at_mux *mx, unsigned dlci)
+{
+	struct at_mux_dlc *dlc = mx->dlcs[dlci];
+	ssize_t val = send (dlc->fd, dlc->queue, dlc->queue_len, MSG_NOSIGNAL);
+
+	if (val <= 0)
+		return;
+	dlc->queue_len -= val;
+	memmove (dlc->queue, dlc->queue + val, dlc->queue_len);
+
+	if (dlc->throttled && dlc->queue_len == 0)
+		mux_throttle (mx, dlci, false);
+}
+
+/** Encodes data from the AT modem of a DLC into frames. */
+static void dlc_read (struct at_mux *mx, unsigned dlci)
+{
+	struct at_mux_dlc *dlc = mx->dlcs[dlci];
+	ssize_t val = recv (dlc->fd, mx->tbuf, MUX_BATCH * mx->n1, 0);
+
+	for (ssize_t offset = 0; offset < val; offset += mx->n1)
+	{
+		size_t len = val - offset;
+
+		if (len > mx->n1)
+			len = mx->n1;
+		mux_frame (mx, dlci, MUX_UIH, false, mx->tbuf + offset, len);
+	}
+}
+
+/**
+ * Handles a control channel message.
+ * @return true if the multiplexer is closed down.
+ */
+static bool mux_message (struct at_mux *mx, const uint8_t *msg, size_t len)
+{
+	if (len < 2 || !(msg[0] & 1) || !(msg[1] & 1))
+		return false; /* malformed (or multi-byte) message */
+
+	uint8_t type = msg[0] >> 2;
+	bool command = msg[0] & 2;
+	size_t vlen = msg[1] >> 1;
+	const uint8_t *val = msg + 2;
+
+	if (vlen > len - 2)
+		return false;
+	if (!command)
+		return false; /* response to our own command */
+
+	switch (type)
+	{
+		case MUX_CLD:
+			mux_control (mx, type, false, NULL, 0);
+			debug ("Multiplexer closed down");
+			return true;
+
+		case MUX_TEST:
+			if (vlen <= 8)
+				mux_control (mx, type, false, val, vlen);
+			break;
+
+		case MUX_FCON:
+		case MUX_FCOFF:
+			mx->stopped = type == MUX_FCOFF;
+			mux_control (mx, type, false, NULL, 0);
+			break;
+
+		case MUX_MSC:
+		{
+			if (vlen < 2)
+				break;
+
+			unsigned dlci = val[0] >> 2;
+			if (dlci <= MUX_DLCI_MAX && mx->dlcs[dlci] != NULL)
+				mx->dlcs[dlci]->stopped = (val[1] & MUX_V24_FC) != 0;
+			mux_control (mx, type, false, val, 2);
+			break;
+		}
+
+		case MUX_PN:
+		{
+			if (vlen != 8)
+				break;
+
+			/* Accept the parameters, capping the frame size */
+			uint8_t pn[8];
+			unsigned n1 = val[4] | (val[5] << 8);
+
+			memcpy (pn, val, 8);
+			if (n1 == 0 || n1 > mx->n1)
+				n1 = mx->n1;
+			pn[1] = 0; /* UIH frames, no convergence layer */
+			pn[4] = n1;
+			pn[5] = n1 >> 8;
+			mux_control (mx, type, false, pn, 8);
+			break;
+		}
+
+		default:
+		{
+			uint8_t nsc = msg[0];
+
+			mux_control (mx, MUX_NSC, false, &nsc, 1);
+		}
+	}
+	return false;
+}
+
+/**
+ * Handles a frame from the DTE.
+ * @return true if the multiplexer is closed down.
+ */
+static bool mux_receive (struct at_mux *mx, unsigned dlci, uint8_t ctrl,
+                         bool pf, const uint8_t *data, size_t len)
+{
+	struct at_mux_dlc *dlc = mx->dlcs[dlci];
+
+	switch (ctrl)
+	{
+		case MUX_SABM:
+			if (dlci == 0)
+				mx->open = true;
+			else
+			if (mx->open && dlc == NULL)
+				mx->dlcs[dlci] = dlc = dlc_open (dlci);
+
+			if (dlci == 0 || dlc != NULL)
+				mux_frame (mx, dlci, MUX_UA | (pf ? MUX_PF : 0), true,
+				           NULL, 0);
+			else
+				mux_frame (mx, dlci, MUX_DM | (pf ? MUX_PF : 0), true,
+				           NULL, 0);
+			break;
+
+		case MUX_DISC:
+			if (dlci == 0)
+			{
+				mux_frame (mx, 0, MUX_UA | (pf ? MUX_PF : 0), true, NULL, 0);
+				debug ("Multiplexer disconnected");
+				return true;
+			}
+			if (dlc != NULL)
+			{
+				dlc_close (dlc);
+				mx->dlcs[dlci] = NULL;
+				debug ("Multiplexer DLC %u closed", dlci);
+				mux_frame (mx, dlci, MUX_UA | (pf ? MUX_PF : 0), true,
+				           NULL, 0);
+			}
+			else
+				mux_frame (mx, dlci, MUX_DM | (pf ? MUX_PF : 0), true,
+				           NULL, 0);
+			break;
+
+		case MUX_UIH:
+		case MUX_UI:
+			if (dlci == 0)
+			{
+				if (mx->open)
+					return mux_message (mx, data, len);
+			}
+			else
+			if (dlc != NULL)
+				dlc_write (mx, dlci, data, len);
+			else
+				mux_frame (mx, dlci, MUX_DM | MUX_PF, true, NULL, 0);
+			break;
+
+		default:
+			debug ("Unsupported multiplexer frame type 0x%02X", ctrl);
+	}
+	return false;
+}
+
+/**
+ * Decodes and handles all complete frames received from the DTE.
+ * @return true if the multiplexer is closed down.
+ */
+static bool mux_parse (struct at_mux *mx)
+{
+	uint8_t *p = mx->ibuf, *end = mx->ibuf + mx->ilen;
+	bool closed = false;
+
+	while (!closed)
+	{
+		/* Find the opening flag, skipping repeated flags */
+		while (p < end && *p != MUX_FLAG)
+			p++;
+		while (end - p >= 2 && p[1] == MUX_FLAG)
+			p++;
+		if (end - p < 6)
+			break;
+
+		const uint8_t *hdr = p + 1;
+		size_t hlen = 3, len = hdr[2] >> 1;
+
+		if (!(hdr[2] & 1))
+		{
+			hlen = 4;
+			len |= hdr[3] << 7;
+		}
+		if (!(hdr[0] & 1) || len > mx->n1)
+		{
+			p++; /* garbage, resynchronize */
+			continue;
+		}
+		if ((size_t)(end - p) < 1 + hlen + len + 2)
+			break; /* incomplete frame */
+
+		const uint8_t *data = hdr + hlen;
+		uint8_t ctrl = hdr[1] & ~MUX_PF;
+
+		/* The UI frame check sequence also covers the information field */
+		if (data[len + 1] != MUX_FLAG
+		 || data[len] != mux_fcs (hdr, hlen + ((ctrl == MUX_UI) ? len : 0)))
+		{
+			p++;
+			continue;
+		}
+
+		/* The closing flag may also be the next opening flag */
+		p += hlen + len + 2;
+		closed = mux_receive (mx, hdr[0] >> 2, ctrl, (hdr[1] & MUX_PF) != 0,
+		                      data, len);
+	}
+
+	mx->ilen = end - p;
+	memmove (mx->ibuf, p, mx->ilen);
+	return closed;
+}
+
+/**
+ * Relays frames between the DTE and the DLCs until the multiplexer is closed.
+ */
+static void mux_loop (struct at_mux *mx)
+{
+	if (mux_parse (mx))
+		goto out;
+
+	for (;;)
+	{
+		struct pollfd ufd[1 + MUX_DLCI_MAX];
+		unsigned dlcis[1 + MUX_DLCI_MAX];
+		unsigned n = 1;
+
+		if (mux_flush (mx))
+			return;
+
+		ufd[0].fd = mx->fd_in;
+		ufd[0].events = POLLIN;
+		for (unsigned i = 1; i <= MUX_DLCI_MAX; i++)
+		{
+			const struct at_mux_dlc *dlc = mx->dlcs[i];
+
+			if (dlc == NULL)
+				continue;
+			ufd[n].fd = dlc->fd;
+			ufd[n].events = 0;
+			if (!mx->stopped && !dlc->stopped)
+				ufd[n].events |= POLLIN;
+			if (dlc->queue_len > 0)
+				ufd[n].events |= POLLOUT;
+			dlcis[n++] = i;
+		}
+
+		if (poll (ufd, n, -1) < 0)
+			continue;
+
+		/* Encode all pending DLC output, then send it in one go */
+		for (unsigned k = 1; k < n; k++)
+		{
+			if (ufd[k].revents & POLLOUT)
+				dlc_drain (mx, dlcis[k]);
+			if (ufd[k].revents & POLLIN)
+				dlc_read (mx, dlcis[k]);
+		}
+
+		if (ufd[0].revents)
+		{
+			ssize_t val = read (mx->fd_in, mx->ibuf + mx->ilen,
+			                    mx->isize - mx->ilen);
+			if (val <= 0)
+			{
+				if (val == -1 && errno == EINTR)
+					continue;
+				debug ("DTE hung up the multiplexer");
+				return;
+			}
+			mx->ilen += val;
+			if (mux_parse (mx))
+				break;
+			if (mx->ilen == mx->isize)
+				mx->ilen = 0; /* no valid frame: flush garbage */
+		}
+	}
+out:
+	mux_flush (mx);
+}
+
+static void cleanup_mux (void *data)
+{
+	struct at_mux *mx = data;
+
+	for (unsigned i = 1; i <= MUX_DLCI_MAX; i++)
+		if (mx->dlcs[i] != NULL)
+			dlc_close (mx->dlcs[i]);
+	free (mx->tbuf);
+	free (mx->obuf);
+	free (mx->ibuf);
+}
+
+void at_mux_run (int fd_in, int fd_out, const at_mux_config_t *cfg,
+                 const void *buf, size_t len)
+{
+	struct at_mux mx;
+
+	mx.fd_in = fd_in;
+	mx.fd_out = fd_out;
+	mx.n1 = cfg->n1;
+	mx.stopped = false;
+	mx.open = false;
+	/* Room for a couple of frames of maximum size */
+	mx.isize = 2 * (mx.n1 + 7) + len;
+	if (mx.isize < 4096)
+		mx.isize = 4096;
+	mx.ibuf = malloc (mx.isize);
+	mx.ilen = 0;
+	mx.obuf = NULL;
+	mx.olen = 0;
+	mx.osize = 0;
+	mx.tbuf = malloc (MUX_BATCH * mx.n1);
+	memset (mx.dlcs, 0, sizeof (mx.dlcs));
+
+	pthread_cleanup_push (cleanup_mux, &mx);
+	if (mx.ibuf == NULL || mx.tbuf == NULL)
+		goto out;
+
+	debug ("Multiplexer started (N1=%zu)", mx.n1);
+	memcpy (mx.ibuf, buf, len);
+	mx.ilen = len;
+	mux_loop (&mx);
+out:
+	pthread_cleanup_pop (1);
+}
+
+void at_mux_config_init (at_mux_config_t *cfg)
+{
+	cfg->mode = 0;
+	cfg->subset = 0;
+	cfg->speed = 5;
+	cfg->n1 = 31;
+	cfg->t1 = 10;
+	cfg->n2 = 3;
+	cfg->t2 = 30;
+	cfg->t3 = 10;
+	cfg->k = 2;
+}
+
+/*** AT+CMUX ***/
+
+static at_error_t set_cmux (at_modem_t *m, const char *req, void *data)
+{
+	at_mux_config_t cfg;
+
+	at_mux_config_init (&cfg);
+	cfg.n1 = 0;
+	if (sscanf (req, " %u , %u , %u , %u , %u , %u , %u , %u , %u",
+	            &cfg.mode, &cfg.subset, &cfg.speed, &cfg.n1, &cfg.t1,
+	            &cfg.n2, &cfg.t2, &cfg.t3, &cfg.k) < 1)
+		return AT_CME_EINVAL;
+
+	/* Only the basic option with UIH frames is supported */
+	if (cfg.mode != 0 || cfg.subset != 0)
+		return AT_CME_ENOTSUP;
+	if (cfg.n1 == 0)
+		cfg.n1 = 31;
+	if (cfg.speed < 1 || cfg.speed > 6 || cfg.n1 > 32767
+	 || cfg.t1 < 1 || cfg.t1 > 255 || cfg.n2 > 100
+	 || cfg.t2 < 2 || cfg.t2 > 255 || cfg.t3 < 1 || cfg.t3 > 255
+	 || cfg.k < 1 || cfg.k > 7)
+		return AT_CME_EINVAL;
+
+	*at_get_mux_config (m) = cfg;
+	at_start_mux (m);
+	(void) data;
+	return AT_OK;
+}
+
+static at_error_t get_cmux (at_modem_t *m, void *data)
+{
+	const at_mux_config_t *cfg = at_get_mux_config (m);
+
+	at_intermediate (m, "\r\n+CMUX: %u,%u,%u,%u,%u,%u,%u,%u,%u", cfg->mode,
+	                 cfg->subset, cfg->speed, cfg->n1, cfg->t1, cfg->n2,
+	                 cfg->t2, cfg->t3, cfg->k);
+	(void) data;
+	return AT_OK;
+}
+
+static at_error_t list_cmux (at_modem_t *m, void *data)
+{
+	at_intermediate (m, "\r\n+CMUX: (0),(0),(1-6),(1-32767),(1-255),"
+	                 "(0-100),(2-255),(1-255),(1-7)");
+	(void) data;
+	return AT_OK;
+}
+
+const at_command_t at_cmux_commands[] = {
+	{ "+CMUX", set_cmux, get_cmux, list_cmux, NULL },
+	{ NULL, NULL, NULL, NULL, NULL },
+};
@@ -0,0 +1,92 @@
+/**
+ * @file cmux.h
+ * @brief Internal header for the 3GPP TS 27.010 multiplexer
+ * @ingroup internal
+ */
+
+/* ***** BEGIN LICENSE BLOCK *****
+ * Version: MPL 1.1/GPL 2.0/LGPL 2.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is matd.
+ *
+ * The Initial Developer of the Original Code is
+ * remi.denis-courmont@nokia.com.
+ * Portions created by the Initial Developer are
+ * Copyright (C) 2012 Nokia Corporation and/or its subsidiary(-ies).
+ * All Rights Reserved.
+ *
+ * Contributor(s):
+ *
+ * Alternatively, the contents of this file may be used under the terms of
+ * either the GNU General Public License Version 2 or later (the "GPL"), or
+ * the GNU Lesser General Public License Version 2.1 or later (the "LGPL"),
+ * in which case the provisions of the GPL or the LGPL are applicable instead
+ * of those above. If you wish to allow use of your version of this file only
+ * under the terms of either the GPL or the LGPL, and not to allow others to
+ * use your version of this file under the terms of the MPL, indicate your
+ * decision by deleting the provisions above and replace them with the notice
+ * and other provisions required by the GPL or the LGPL. If you do not delete
+ * the provisions above, a recipient may use your version of this file under
+ * the terms of any one of the MPL, the GPL or the LGPL.
+ *
+ * ***** END LICENSE BLOCK ***** */
+
+#ifndef AT_CMUX_H
+# define AT_CMUX_H 1
+
+# include <stddef.h>
+# include <at_command.h>
+
+/** AT+CMUX parameters */
+typedef struct at_mux_config
+{
+	unsigned mode; /**< Framing (0: basic option) */
+	unsigned subset; /**< Frame types (0: UIH only) */
+	unsigned speed; /**< Transmission rate */
+	unsigned n1; /**< Maximum information field length */
+	unsigned t1; /**< Acknowledgement timer (10 ms units) */
+	unsigned n2; /**< Maximum retransmissions */
+	unsigned t2; /**< Control channel response timer (10 ms units) */
+	unsigned t3; /**< Wake up response timer (seconds) */
+	unsigned k; /**< Window size (advanced option only) */
+} at_mux_config_t;
+
+/**
+ * Resets AT+CMUX parameters to their default values.
+ */
+void at_mux_config_init (at_mux_config_t *);
+
+/**
+ * Retrieves the AT+CMUX parameters of an AT modem.
+ */
+at_mux_config_t *at_get_mux_config (at_modem_t *);
+
+/**
+ * Requests that the AT modem starts the multiplexer once the result of the
+ * current command line has been sent.
+ */
+void at_start_mux (at_modem_t *);
+
+/**
+ * Runs the 3GPP TS 27.010 multiplexer on the DTE, until the DTE closes it
+ * down or hangs up. Each DLC opened by the DTE gets its own AT modem.
+ * @param fd_in file descriptor to read frames from the DTE
+ * @param fd_out file descriptor to write frames to the DTE
+ * @param cfg multiplexer parameters
+ * @param buf data already received from the DTE
+ * @param len bytes in buf
+ */
+void at_mux_run (int fd_in, int fd_out, const at_mux_config_t *cfg,
+                 const void *buf, size_t len);
+
+#endif
@@ -47,29 +47,53 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
-#include <ctype.h>
 #include <errno.h>
-#include <search.h>
-#include <pthread.h>
 #include <assert.h>
+#include <pthread.h>
 
 #include <at_modem.h>
 #include <at_command.h>
 #include <at_log.h>
 #include <at_thread.h>
-#include "plugins.h"
+#include "parser.h"
+#include "trie.h"
 #include "commands.h"
-
-#define AT_NAME_MAX	15
+#include "plugins.h"
+#include "data.h"
+#include "perf.h"
 
 typedef struct at_handler
 {
 	char name[AT_NAME_MAX];
 	at_set_cb set;
 	at_get_cb get, test;
-	void *opaque;
 } at_handler_t;
 
+/**
+ * Process-wide immutable table of the extended commands registered with
+ * at_register_ext(). All banks whose plugins register the same commands share
+ * it, and only keep their own data pointers.
+ *
+ * Such plugins are still instantiated, and register their commands, once per
+ * bank. The registrations are only matched against the shared table, without
+ * memory allocation. Commands from static tables (at_plugin_table) are not
+ * registered per bank at all (see at_plugins_match()).
+ */
+typedef struct at_registry
+{
+	unsigned refs;
+	size_t count;
+	at_handler_t *handlers; /**< sorted by name */
+	at_trie_t *trie;
+} at_registry_t;
+
+static pthread_mutex_t registry_lock = PTHREAD_MUTEX_INITIALIZER;
+static at_registry_t *registry = NULL;
+
+/** Data pointer for shared commands not registered (yet) by the bank */
+static char unregistered;
+#define AT_UNREGISTERED ((void *)&unregistered)
+
 #define AT_MAX_S 25
 
 struct at_commands
@@ -98,15 +122,123 @@ struct at_commands
 			at_get_s_cb get;
 			void *opaque;
 		} s[AT_MAX_S + 1]; /**< S-commands */
-		void *extended; /**< extended commands */
+		struct
+		{
+			at_handler_t *handlers; /**< sorted by name */
+			void **opaques; /**< per-command data */
+			size_t count;
+			at_trie_t *trie; /**< lookup tree (once frozen) */
+			at_registry_t *shared; /**< shared table, NULL if private */
+			size_t missing; /**< shared commands not registered yet */
+		} ext; /**< extended commands */
 	} cmd;
+	unsigned generation; /**< bumped whenever a command is registered */
+	struct
+	{
+		at_plan_t *plans[AT_PLAN_CACHE];
+		unsigned next; /**< next slot to recycle */
+	} cache; /**< recently compiled command lines */
 	void **plugins;
 	at_phonebooks_t phonebooks;
 };
 
-static at_error_t handle_clac (at_modem_t *, const char *, void *);
+static at_registry_t *at_registry_hold (void)
+{
+	pthread_mutex_lock (&registry_lock);
+	at_registry_t *reg = registry;
+	if (reg != NULL)
+		reg->refs++;
+	pthread_mutex_unlock (&registry_lock);
+	return reg;
+}
 
-at_commands_t *at_commands_init (at_modem_t *modem)
+static void at_registry_release (at_registry_t *reg)
+{
+	pthread_mutex_lock (&registry_lock);
+	bool last = --reg->refs == 0;
+	if (last)
+		registry = NULL;
+	pthread_mutex_unlock (&registry_lock);
+
+	if (last)
+	{
+		at_trie_destroy (reg->trie);
+		free (reg->handlers);
+		free (reg);
+	}
+}
+
+/**
+ * Hands a frozen private table of extended commands over to the process,
+ * unless another bank did so already.
+ */
+static void at_registry_publish (at_commands_t *bank)
+{
+	at_registry_t *reg = malloc (sizeof (*reg));
+	if (reg == NULL)
+		return;
+
+	reg->refs = 1;
+	reg->count = bank->cmd.ext.count;
+	reg->handlers = bank->cmd.ext.handlers;
+	reg->trie = bank->cmd.ext.trie;
+
+	pthread_mutex_lock (&registry_lock);
+	bool first = registry == NULL;
+	if (first)
+		registry = reg;
+	pthread_mutex_unlock (&registry_lock);
+
+	if (first)
+		bank->cmd.ext.shared = reg;
+	else
+		free (reg);
+}
+
+/**
+ * Copies the commands registered so far out of the shared table, so that
+ * the bank can diverge from it.
+ */
+static int at_commands_unshare (at_commands_t *bank)
+{
+	at_registry_t *reg = bank->cmd.ext.shared;
+	void **opaques = bank->cmd.ext.opaques;
+	size_t count = reg->count - bank->cmd.ext.missing;
+
+	at_handler_t *tab = malloc ((count + 1) * sizeof (*tab));
+	if (tab == NULL)
+		return errno;
+
+	for (size_t i = 0, j = 0; i < reg->count; i++)
+		if (opaques[i] != AT_UNREGISTERED)
+			tab[j++] = reg->handlers[i];
+
+	at_trie_t *trie = NULL;
+	if (bank->cmd.ext.trie != NULL)
+	{	/* Already frozen */
+		trie = at_trie_build (tab->name, count, sizeof (*tab));
+		if (trie == NULL)
+		{
+			int val = errno;
+			free (tab);
+			return val;
+		}
+	}
+
+	for (size_t i = 0, j = 0; i < reg->count; i++)
+		if (opaques[i] != AT_UNREGISTERED)
+			opaques[j++] = opaques[i];
+
+	bank->cmd.ext.handlers = tab;
+	bank->cmd.ext.count = count;
+	bank->cmd.ext.trie = trie;
+	bank->cmd.ext.shared = NULL;
+	bank->cmd.ext.missing = 0;
+	at_registry_release (reg);
+	return 0;
+}
+
+static at_commands_t *at_commands_new (at_modem_t *modem)
 {
 	at_commands_t *bank = malloc (sizeof (*bank));
 	if (bank == NULL)
@@ -120,22 +252,82 @@ at_commands_t *at_commands_init (at_modem_t *modem)
 		bank->cmd.dial[i].handler = NULL;
 	for (size_t i = 0; i <= AT_MAX_S; i++)
 		bank->cmd.s[i].set = NULL;
-	bank->cmd.extended = NULL;
+	bank->cmd.ext.handlers = NULL;
+	bank->cmd.ext.opaques = NULL;
+	bank->cmd.ext.count = 0;
+	bank->cmd.ext.trie = NULL;
+	bank->cmd.ext.shared = NULL;
+	bank->cmd.ext.missing = 0;
+	bank->generation = 0;
+	for (size_t i = 0; i < AT_PLAN_CACHE; i++)
+		bank->cache.plans[i] = NULL;
+	bank->cache.next = 0;
 	bank->modem = modem;
 	assert (AT_COMMANDS_MODEM(bank) == modem);
+	bank->plugins = NULL;
+	at_phonebooks_init (&bank->phonebooks);
+	return bank;
+}
 
-	/* Load all plugins */
-	int canc = at_cancel_disable ();
+at_commands_t *at_commands_init (at_modem_t *modem)
+{
+	at_commands_t *bank = at_commands_new (modem);
+	if (bank == NULL)
+		return NULL;
 
-	at_register_basic (bank);
-	at_register_charset (bank);
-	at_phonebooks_init(&bank->phonebooks);
-	at_register_ext (bank, "+CLAC", handle_clac, NULL, NULL, bank);
+	bank->cmd.ext.shared = at_registry_hold ();
+	if (bank->cmd.ext.shared != NULL)
+	{	/* Expect the same commands as the other banks */
+		at_registry_t *reg = bank->cmd.ext.shared;
+		void **opaques = malloc (reg->count * sizeof (*opaques));
+
+		if (opaques != NULL)
+		{
+			for (size_t i = 0; i < reg->count; i++)
+				opaques[i] = AT_UNREGISTERED;
+			bank->cmd.ext.handlers = reg->handlers;
+			bank->cmd.ext.opaques = opaques;
+			bank->cmd.ext.count = reg->count;
+			bank->cmd.ext.missing = reg->count;
+		}
+		else
+		{
+			at_registry_release (reg);
+			bank->cmd.ext.shared = NULL;
+		}
+	}
+
+	/* Load all plugins, and their static commands along with the core's */
+	int canc = at_cancel_disable ();
 
 	at_load_plugins ();
+	at_perf_init ();
+	at_register_basic (bank);
 	bank->plugins = at_instantiate_plugins (bank);
+
+	/* Freeze the extended commands into a lookup tree */
+	if (bank->cmd.ext.shared != NULL && bank->cmd.ext.missing > 0
+	 && at_commands_unshare (bank))
+		goto error;
+
+	if (bank->cmd.ext.shared != NULL)
+		bank->cmd.ext.trie = bank->cmd.ext.shared->trie;
+	else
+	{
+		bank->cmd.ext.trie = at_trie_build (bank->cmd.ext.handlers->name,
+		                                    bank->cmd.ext.count,
+		                                    sizeof (at_handler_t));
+		if (bank->cmd.ext.trie == NULL)
+			goto error;
+		at_registry_publish (bank);
+	}
 	at_cancel_enable (canc);
 	return bank;
+
+error:
+	at_cancel_enable (canc);
+	at_commands_deinit (bank);
+	return NULL;
 }
 
 void at_commands_deinit (at_commands_t *bank)
@@ -146,59 +338,65 @@ void at_commands_deinit (at_commands_t *bank)
 	int canc = at_cancel_disable ();
 	at_phonebooks_deinit (&bank->phonebooks);
 	at_deinstantiate_plugins (bank->plugins);
-	tdestroy (bank->cmd.extended, free);
+	if (bank->cmd.ext.shared != NULL)
+		at_registry_release (bank->cmd.ext.shared);
+	else
+	{
+		at_trie_destroy (bank->cmd.ext.trie);
+		free (bank->cmd.ext.handlers);
+	}
+	free (bank->cmd.ext.opaques);
+	for (size_t i = 0; i < AT_PLAN_CACHE; i++)
+		free (bank->cache.plans[i]);
 	free (bank);
 	at_unload_plugins ();
 	at_cancel_enable (canc);
 }
 
+int at_commands_reset (at_commands_t *bank)
+{
+	if (bank == NULL || bank->plugins == NULL)
+		return -1;
+
+	int canc = at_cancel_disable ();
+	int ret = at_reset_plugins (bank->plugins);
+	if (ret == 0)
+		at_phonebooks_reset (&bank->phonebooks);
+	at_cancel_enable (canc);
+	return ret;
+}
+
 
 /*** Command handler registration and lookup ***/
 
-/** Comparator for extended commands */
-static int ext_cmp (const void *a, const void *b)
+/**
+ * Binary search for an extended command.
+ * @param found set to whether the command is in the table
+ * @return the index of the command, or its insertion point
+ */
+static size_t at_ext_search (const at_commands_t *bank, const char *name,
+                             bool *found)
 {
-	const struct at_handler *ha = a;
-	const struct at_handler *hb = b;
-	size_t alen = strlen (ha->name);
-	size_t blen = strlen (hb->name);
-	int val;
+	const at_handler_t *tab = bank->cmd.ext.handlers;
+	size_t lo = 0, hi = bank->cmd.ext.count;
 
-	if (alen > blen)
-	{
-		val = strncasecmp (ha->name, hb->name, blen);
-		if (val != 0)
-			return val;
-		return +1;
-	}
-	else
-	if (alen < blen)
+	*found = false;
+	while (lo < hi)
 	{
-		val = strncasecmp (ha->name, hb->name, alen);
-		if (val != 0)
-			return val;
-		return -1;
-	}
-	else
-		return strcasecmp (ha->name, hb->name);
-}
+		size_t mid = (lo + hi) / 2;
+		int val = strcasecmp (name, tab[mid].name);
 
-static int ext_match (const void *a, const void *b)
-{
-	const char *cmd = a;
-	const struct at_handler *handler = b;
-	size_t len = strlen (handler->name);
-
-	int val = strncasecmp (cmd, handler->name, len);
-	if (val)
-		return val; /* crystal clear mismatch */
-
-	/* Handler is equal to, or has fewer characters than, command */
-	assert (strlen (cmd) >= len);
-	cmd += len;
-	if (isalnum ((unsigned char)cmd[0]))
-		return 1; // command is longer, e.g. "+CRC=..." vs "+CR" */
-	return 0; // proper match!
+		if (val == 0)
+		{
+			*found = true;
+			return mid;
+		}
+		if (val < 0)
+			hi = mid;
+		else
+			lo = mid + 1;
+	}
+	return lo;
 }
 
 int at_register_ext (at_commands_t *bank, const char *name, at_set_cb set,
@@ -206,32 +404,79 @@ int at_register_ext (at_commands_t *bank, const char *name, at_set_cb set,
 {
 	if (strlen (name) >= AT_NAME_MAX)
 		return ENAMETOOLONG;
+	if (at_plugins_find (name) != NULL)
+	{
+		warning ("Duplicate registration for AT%s", name);
+		return EALREADY;
+	}
 
-	struct at_handler *h = malloc (sizeof (*h));
-	if (h == NULL)
-		return errno;
-
-	strcpy (h->name, name);
-	h->set = set;
-	h->get = get;
-	h->test = test;
-	h->opaque = opaque;
+retry:;
+	at_handler_t *tab = bank->cmd.ext.handlers;
+	void **opaques = bank->cmd.ext.opaques;
+	bool found;
+	size_t lo = at_ext_search (bank, name, &found);
 
-	void **proot = &bank->cmd.extended;
-	struct at_handler **cur = tsearch (h, proot, ext_cmp);
-	if (cur == NULL) /* Out of memory */
+	if (found)
 	{
-		int val = errno;
-		free (h);
-		return val;
+		if (bank->cmd.ext.shared == NULL || opaques[lo] != AT_UNREGISTERED)
+		{
+			warning ("Duplicate registration for AT%s", name);
+			return EALREADY;
+		}
+		if (tab[lo].set == set && tab[lo].get == get && tab[lo].test == test)
+		{	/* Same as in the shared table */
+			opaques[lo] = opaque;
+			bank->cmd.ext.missing--;
+			bank->generation++;
+			return 0;
+		}
 	}
 
-	if ((void *)*cur != (void *)h)
-	{
-		warning ("Duplicate registration for AT%s", name);
-		free (h);
-		return EALREADY;
+	if (bank->cmd.ext.shared != NULL)
+	{	/* Diverging from the shared table: copy on write */
+		int val = at_commands_unshare (bank);
+		if (val)
+			return val;
+		goto retry;
+	}
+
+	size_t count = bank->cmd.ext.count;
+
+	tab = realloc (tab, (count + 1) * sizeof (*tab));
+	if (tab == NULL)
+		return errno;
+	bank->cmd.ext.handlers = tab;
+	opaques = realloc (opaques, (count + 1) * sizeof (*opaques));
+	if (opaques == NULL)
+		return errno;
+	bank->cmd.ext.opaques = opaques;
+
+	memmove (tab + lo + 1, tab + lo, (count - lo) * sizeof (*tab));
+	memmove (opaques + lo + 1, opaques + lo, (count - lo) * sizeof (*opaques));
+	strcpy (tab[lo].name, name);
+	tab[lo].set = set;
+	tab[lo].get = get;
+	tab[lo].test = test;
+	opaques[lo] = opaque;
+	bank->cmd.ext.count = ++count;
+
+	if (bank->cmd.ext.trie != NULL)
+	{	/* Late registration: rebuild the lookup tree */
+		at_trie_t *trie = at_trie_build (tab->name, count, sizeof (*tab));
+		if (trie == NULL)
+		{
+			int val = errno;
+
+			bank->cmd.ext.count = --count;
+			memmove (tab + lo, tab + lo + 1, (count - lo) * sizeof (*tab));
+			memmove (opaques + lo, opaques + lo + 1,
+			         (count - lo) * sizeof (*opaques));
+			return val;
+		}
+		at_trie_destroy (bank->cmd.ext.trie);
+		bank->cmd.ext.trie = trie;
 	}
+	bank->generation++;
 	return 0;
 }
 
@@ -250,6 +495,7 @@ int at_register_alpha (at_commands_t *bank, char cmd, at_alpha_cb req,
 
 	bank->cmd.alpha[x].handler = req;
 	bank->cmd.alpha[x].opaque = opaque;
+	bank->generation++;
 	return 0;
 }
 
@@ -267,6 +513,7 @@ int at_register_ampersand (at_commands_t *bank, char cmd, at_alpha_cb req,
 
 	bank->cmd.ampersand[x].handler = req;
 	bank->cmd.ampersand[x].opaque = opaque;
+	bank->generation++;
 	return 0;
 }
 
@@ -281,6 +528,7 @@ int at_register_dial (at_commands_t *bank, bool voice, at_set_cb req,
 	}
 	bank->cmd.dial[voice].handler = req;
 	bank->cmd.dial[voice].opaque = opaque;
+	bank->generation++;
 	return 0;
 }
 
@@ -302,6 +550,7 @@ int at_register_s (at_commands_t *bank, unsigned param,
 	bank->cmd.s[param].set = set;
 	bank->cmd.s[param].get = get;
 	bank->cmd.s[param].opaque = opaque;
+	bank->generation++;
 	return 0;
 }
 
@@ -317,14 +566,20 @@ int at_register_pb (at_commands_t *set, const char *id, at_pb_pw_cb pw_cb,
 
 /*** Command execution ***/
 
-at_error_t at_commands_execute (const at_commands_t *bank,
-                                at_modem_t *m, const char *req)
+/**
+ * Resolves an elementary AT command (with the AT prefix removed) to its
+ * handler, and splits its parameters. This has no side effects.
+ */
+static void at_commands_resolve (const at_commands_t *bank, const char *req,
+                                 at_request_t *r)
 {
-	if (bank == NULL)
-		return AT_ERROR;
-
 	char c = *req;
 
+	r->type = AT_REQ_RESULT;
+	r->param = AT_ERROR;
+	r->plugin = AT_PLUGIN_CORE;
+	r->name[0] = '\0';
+
 	if ((unsigned)(c - 'a') < 26)
 		c += 'A' - 'a';
 	if ((unsigned)(c - 'A') < 26)
@@ -333,39 +588,62 @@ at_error_t at_commands_execute (const at_commands_t *bank,
 		if (c == 'D')
 		{
 			bool voice = strchr (req, ';') != NULL;
-			at_set_cb cb = bank->cmd.dial[voice].handler;
 
-			if (cb == NULL)
-				return AT_NO_DIALTONE;
-			return cb (m, req + 1, bank->cmd.dial[voice].opaque);
+			if (bank->cmd.dial[voice].handler == NULL)
+			{
+				r->param = AT_NO_DIALTONE;
+				return;
+			}
+			strcpy (r->name, "D");
+			r->type = AT_REQ_STRING;
+			r->cb.string = bank->cmd.dial[voice].handler;
+			r->opaque = bank->cmd.dial[voice].opaque;
+			r->arg = 1;
+			return;
 		}
 
 		/* ATS */
 		if (c == 'S')
 		{
-			unsigned x, value;
-			char op;
+			char *end;
+			unsigned long x = strtoul (req + 1, &end, 10);
+			at_param_t value;
 
-			switch (sscanf (req, "%*c %u %c %u", &x, &op, &value))
+			if (end == req + 1)
+				return;
+			while (*end == ' ')
+				end++;
+
+			switch (*end)
 			{
-				case 2:
-					if (op != '?')
-						return AT_ERROR;
+				case '?':
 					break;
-				case 3:
-					if (op != '=')
-						return AT_ERROR;
+				case '=':
+					if (at_tokenize (end + 1, &value, 1) != 1
+					 || value.type != AT_PARAM_NUMBER)
+						return;
 					break;
 				default:
-					return AT_ERROR;
+					return;
 			}
 
 			if (x > AT_MAX_S || bank->cmd.s[x].set == NULL)
 				goto unknown;
 
-			if (op == '?')
-				return bank->cmd.s[x].get (m, bank->cmd.s[x].opaque);
-			return bank->cmd.s[x].set (m, value, bank->cmd.s[x].opaque);
+			snprintf (r->name, sizeof (r->name), "S%lu", x);
+			r->opaque = bank->cmd.s[x].opaque;
+			if (*end == '?')
+			{
+				r->type = AT_REQ_GET;
+				r->cb.get = bank->cmd.s[x].get;
+			}
+			else
+			{
+				r->type = AT_REQ_VALUE;
+				r->cb.value = bank->cmd.s[x].set;
+				r->param = value.number;
+			}
+			return;
 		}
 
 		/* AT + other latin letter */
@@ -376,8 +654,13 @@ at_error_t at_commands_execute (const at_commands_t *bank,
 		unsigned value;
 		if (sscanf (req, "%*c %u", &value) != 1)
 			value = 0;
-		return bank->cmd.alpha[x].handler (m, value,
-		                                   bank->cmd.alpha[x].opaque);
+		r->name[0] = c;
+		r->name[1] = '\0';
+		r->type = AT_REQ_VALUE;
+		r->cb.value = bank->cmd.alpha[x].handler;
+		r->opaque = bank->cmd.alpha[x].opaque;
+		r->param = value;
+		return;
 	}
 
 	/* AT& + latin letter */
@@ -389,81 +672,280 @@ at_error_t at_commands_execute (const at_commands_t *bank,
 		else if ((x - 'a') < 26)
 			x -= 'a';
 		else
-			return AT_ERROR; /* XXX: Is this even possible here? */
+			return; /* XXX: Is this even possible here? */
 		if (bank->cmd.ampersand[x].handler == NULL)
 			goto unknown;
 
 		unsigned value;
 		if (sscanf (req, "&%*c %u", &value) != 1)
 			value = 0;
-		return bank->cmd.ampersand[x].handler (m, value,
-		                                       bank->cmd.ampersand[x].opaque);
+		r->name[0] = '&';
+		r->name[1] = 'A' + x;
+		r->name[2] = '\0';
+		r->type = AT_REQ_VALUE;
+		r->cb.value = bank->cmd.ampersand[x].handler;
+		r->opaque = bank->cmd.ampersand[x].opaque;
+		r->param = value;
+		return;
 	}
 
 	/* Other command, i.e. extended command */
-	struct at_handler **p = tfind (req, &bank->cmd.extended, ext_match);
-	if (p == NULL)
-		goto unknown;
+	const at_entry_t *e = at_plugins_match (req);
+	int idx = at_trie_find (bank->cmd.ext.trie, req);
+	const char *name;
+	at_set_cb set;
+	at_get_cb get, test;
 
-	struct at_handler *h = *p;
-	assert (h->set != NULL);
+	if (idx >= 0 && (e == NULL
+	 || strlen (bank->cmd.ext.handlers[idx].name) > strlen (e->name)))
+	{	/* Registered by a plugin instance */
+		const at_handler_t *h = bank->cmd.ext.handlers + idx;
+
+		name = h->name;
+		set = h->set;
+		get = h->get;
+		test = h->test;
+		r->opaque = bank->cmd.ext.opaques[idx];
+	}
+	else if (e != NULL)
+	{	/* From a static table */
+		name = e->name;
+		set = e->cmd->set;
+		get = e->cmd->get;
+		test = e->cmd->test;
+		r->opaque = e->cmd->data;
+		if (e->plugin != AT_PLUGIN_CORE)
+			r->plugin = e->plugin;
+		else if (r->opaque == NULL)
+			r->opaque = (void *)bank;
+	}
+	else
+		goto unknown;
+	assert (set != NULL);
 
 	int offset;
+	strcpy (r->name, name);
+	r->type = AT_REQ_STRING;
+	r->cb.string = set;
+	r->arg = strlen (req); /* empty string */
+
 	if (sscanf (req, "%*[^?= ] %c%n", &c, &offset) < 1)
-		return h->set (m, "", h->opaque);
+		return;
 
+	r->arg = offset;
 	req += offset;
 
 	switch (c)
 	{
 		case '?':
 			/* "AT+FOO?" */
-			return (h->get != NULL) ? h->get (m, h->opaque) : AT_CME_EINVAL;
+			if (get != NULL)
+			{
+				r->type = AT_REQ_GET;
+				r->cb.get = get;
+			}
+			else
+			{
+				r->type = AT_REQ_RESULT;
+				r->param = AT_CME_EINVAL;
+			}
+			return;
 		case '=':
 			if (sscanf (req, " %n%c", &offset, &c) < 1)
-				/* "AT+FOO=" */
-				return h->set (m, "", h->opaque);
+			{	/* "AT+FOO=" */
+				r->arg += strlen (req);
+				return;
+			}
 
 			if (c == '?')
-				/* "AT+FOO=?" */
-				return (h->test != NULL) ? h->test (m, h->opaque) : AT_OK;
+			{	/* "AT+FOO=?" */
+				if (test != NULL)
+				{
+					r->type = AT_REQ_GET;
+					r->cb.get = test;
+				}
+				else
+				{
+					r->type = AT_REQ_RESULT;
+					r->param = AT_OK;
+				}
+				return;
+			}
 
-			req += offset;
 			/* "AT+FOO=BAR" */
-			return h->set (m, req, h->opaque);
+			r->arg += offset;
+			return;
 	}
 
 	/* "AT+FOOjunk" */
-	return AT_ERROR;
+	r->type = AT_REQ_RESULT;
+	r->param = AT_ERROR;
+	return;
 
 unknown:
-	warning ("Unknown request \"AT%s\"", req);
-	return AT_ERROR;
+	r->type = AT_REQ_UNKNOWN;
 }
 
+static at_error_t at_request_call (const at_commands_t *bank,
+                                   const at_request_t *r, at_modem_t *m,
+                                   const char *req)
+{
+	void *opaque = r->opaque;
 
-/*** AT+CLAC implementation ***/
+	if (r->plugin != AT_PLUGIN_CORE && r->type != AT_REQ_RESULT)
+	{	/* Plugin instantiated on first use */
+		void *data;
+
+		if (at_plugin_data (bank->plugins, r->plugin, &data))
+			return AT_ERROR;
+		if (opaque == NULL)
+			opaque = data;
+	}
 
-static at_modem_t *clac_modem;
+	switch (r->type)
+	{
+		case AT_REQ_VALUE:
+			return r->cb.value (m, r->param, opaque);
+		case AT_REQ_STRING:
+			return r->cb.string (m, req + r->arg, opaque);
+		case AT_REQ_GET:
+			return r->cb.get (m, opaque);
+		case AT_REQ_UNKNOWN:
+			warning ("Unknown request \"AT%s\"", req);
+			return AT_ERROR;
+	}
+	return r->param;
+}
 
-static void print_clac (const void *nodep, const VISIT which, const int depth)
+/**
+ * Executes a resolved elementary AT command.
+ */
+static at_error_t at_request_run (const at_commands_t *bank,
+                                  const at_request_t *r, at_modem_t *m,
+                                  const char *req)
 {
-	const struct at_handler *const *ph = nodep, *h = *ph;
+	if (!at_perf_active () || r->name[0] == '\0')
+		return at_request_call (bank, r, m, req);
 
-	if (which != postorder && which != leaf)
-		return;
+	uint64_t start = at_data_timestamp (CLOCK_MONOTONIC);
+	at_error_t ret = at_request_call (bank, r, m, req);
 
-	/* Do not list non-standard commands */
-	if (h->name[0] != '+')
-		return;
+	uint64_t end = at_data_timestamp (CLOCK_MONOTONIC);
+
+	/* AT@PERF may have just disabled recording */
+	if (at_perf_active ())
+		at_perf_record (r->name, ret, end - start);
+	return ret;
+}
+
+at_error_t at_commands_execute (const at_commands_t *bank,
+                                at_modem_t *m, const char *req)
+{
+	at_request_t r;
+
+	if (bank == NULL)
+		return AT_ERROR;
+
+	at_commands_resolve (bank, req, &r);
+	return at_request_run (bank, &r, m, req);
+}
+
+/** FNV-1a hash of a command line */
+static unsigned at_line_hash (const char *line, size_t len)
+{
+	unsigned hash = 2166136261u;
+
+	for (size_t i = 0; i < len; i++)
+		hash = (hash ^ (unsigned char)line[i]) * 16777619u;
+	return hash;
+}
+
+const at_plan_t *at_commands_compile (at_commands_t *bank,
+                                      const char *line, size_t len)
+{
+	if (bank == NULL)
+		return NULL;
+
+	unsigned hash = at_line_hash (line, len);
+	unsigned slot = bank->cache.next;
+
+	for (unsigned i = 0; i < AT_PLAN_CACHE; i++)
+	{
+		at_plan_t *plan = bank->cache.plans[i];
+
+		if (plan == NULL || plan->generation != bank->generation)
+		{	/* Prefer recycling a free or stale slot */
+			slot = i;
+			continue;
+		}
+		if (plan->hash == hash && plan->length == len
+		 && !memcmp (plan->line, line, len))
+			return plan;
+	}
+
+	/* Cache miss: split the command line */
+	char *cur = (char *)line;
+	size_t curlen = len, reqlen;
+	unsigned count = 0;
+
+	for (char *req = at_iterate_first (&cur, &curlen, &reqlen);
+	     req != NULL;
+	     req = at_iterate_next (&cur, &curlen, &reqlen))
+		count++;
+
+	at_plan_t *plan = malloc (sizeof (*plan)
+	                          + count * sizeof (plan->steps[0]) + len + 1);
+	if (plan == NULL)
+		return NULL;
+
+	char *copy = (char *)(plan->steps + count);
+	memcpy (copy, line, len + 1);
+	plan->generation = bank->generation;
+	plan->hash = hash;
+	plan->length = len;
+	plan->line = copy;
+	plan->count = count;
+
+	cur = copy;
+	curlen = len;
+	count = 0;
+	for (char *req = at_iterate_first (&cur, &curlen, &reqlen);
+	     req != NULL;
+	     req = at_iterate_next (&cur, &curlen, &reqlen))
+	{
+		char c = req[reqlen];
+
+		req[reqlen] = '\0';
+		at_commands_resolve (bank, req, &plan->steps[count].req);
+		req[reqlen] = c;
+		plan->steps[count].offset = req - copy;
+		plan->steps[count].length = reqlen;
+		count++;
+	}
+	assert (count == plan->count);
+	plan->rest = cur - copy;
 
-	at_intermediate (clac_modem, "\r\n%s", h->name);
-	(void) depth;
+	free (bank->cache.plans[slot]);
+	bank->cache.plans[slot] = plan;
+	bank->cache.next = (slot + 1) % AT_PLAN_CACHE;
+	return plan;
 }
 
+at_error_t at_commands_run (const at_commands_t *bank, at_modem_t *m,
+                            const at_plan_t *plan, unsigned i,
+                            const char *req)
+{
+	if (plan->generation != bank->generation)
+		/* Commands were registered by a previous command on the line */
+		return at_commands_execute (bank, m, req);
+	return at_request_run (bank, &plan->steps[i].req, m, req);
+}
+
+
+/*** AT+CLAC implementation ***/
+
 static at_error_t handle_clac (at_modem_t *m, const char *req, void *data)
 {
-	static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
 	at_commands_t *bank = data;
 
 	if (*req)
@@ -487,16 +969,40 @@ static at_error_t handle_clac (at_modem_t *m, const char *req, void *data)
 		if (bank->cmd.ampersand[i].handler != NULL)
 			at_intermediate (m, "\r\n&%c", 'A' + i);
 
-	pthread_mutex_lock (&lock);
-#ifndef NDEBUG
-	assert (clac_modem == NULL);
-#endif
-	clac_modem = m;
-	twalk (bank->cmd.extended, print_clac);
-#ifndef NDEBUG
-	clac_modem = NULL;
-#endif
-	pthread_mutex_unlock (&lock);
+	/* Merge the static and registered extended commands */
+	size_t count;
+	const at_entry_t *tab = at_plugins_list (&count);
+	const at_handler_t *h = bank->cmd.ext.handlers;
+
+	for (size_t i = 0, j = 0; i < count || j < bank->cmd.ext.count;)
+	{
+		const char *name;
+
+		if (j == bank->cmd.ext.count
+		 || (i < count && strcasecmp (tab[i].name, h[j].name) < 0))
+			name = tab[i++].name;
+		else
+			name = h[j++].name;
+
+		/* Do not list non-standard commands */
+		if (name[0] == '+')
+			at_intermediate (m, "\r\n%s", name);
+	}
 	(void) req;
 	return AT_OK;
 }
+
+static const at_command_t at_clac_commands[] = {
+	{ "+CLAC", handle_clac, NULL, NULL, NULL },
+	{ NULL, NULL, NULL, NULL, NULL },
+};
+
+const at_command_t *const at_core_commands[] = {
+	at_basic_commands,
+	at_charset_commands,
+	at_data_commands,
+	at_cmux_commands,
+	at_perf_commands,
+	at_clac_commands,
+	NULL,
+};
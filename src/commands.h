@@ -54,6 +54,14 @@ at_commands_t *at_commands_init (at_modem_t *modem);
  */
 void at_commands_deinit (at_commands_t *bank);
 
+/**
+ * Restores the default settings of a list of AT commands, keeping
+ * registrations (ATZ).
+ * @param bank AT commands list as returned by at_commands_init()
+ * @return 0 on success, -1 if the list must be destroyed and created again.
+ */
+int at_commands_reset (at_commands_t *bank);
+
 /**
  * Executes an elementary AT command (with the AT prefix removed)
  * @param bank AT commands list created by at_commands_init()
@@ -64,6 +72,81 @@ void at_commands_deinit (at_commands_t *bank);
 at_error_t at_commands_execute (const at_commands_t *bank, at_modem_t *modem,
                                 const char *str);
 
+/** Maximum length of an extended command name (including nul) */
+#define AT_NAME_MAX 15
+
+/** Resolved elementary AT command types */
+enum
+{
+	AT_REQ_RESULT, /**< fixed result without handler */
+	AT_REQ_UNKNOWN, /**< unknown command */
+	AT_REQ_VALUE, /**< handler with a numeric value */
+	AT_REQ_STRING, /**< handler with a string argument */
+	AT_REQ_GET, /**< handler without arguments */
+};
+
+/** Elementary AT command resolved to its handler */
+typedef struct at_request
+{
+	unsigned type; /**< resolved command type (AT_REQ_*) */
+	union
+	{
+		at_alpha_cb value;
+		at_set_cb string;
+		at_get_cb get;
+	} cb; /**< handler callback */
+	void *opaque; /**< handler data, or NULL for the plugin data */
+	size_t plugin; /**< plugin instantiated on first use, or AT_PLUGIN_CORE */
+	unsigned param; /**< numeric value, or result for AT_REQ_RESULT */
+	size_t arg; /**< offset of the string argument in the command */
+	char name[AT_NAME_MAX]; /**< command name for statistics, or empty */
+} at_request_t;
+
+/** Number of command lines cached for each list of AT commands */
+#define AT_PLAN_CACHE 8
+
+/** Execution plan for a complete AT command line */
+typedef struct at_plan
+{
+	unsigned generation; /**< commands registrations when compiled */
+	unsigned hash; /**< hash of the command line */
+	size_t length; /**< command line byte length */
+	const char *line; /**< command line (copy) */
+	size_t rest; /**< offset of left-over (malformed) characters */
+	unsigned count; /**< number of elementary commands */
+	struct
+	{
+		size_t offset; /**< offset of the command in the line */
+		size_t length; /**< byte length of the command */
+		at_request_t req; /**< resolved command */
+	} steps[];
+} at_plan_t;
+
+/**
+ * Splits an AT command line into elementary commands and resolves them, or
+ * looks up the result of a previous identical command line. The result
+ * remains valid until the next call.
+ * @param bank AT commands list created by at_commands_init()
+ * @param line nul-terminated AT command line (with the AT prefix)
+ * @param len byte length of the command line
+ * @return the execution plan or NULL on error.
+ */
+const at_plan_t *at_commands_compile (at_commands_t *bank,
+                                      const char *line, size_t len);
+
+/**
+ * Executes an elementary AT command from an execution plan.
+ * @param bank AT commands list the plan was compiled for
+ * @param modem AT modem instance to run commands for
+ * @param plan execution plan from at_commands_compile()
+ * @param i index of the elementary command in the plan
+ * @param str nul-terminated command string to execute
+ * @return AT_OK on success or an error code on failure (see @ref at_error).
+ */
+at_error_t at_commands_run (const at_commands_t *bank, at_modem_t *modem,
+                            const at_plan_t *plan, unsigned i,
+                            const char *str);
+
 void at_register_basic (at_commands_t *);
 
 typedef struct at_phonebook at_phonebook_t;
@@ -76,10 +159,18 @@ typedef struct at_phonebooks
 
 void at_phonebooks_init (at_phonebooks_t *);
 void at_phonebooks_deinit (at_phonebooks_t *);
+void at_phonebooks_reset (at_phonebooks_t *);
 int at_phonebooks_register (at_commands_t *set, at_phonebooks_t *, const char *,
                             at_pb_pw_cb, at_pb_read_cb, at_pb_write_cb,
                             at_pb_find_cb, at_pb_range_cb, void *);
 
 unsigned at_get_charset (at_modem_t *);
 void at_set_charset (at_modem_t *, unsigned);
-void at_register_charset (at_commands_t *);
+
+/** Extended commands of the core, terminated by a NULL table */
+extern const at_command_t *const at_core_commands[];
+extern const at_command_t at_basic_commands[];
+extern const at_command_t at_charset_commands[];
+extern const at_command_t at_data_commands[];
+extern const at_command_t at_cmux_commands[];
+extern const at_command_t at_perf_commands[];
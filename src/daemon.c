@@ -0,0 +1,534 @@
+/**
+ * @file daemon.c
+ * @brief Multi-port AT modem daemon
+ */
+
+/* ***** BEGIN LICENSE BLOCK *****
+ * Version: MPL 1.1/GPL 2.0/LGPL 2.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is matd.
+ *
+ * The Initial Developer of the Original Code is
+ * remi.denis-courmont@nokia.com.
+ * Portions created by the Initial Developer are
+ * Copyright (C) 2010 Nokia Corporation and/or its subsidiary(-ies).
+ * All Rights Reserved.
+ *
+ * Contributor(s):
+ *
+ * Alternatively, the contents of this file may be used under the terms of
+ * either the GNU General Public License Version 2 or later (the "GPL"), or
+ * the GNU Lesser General Public License Version 2.1 or later (the "LGPL"),
+ * in which case the provisions of the GPL or the LGPL are applicable instead
+ * of those above. If you wish to allow use of your version of this file only
+ * under the terms of either the GPL or the LGPL, and not to allow others to
+ * use your version of this file under the terms of the MPL, indicate your
+ * decision by deleting the provisions above and replace them with the notice
+ * and other provisions required by the GPL or the LGPL. If you do not delete
+ * the provisions above, a recipient may use your version of this file under
+ * the terms of any one of the MPL, the GPL or the LGPL.
+ *
+ * ***** END LICENSE BLOCK ***** */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <signal.h>
+#include <string.h>
+#include <errno.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <termios.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/signalfd.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <locale.h>
+#include <time.h>
+
+#include <at_modem.h>
+#include <at_log.h>
+
+/*
+ * All ports run in a single process. Plugins are loaded once for the whole
+ * daemon (see at_load_plugins()) and the D-Bus connections are per process,
+ * so each port only costs its AT modem: a thread, the parser state and the
+ * plugin instances. In event mode, there is not even a thread: the main
+ * loop feeds the AT modems (see at_modem_create()), but a slow command then
+ * delays all ports.
+ */
+
+/** Configured port: either a TTY or a listening Unix socket */
+struct port
+{
+	const char *path;
+	int fd; /**< listening socket, -1 for a TTY */
+	bool down; /**< TTY waiting to be re-opened */
+	bool term; /**< TTY settings need to be restored */
+	struct termios oldtp;
+};
+
+/** Running AT modem on a port */
+struct session
+{
+	struct session *prev, *next;
+	struct port *port;
+	struct at_modem *modem;
+	int fd;
+};
+
+static struct session *sessions = NULL;
+static size_t nsessions = 0;
+static int hangup_pipe[2];
+static bool event_mode = false; /**< no thread per port */
+static time_t retry_time = 0; /**< when to re-open TTYs that are down */
+
+static int usage (const char *cmd)
+{
+	const char fmt[] =
+"Usage: %s [-d] [-e] [-s socket]... [TTY node]...\n"
+"Provides AT commands emulation through multiple terminal devices and\n"
+"Unix sockets from a single process.\n"
+"\n"
+"  -d, --debug         enable debug messages\n"
+"  -e, --event         serve all ports from a single thread\n"
+"  -h, --help          print this help and exit\n"
+"  -s, --socket=PATH   accept connections on a Unix socket\n"
+"  -V, --version       print version informations and exit\n";
+
+	return (printf (fmt, cmd) >= 0) ? 0 : 1;
+}
+
+static int version (void)
+{
+	const char text[] =
+"MeeGo AT modem emulation daemon (version "VERSION")\n"
+"Written by Remi Denis-Courmont.\n"
+"Copyright (C) 2008-2010 Nokia Corporation. All rights reserved.";
+	return (puts (text) >= 0) ? 0 : 1;
+}
+
+/**
+ * Signals the main thread that a DTE hung up. This runs on the AT modem
+ * thread, which cannot stop itself.
+ */
+static void hangup_cb (struct at_modem *m, void *data)
+{
+	struct session *s = data;
+
+	if (write (hangup_pipe[1], &s, sizeof (s)) != sizeof (s))
+		syslog (LOG_CRIT, "Cannot report hang up: %m");
+	(void)m;
+}
+
+static int open_tty (struct port *p)
+{
+	int fd = open (p->path, O_RDWR|O_NOCTTY|O_CLOEXEC|O_NONBLOCK);
+	if (fd == -1)
+	{
+		syslog (LOG_ERR, "Cannot open %s: %m", p->path);
+		return -1;
+	}
+
+	p->term = !tcgetattr (fd, &p->oldtp);
+	if (p->term)
+	{
+		struct termios tp = p->oldtp;
+
+		ioctl (fd, TIOCEXCL);
+		tp.c_iflag &= ~(IGNBRK | BRKINT | PARMRK |
+		                INLCR | IGNCR | ICRNL | ISTRIP | IXON);
+		tp.c_oflag &= ~(OPOST | ONLCR | OCRNL | ONOCR | ONLRET | OFILL);
+		tp.c_cflag &= ~(CSIZE | PARENB);
+		tp.c_cflag |= CS8 | CLOCAL;
+		tp.c_lflag &= ~(ECHO | ECHONL | ICANON | ISIG | IEXTEN);
+		tcsetattr (fd, TCSADRAIN, &tp);
+	}
+
+	/* Blocking mode for actual I/O */
+	fcntl (fd, F_SETFL, fcntl (fd, F_GETFL) & ~O_NONBLOCK);
+	return fd;
+}
+
+static int open_socket (struct port *p)
+{
+	struct sockaddr_un addr = { .sun_family = AF_UNIX };
+	size_t len = strlen (p->path);
+	struct stat st;
+
+	if (len >= sizeof (addr.sun_path))
+	{
+		syslog (LOG_ERR, "Socket path too long: %s", p->path);
+		return -1;
+	}
+	memcpy (addr.sun_path, p->path, len + 1);
+
+	/* Remove stale socket from a previous instance */
+	if (lstat (p->path, &st) == 0 && S_ISSOCK (st.st_mode))
+		unlink (p->path);
+
+	int fd = socket (AF_UNIX, SOCK_STREAM|SOCK_CLOEXEC, 0);
+	if (fd == -1)
+	{
+		syslog (LOG_ERR, "Cannot create socket: %m");
+		return -1;
+	}
+
+	if (bind (fd, (struct sockaddr *)&addr, sizeof (addr))
+	 || listen (fd, 8))
+	{
+		syslog (LOG_ERR, "Cannot listen on %s: %m", p->path);
+		close (fd);
+		return -1;
+	}
+	return fd;
+}
+
+static struct session *session_start (struct port *p, int fd)
+{
+	struct session *s = malloc (sizeof (*s));
+	if (s == NULL)
+		return NULL;
+
+	s->port = p;
+	s->fd = fd;
+	if (event_mode)
+		s->modem = at_modem_create (fd, fd, NULL, NULL);
+	else
+		s->modem = at_modem_start (fd, fd, hangup_cb, s);
+	if (s->modem == NULL)
+	{
+		syslog (LOG_ERR, "Cannot start AT modem on %s: %m", p->path);
+		free (s);
+		return NULL;
+	}
+
+	s->prev = NULL;
+	s->next = sessions;
+	if (sessions != NULL)
+		sessions->prev = s;
+	sessions = s;
+	nsessions++;
+	return s;
+}
+
+static void session_stop (struct session *s)
+{
+	struct port *p = s->port;
+
+	if (event_mode)
+		at_modem_destroy (s->modem);
+	else
+		at_modem_stop (s->modem);
+
+	if (s->prev != NULL)
+		s->prev->next = s->next;
+	else
+		sessions = s->next;
+	if (s->next != NULL)
+		s->next->prev = s->prev;
+	nsessions--;
+
+	if (p->fd == -1 && p->term)
+		tcsetattr (s->fd, TCSAFLUSH, &p->oldtp);
+	close (s->fd);
+	free (s);
+}
+
+/** (Re)starts the AT modem on a TTY port. */
+static void tty_start (struct port *p)
+{
+	int fd = open_tty (p);
+	if (fd != -1)
+	{
+		if (session_start (p, fd) != NULL)
+		{
+			p->down = false;
+			return;
+		}
+		if (p->term)
+			tcsetattr (fd, TCSAFLUSH, &p->oldtp);
+		close (fd);
+	}
+	p->down = true;
+	retry_time = time (NULL) + 1;
+}
+
+static void socket_accept (struct port *p)
+{
+	int fd = accept4 (p->fd, NULL, NULL, SOCK_CLOEXEC);
+	if (fd == -1)
+		return;
+
+	if (session_start (p, fd) == NULL)
+		close (fd);
+	else
+		debug ("New connection on %s", p->path);
+}
+
+static void hangup (struct session *s)
+{
+	struct port *p = s->port;
+	bool tty = p->fd == -1;
+
+	syslog (LOG_NOTICE, "DTE hung up on %s", p->path);
+	session_stop (s);
+	if (tty)
+	{	/* Do not spin if the TTY hangs up again straight away */
+		p->down = true;
+		retry_time = time (NULL) + 1;
+	}
+}
+
+/** Main loop: handles signals, hang ups and new connections. */
+static void run (struct port *ports, size_t nports, int sigfd)
+{
+	for (;;)
+	{
+		int timeout = -1;
+
+		for (size_t i = 0; i < nports; i++)
+			if (ports[i].down && time (NULL) >= retry_time)
+				tty_start (ports + i);
+		for (size_t i = 0; i < nports; i++)
+			if (ports[i].down)
+				timeout = 1000; /* try again later */
+
+		/* In event mode, the main thread also reads from the DTEs, and
+		 * sends their queued unsolicited results */
+		size_t n = 2 + nports + (event_mode ? 2 * nsessions : 0);
+		struct pollfd ufd[n];
+		struct session *sv[n];
+
+		ufd[0].fd = sigfd;
+		ufd[0].events = POLLIN;
+		ufd[1].fd = hangup_pipe[0];
+		ufd[1].events = POLLIN;
+		for (size_t i = 0; i < nports; i++)
+		{
+			ufd[2 + i].fd = ports[i].fd;
+			ufd[2 + i].events = POLLIN;
+		}
+		n = 2 + nports;
+		if (event_mode)
+			for (struct session *s = sessions; s != NULL; s = s->next)
+			{
+				int ms = at_modem_flush (s->modem);
+
+				if (ms >= 0 && (timeout < 0 || ms < timeout))
+					timeout = ms;
+				sv[n] = s;
+				ufd[n].fd = s->fd;
+				ufd[n++].events = POLLIN;
+				sv[n] = s;
+				ufd[n].fd = at_modem_urc_fd (s->modem);
+				ufd[n++].events = POLLIN;
+			}
+
+		if (poll (ufd, n, timeout) == -1)
+			continue;
+
+		if (ufd[0].revents)
+		{
+			struct signalfd_siginfo si;
+
+			if (read (sigfd, &si, sizeof (si)) == sizeof (si))
+			{
+				if (si.ssi_signo == SIGUSR1)
+				{
+					at_log_command_stats ();
+					continue;
+				}
+				syslog (LOG_INFO, "stopped (caught signal %u - %s)",
+				        si.ssi_signo, strsignal (si.ssi_signo));
+				break;
+			}
+		}
+
+		if (ufd[1].revents)
+		{
+			struct session *s;
+
+			if (read (hangup_pipe[0], &s, sizeof (s)) == sizeof (s))
+				hangup (s);
+		}
+
+		/* Unsolicited results are sent at the next iteration */
+		for (size_t i = 2 + nports; i < n; i += 2)
+			if (ufd[i].revents && at_modem_ready (sv[i]->modem))
+				hangup (sv[i]);
+
+		for (size_t i = 0; i < nports; i++)
+			if (ufd[2 + i].revents)
+				socket_accept (ports + i);
+	}
+}
+
+/**
+ * Runs many AT modems from a single process.
+ * @param argc number of command line arguments
+ * @param argv array of command line arguments
+ * @return 0 on successful completion, 1 on I/O error, 2 on invalid arguments.
+ */
+int main (int argc, char *argv[])
+{
+	int ret = 1;
+	sigset_t set;
+
+	sigemptyset (&set);
+	sigaddset (&set, SIGHUP);
+	sigaddset (&set, SIGINT);
+	sigaddset (&set, SIGQUIT);
+	sigaddset (&set, SIGTERM);
+	sigaddset (&set, SIGUSR1);
+	signal (SIGPIPE, SIG_IGN);
+
+	setlocale (LC_CTYPE, "");
+
+#ifdef AT_PLUGINS_PATH
+	if (setenv ("AT_PLUGINS_PATH", AT_PLUGINS_PATH, 0))
+		return 2;
+#endif
+
+	int logopts = LOG_PID;
+	int logmask = LOG_UPTO(LOG_NOTICE);
+	struct port ports[argc];
+	size_t nports = 0;
+
+	static const struct option opts[] =
+	{
+		{ "debug",   no_argument,       NULL, 'd' },
+		{ "event",   no_argument,       NULL, 'e' },
+		{ "help",    no_argument,       NULL, 'h' },
+		{ "socket",  required_argument, NULL, 's' },
+		{ "version", no_argument,       NULL, 'V' },
+		{ NULL,      no_argument,       NULL, '\0'}
+	};
+
+	for (;;)
+	{
+		switch (getopt_long (argc, argv, "dehs:V", opts, NULL))
+		{
+			case -1:
+				goto done;
+			case 'd':
+				logopts |= LOG_PERROR;
+				logmask = LOG_UPTO(LOG_DEBUG);
+				break;
+			case 'e':
+				event_mode = true;
+				break;
+			case 'h':
+				return usage (argv[0]);
+			case 's':
+				ports[nports].path = optarg;
+				ports[nports++].fd = -2; /* opened below */
+				break;
+			case 'V':
+				return version ();
+			case '?':
+			default:
+				usage (argv[0]);
+				return 2;
+		}
+	}
+
+done:
+	while (optind < argc)
+	{
+		ports[nports].path = argv[optind++];
+		ports[nports++].fd = -1;
+	}
+
+	if (nports == 0)
+	{
+		fprintf (stderr, "%s: no ports specified\n", argv[0]);
+		return 2;
+	}
+
+	setlogmask (logmask);
+	openlog ("cellular: matd", logopts, LOG_DAEMON);
+
+	/* Signals are handled synchronously, block them in all threads */
+	pthread_sigmask (SIG_BLOCK, &set, NULL);
+
+	int sigfd = signalfd (-1, &set, SFD_CLOEXEC);
+	if (sigfd == -1)
+	{
+		syslog (LOG_CRIT, "Cannot create signal descriptor: %m");
+		goto out;
+	}
+
+	if (pipe2 (hangup_pipe, O_CLOEXEC))
+	{
+		syslog (LOG_CRIT, "Cannot create pipe: %m");
+		goto nopipe;
+	}
+
+	/* Keep plugins loaded until exit, even when no ports are active */
+	if (at_load_plugins ())
+		goto noplugins;
+
+	for (size_t i = 0; i < nports; i++)
+	{
+		struct port *p = ports + i;
+
+		p->down = false;
+		p->term = false;
+		if (p->fd == -1)
+			continue;
+
+		p->fd = open_socket (p);
+		if (p->fd == -1)
+			goto error;
+	}
+
+	for (size_t i = 0; i < nports; i++)
+		if (ports[i].fd == -1)
+			tty_start (ports + i);
+
+	syslog (LOG_INFO, "started with %zu port(s)", nports);
+
+	run (ports, nports, sigfd);
+	ret = 0;
+error:
+	while (sessions != NULL)
+		session_stop (sessions);
+
+	for (size_t i = 0; i < nports; i++)
+		if (ports[i].fd >= 0)
+		{
+			close (ports[i].fd);
+			unlink (ports[i].path);
+		}
+	at_unload_plugins ();
+noplugins:
+	close (hangup_pipe[1]);
+	close (hangup_pipe[0]);
+nopipe:
+	close (sigfd);
+out:
+	pthread_sigmask (SIG_UNBLOCK, &set, NULL);
+	closelog ();
+	return ret;
+}
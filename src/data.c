@@ -0,0 +1,825 @@
+/**
+ * @file data.c
+ * @brief Data mode bridge between the DTE and the DCE
+ * @ingroup internal
+ */
+
+/* ***** BEGIN LICENSE BLOCK *****
+ * Version: MPL 1.1/GPL 2.0/LGPL 2.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is matd.
+ *
+ * The Initial Developer of the Original Code is
+ * remi.denis-courmont@nokia.com.
+ * Portions created by the Initial Developer are
+ * Copyright (C) 2012 Nokia Corporation and/or its subsidiary(-ies).
+ * All Rights Reserved.
+ *
+ * Contributor(s):
+ *
+ * Alternatively, the contents of this file may be used under the terms of
+ * either the GNU General Public License Version 2 or later (the "GPL"), or
+ * the GNU Lesser General Public License Version 2.1 or later (the "LGPL"),
+ * in which case the provisions of the GPL or the LGPL are applicable instead
+ * of those above. If you wish to allow use of your version of this file only
+ * under the terms of either the GPL or the LGPL, and not to allow others to
+ * use your version of this file under the terms of the MPL, indicate your
+ * decision by deleting the provisions above and replace them with the notice
+ * and other provisions required by the GPL or the LGPL. If you do not delete
+ * the provisions above, a recipient may use your version of this file under
+ * the terms of any one of the MPL, the GPL or the LGPL.
+ *
+ * ***** END LICENSE BLOCK ***** */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <stdbool.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/uio.h>
+
+#include <at_command.h>
+#include <at_log.h>
+#include <at_thread.h>
+#include "commands.h"
+#include "data.h"
+
+/** Internal state of one direction of the data bridge. */
+struct at_data_flow
+{
+	int in; /**< Source file descriptor */
+	int out; /**< Sink file descriptor */
+	int pipe[2]; /**< Kernel pipe for zero-copy transfers */
+	bool splice; /**< Whether to use splice() */
+	bool full; /**< Whether the kernel pipe is full */
+	size_t piped; /**< Bytes pending in the pipe */
+	size_t pipe_size; /**< Kernel pipe capacity */
+	size_t avg; /**< Moving average of read sizes */
+	uint64_t since; /**< Time the oldest pending data was queued */
+
+	struct
+	{
+		uint8_t *buf;
+		size_t len; /**< Pending bytes */
+		size_t offset; /**< Write offset */
+	} stage; /**< Pipe data relayed through user space */
+
+	struct
+	{
+		uint8_t *buf;
+		size_t size; /**< Capacity (multiple of the MTU) */
+		size_t head; /**< Offset of the oldest pending byte */
+		size_t len; /**< Pending bytes */
+	} ring; /**< Bounce buffer for user-space copy */
+};
+
+uint64_t at_data_timestamp (clockid_t clk)
+{
+	struct timespec now;
+
+	clock_gettime (clk, &now);
+	return now.tv_sec * UINT64_C(1000000000) + now.tv_nsec;
+}
+
+static void flow_init (struct at_data_flow *f, int in, int out, size_t mtu)
+{
+	f->in = in;
+	f->out = out;
+	f->full = false;
+	f->piped = 0;
+	f->pipe_size = 0;
+	f->avg = 0;
+	f->since = 0;
+	f->stage.buf = NULL;
+	f->stage.len = 0;
+	f->stage.offset = 0;
+	f->ring.size = AT_DATA_SLOTS_MIN * mtu;
+	f->ring.buf = malloc (f->ring.size);
+	f->ring.head = 0;
+	f->ring.len = 0;
+
+	f->splice = !pipe2 (f->pipe, O_CLOEXEC|O_NONBLOCK);
+	if (f->splice)
+	{
+		int size = fcntl (f->pipe[0], F_GETPIPE_SZ);
+
+		f->pipe_size = (size > 0) ? size : 0;
+		f->stage.buf = malloc (mtu);
+		if (f->stage.buf == NULL)
+		{
+			close (f->pipe[1]);
+			close (f->pipe[0]);
+			f->splice = false;
+		}
+	}
+	if (!f->splice)
+		f->pipe[0] = f->pipe[1] = -1;
+}
+
+static void flow_deinit (struct at_data_flow *f)
+{
+	if (f->pipe[0] != -1)
+	{
+		close (f->pipe[1]);
+		close (f->pipe[0]);
+	}
+	free (f->stage.buf);
+	free (f->ring.buf);
+}
+
+static bool flow_pending (const struct at_data_flow *f)
+{
+	return (f->stage.len + f->piped + f->ring.len) > 0;
+}
+
+/**
+ * Checks whether there is room to read more data from the source.
+ * Data flows out of the stage first, then the pipe, then the ring. Hence
+ * the pipe is only filled while the ring is empty, so ordering is kept.
+ */
+static bool flow_can_fill (const struct at_data_flow *f)
+{
+	if (f->splice && f->ring.len == 0)
+		return !f->full;
+	return f->ring.len < f->ring.size;
+}
+
+/**
+ * Enlarges the queue of a direction that is full, if the observed read sizes
+ * suggest that the source is bursting. Small interactive reads never fill
+ * more than a couple of slots, so the queue is not grown for them.
+ */
+static void flow_grow (struct at_data_flow *f, size_t mtu)
+{
+	const size_t max = AT_DATA_SLOTS_MAX * mtu;
+
+	if (2 * f->avg < mtu)
+		return;
+
+	if (f->splice && f->ring.len == 0)
+	{
+		if (f->pipe_size == 0 || f->pipe_size >= max)
+			return;
+
+		int size = fcntl (f->pipe[0], F_SETPIPE_SZ, (int)(2 * f->pipe_size));
+		if (size > 0 && (size_t)size > f->pipe_size)
+		{
+			debug ("Pipe from %d to %d grown to %d bytes", f->in, f->out,
+			       size);
+			f->pipe_size = size;
+			f->full = false;
+		}
+		else
+			f->pipe_size = max; /* do not try again */
+		return;
+	}
+
+	size_t size = f->ring.size;
+	if (size >= max)
+		return;
+
+	uint8_t *buf = realloc (f->ring.buf, 2 * size);
+	if (buf == NULL)
+		return;
+
+	/* Move the wrapped-around oldest segment to the end */
+	if (f->ring.head + f->ring.len > size)
+	{
+		size_t n = size - f->ring.head;
+
+		memmove (buf + 2 * size - n, buf + f->ring.head, n);
+		f->ring.head += size;
+	}
+	f->ring.buf = buf;
+	f->ring.size = 2 * size;
+	debug ("Ring from %d to %d grown to %zu bytes", f->in, f->out, 2 * size);
+}
+
+/**
+ * Stops using splice() on a direction, e.g. if one end does not support it.
+ */
+static void flow_nosplice (struct at_data_flow *f)
+{
+	debug ("Zero-copy not supported from %d to %d", f->in, f->out);
+	f->splice = false;
+	f->full = false;
+}
+
+/** Describes the free space of the ring, up to max bytes. */
+static int ring_tail (const struct at_data_flow *f, struct iovec *iov,
+                      size_t max)
+{
+	size_t size = f->ring.size;
+	size_t tail = (f->ring.head + f->ring.len) % size;
+	size_t room = size - f->ring.len;
+	size_t first = size - tail;
+
+	if (room > max)
+		room = max;
+	if (first > room)
+		first = room;
+
+	iov[0].iov_base = f->ring.buf + tail;
+	iov[0].iov_len = first;
+	iov[1].iov_base = f->ring.buf;
+	iov[1].iov_len = room - first;
+	return (room > first) ? 2 : 1;
+}
+
+/** Describes the pending data of the ring. */
+static int ring_head (const struct at_data_flow *f, struct iovec *iov)
+{
+	size_t size = f->ring.size;
+	size_t first = size - f->ring.head;
+
+	if (first > f->ring.len)
+		first = f->ring.len;
+
+	iov[0].iov_base = f->ring.buf + f->ring.head;
+	iov[0].iov_len = first;
+	iov[1].iov_base = f->ring.buf;
+	iov[1].iov_len = f->ring.len - first;
+	return (f->ring.len > first) ? 2 : 1;
+}
+
+/** Checks whether the last n bytes read are the +++ escape sequence. */
+static bool ring_escape (const struct at_data_flow *f, size_t n)
+{
+	size_t size = f->ring.size;
+	size_t pos = f->ring.head + f->ring.len - n;
+
+	if (n != 3)
+		return false;
+
+	for (size_t i = 0; i < n; i++)
+		if (f->ring.buf[(pos + i) % size] != '+')
+			return false;
+	return true;
+}
+
+/**
+ * Pulls data from the source of a direction.
+ * Must only be called if flow_can_fill() is true.
+ * @param inspect true to read data into user space even if splice() works
+ * @return the number of bytes, 0 at end of stream, or -1 on error.
+ */
+static ssize_t flow_fill (struct at_data_flow *f, size_t mtu, bool inspect)
+{
+	ssize_t val;
+
+	if (f->splice && f->ring.len == 0 && !inspect)
+	{
+		val = splice (f->in, NULL, f->pipe[1], NULL, mtu,
+		              SPLICE_F_MOVE|SPLICE_F_NONBLOCK);
+		if (val > 0)
+			f->piped += val;
+		else
+		if (val == -1 && errno == EAGAIN && f->piped > 0)
+			f->full = true; /* the source was readable */
+		if (val != -1 || errno != EINVAL)
+			goto out;
+		flow_nosplice (f);
+	}
+
+	struct iovec iov[2];
+
+	val = readv (f->in, iov, ring_tail (f, iov, mtu));
+	if (val > 0)
+		f->ring.len += val;
+out:
+	if (val > 0)
+		f->avg = (7 * f->avg + val) / 8;
+	return val;
+}
+
+/**
+ * Pushes pending data to the sink of a direction.
+ * @return the number of bytes written, or -1 on error.
+ */
+static ssize_t flow_drain (struct at_data_flow *f, size_t mtu)
+{
+	ssize_t val;
+
+	if (f->stage.len == 0 && f->piped > 0)
+	{
+		if (f->splice)
+		{
+			val = splice (f->pipe[0], NULL, f->out, NULL, f->piped,
+			              SPLICE_F_MOVE|SPLICE_F_NONBLOCK);
+			if (val > 0)
+			{
+				f->piped -= val;
+				f->full = false;
+			}
+			if (val != -1 || errno != EINVAL)
+				return val;
+			flow_nosplice (f);
+		}
+
+		/* Sink cannot splice: relay pending pipe data through user space */
+		val = read (f->pipe[0], f->stage.buf,
+		            (f->piped < mtu) ? f->piped : mtu);
+		if (val <= 0)
+			return -1;
+		f->piped -= val;
+		f->stage.len = val;
+		f->stage.offset = 0;
+	}
+
+	if (f->stage.len > 0)
+	{
+		val = write (f->out, f->stage.buf + f->stage.offset, f->stage.len);
+		if (val > 0)
+		{
+			f->stage.len -= val;
+			f->stage.offset += val;
+		}
+		return val;
+	}
+
+	struct iovec iov[2];
+
+	val = writev (f->out, iov, ring_head (f, iov));
+	if (val > 0)
+	{
+		f->ring.len -= val;
+		/* Rewind when empty to keep reads contiguous */
+		if (f->ring.len == 0)
+			f->ring.head = 0;
+		else
+			f->ring.head = (f->ring.head + val) % f->ring.size;
+	}
+	return val;
+}
+
+void at_data_block (const at_data_ctx_t *ctx, int flags[3])
+{
+	const int fds[3] = { ctx->dte_in, ctx->dte_out, ctx->dce };
+
+	for (int i = 0; i < 3; i++)
+	{
+		flags[i] = fcntl (fds[i], F_GETFL);
+		if (flags[i] != -1 && (flags[i] & O_NONBLOCK))
+			fcntl (fds[i], F_SETFL, flags[i] & ~O_NONBLOCK);
+	}
+}
+
+void at_data_unblock (const at_data_ctx_t *ctx, const int flags[3])
+{
+	const int fds[3] = { ctx->dte_in, ctx->dte_out, ctx->dce };
+
+	/* Restore in reverse order, as descriptors may share a description */
+	for (int i = 2; i >= 0; i--)
+		if (flags[i] != -1)
+			fcntl (fds[i], F_SETFL, flags[i]);
+}
+
+void at_data_latency (at_data_stats_t *st, uint64_t ns)
+{
+	uint64_t us = ns / 1000;
+	unsigned k = 0;
+
+	while ((us >>= 1) > 0 && k < (AT_DATA_HIST - 1))
+		k++;
+	st->latency[k]++;
+}
+
+static void dump_init (struct at_data_dump *d, int fd, uint64_t now)
+{
+	const char *dir = getenv ("AT_STATS_DIR");
+
+	d->path = NULL;
+	d->last = now;
+	d->bytes[0] = d->bytes[1] = 0;
+
+	if (dir != NULL
+	 && asprintf (&d->path, "%s/data.%u.%d", dir, (unsigned)getpid (),
+	              fd) == -1)
+		d->path = NULL;
+}
+
+/**
+ * Writes session statistics to the statistics file, atomically.
+ */
+static void dump_write (struct at_data_dump *d, const at_data_session_t *s,
+                        uint64_t now)
+{
+	static const char names[2][3] = { "tx", "rx" };
+	uint64_t delay = now - d->last;
+	char *tmp;
+
+	if (d->path == NULL || asprintf (&tmp, "%s.tmp", d->path) == -1)
+		return;
+
+	int canc = at_cancel_disable ();
+	FILE *out = fopen (tmp, "w");
+	if (out == NULL)
+	{
+		warning ("Cannot write data statistics %s (%m)", tmp);
+		free (d->path); /* do not try again */
+		d->path = NULL;
+		goto out;
+	}
+
+	fprintf (out, "active=%d\n", s->active);
+	fprintf (out, "real_ns=%"PRIu64"\n", s->real);
+	fprintf (out, "thread_ns=%"PRIu64"\n", s->thread);
+	fprintf (out, "process_ns=%"PRIu64"\n", s->process);
+	fprintf (out, "polls=%"PRIu64"\n", s->polls);
+	for (int i = 0; i < 2; i++)
+	{
+		const at_data_stats_t *st = s->dir + i;
+		const char *n = names[i];
+		uint64_t bytes = st->bytes - d->bytes[i];
+
+		fprintf (out, "%s.bytes=%"PRIu64"\n", n, st->bytes);
+		fprintf (out, "%s.bps=%"PRIu64"\n", n,
+		         delay ? (8000000000 * bytes / delay) : 0);
+		fprintf (out, "%s.idle_ns=%"PRIu64"\n", n, st->idle);
+		fprintf (out, "%s.congest_ns=%"PRIu64"\n", n, st->congest);
+		fprintf (out, "%s.reads=%"PRIu64"\n", n, st->reads);
+		fprintf (out, "%s.writes=%"PRIu64"\n", n, st->writes);
+		fprintf (out, "%s.latency_us=", n);
+		for (unsigned k = 0; k < AT_DATA_HIST; k++)
+			fprintf (out, "%s%"PRIu64, k ? "," : "", st->latency[k]);
+		fputc ('\n', out);
+		d->bytes[i] = st->bytes;
+	}
+	d->last = now;
+
+	if (fclose (out) || rename (tmp, d->path))
+	{
+		warning ("Cannot write data statistics %s (%m)", d->path);
+		unlink (tmp);
+	}
+out:
+	at_cancel_enable (canc);
+	free (tmp);
+}
+
+static void session_update (at_data_ctx_t *ctx, uint64_t now)
+{
+	at_data_session_t *s = ctx->session;
+
+	s->real = now - ctx->start[0];
+	s->thread = at_data_timestamp (CLOCK_THREAD_CPUTIME_ID) - ctx->start[1];
+	s->process = at_data_timestamp (CLOCK_PROCESS_CPUTIME_ID) - ctx->start[2];
+}
+
+void at_data_tick (at_data_ctx_t *ctx, uint64_t now)
+{
+	if (ctx->dump.path != NULL
+	 && (now - ctx->dump.last) >= UINT64_C(1000000000))
+	{
+		session_update (ctx, now);
+		dump_write (&ctx->dump, ctx->session, now);
+	}
+}
+
+static void cleanup_flows (void *data)
+{
+	struct at_data_flow *flows = data;
+
+	flow_deinit (flows + 1);
+	flow_deinit (flows + 0);
+}
+
+/**
+ * Forwards data with poll() and non-blocking splice() or read()/write().
+ */
+static void data_poll (at_data_ctx_t *ctx)
+{
+	struct at_data_flow flows[2];
+	at_data_session_t *s = ctx->session;
+	size_t mtu = ctx->mtu;
+
+	flow_init (flows + 0, ctx->dte_in, ctx->dce, mtu);
+	flow_init (flows + 1, ctx->dce, ctx->dte_out, mtu);
+	pthread_cleanup_push (cleanup_flows, flows);
+	if (flows[0].ring.buf == NULL || flows[1].ring.buf == NULL)
+		goto out;
+
+	struct pollfd ufd[4];
+	for (int i = 0; i < 2; i++)
+	{
+		ufd[i].events = POLLIN;
+		ufd[2 + i].events = POLLOUT;
+	}
+
+	/* Refresh the statistics file every second */
+	int timeout = (ctx->dump.path != NULL) ? 1000 : -1;
+	/* Not live across pthread_cleanup_push(), so it cannot be clobbered */
+	uint64_t now = at_data_timestamp (CLOCK_MONOTONIC);
+
+	for (;;)
+	{
+		bool fill[2], pending[2];
+
+		/* Read from the source while there is room left, and write to the
+		 * sink while there is pending data. Negative descriptors also mask
+		 * out POLLERR and POLLHUP. */
+		for (int i = 0; i < 2; i++)
+		{
+			struct at_data_flow *f = flows + i;
+
+			if (!flow_can_fill (f))
+				flow_grow (f, mtu);
+			fill[i] = flow_can_fill (f);
+			pending[i] = flow_pending (f);
+			ufd[i].fd = fill[i] ? f->in : -1;
+			ufd[2 + i].fd = pending[i] ? f->out : -1;
+		}
+
+		uint64_t delay = now;
+		while (poll (ufd, 4, timeout) < 0)
+			s->polls++;
+		s->polls++;
+		now = at_data_timestamp (CLOCK_MONOTONIC);
+		delay = now - delay;
+
+		for (int i = 0; i < 2; i++)
+			if (!fill[i])
+				s->dir[i].congest += delay;
+			else if (!pending[i])
+				s->dir[i].idle += delay;
+
+		for (int i = 0; i < 2; i++)
+		{
+			struct at_data_flow *f = flows + i;
+			at_data_stats_t *st = s->dir + i;
+
+			if (ufd[i].revents & (POLLIN|POLLERR|POLLHUP))
+			{
+				/* The +++ escape sequence can only follow the guard time.
+				 * Only then does DTE data need to be seen in user space. */
+				bool inspect = (i == 0)
+				            && (now - ctx->last_rx) >= AT_DATA_GUARD_TIME;
+
+				st->reads++;
+				ssize_t val = flow_fill (f, mtu, inspect);
+				if (val == -1)
+				{
+					if (errno != EINTR && errno != EAGAIN)
+					{
+						warning ("%s data read error (%m)",
+						         i ? "DCE" : "DTE");
+						goto out;
+					}
+				}
+				else
+				if (val == 0)
+				{
+					notice ("%s data stream end", i ? "DCE" : "DTE");
+					goto out;
+				}
+				else
+				{
+					if (!pending[i])
+						f->since = now;
+					if (i == 0)
+					{
+						/* +++ escape handling */
+						if (inspect && ring_escape (f, val))
+						{
+							debug ("Caught +++ escape sequence");
+							goto out;
+						}
+						ctx->last_rx = now;
+					}
+				}
+			}
+			if (ufd[2 + i].revents & (POLLOUT|POLLERR|POLLHUP))
+			{
+				st->writes++;
+				ssize_t val = flow_drain (f, mtu);
+				if (val == -1)
+				{
+					if (errno != EINTR && errno != EAGAIN)
+					{
+						warning ("%s data write error (%m)",
+						         i ? "DTE" : "DCE");
+						goto out;
+					}
+				}
+				else
+				{
+					st->bytes += val;
+					if (!flow_pending (f))
+						at_data_latency (st, now - f->since);
+				}
+			}
+		}
+
+		at_data_tick (ctx, now);
+	}
+out:
+	pthread_cleanup_pop (1);
+}
+
+static void cleanup_session (void *data)
+{
+	at_data_ctx_t *ctx = data;
+	uint64_t now = at_data_timestamp (CLOCK_MONOTONIC);
+
+	session_update (ctx, now);
+	ctx->session->active = false;
+	dump_write (&ctx->dump, ctx->session, now);
+	free (ctx->dump.path);
+}
+
+/**
+ * Forwards data with the selected data engine, falling back to poll().
+ */
+static void data_run (at_data_ctx_t *ctx)
+{
+	const char *engine = getenv ("AT_DATA_ENGINE");
+
+	if (engine != NULL && !strcmp (engine, "duplex"))
+	{
+		if (at_data_duplex (ctx) == 0)
+			return;
+		debug ("Falling back to poll() data engine");
+	}
+#ifdef HAVE_IO_URING
+	else
+	if (engine == NULL || strcmp (engine, "poll"))
+	{
+		if (at_data_uring (ctx) == 0)
+			return;
+		debug ("Falling back to poll() data engine");
+	}
+#endif
+	data_poll (ctx);
+}
+
+/**
+ * Runs a data session, and updates its statistics even if cancelled.
+ */
+static void data_session (at_data_ctx_t *ctx)
+{
+	pthread_cleanup_push (cleanup_session, ctx);
+	data_run (ctx);
+	pthread_cleanup_pop (1);
+}
+
+void at_data_bridge (int dte_in, int dte_out, int dce, size_t mtu,
+                     at_data_session_t *s)
+{
+	at_data_ctx_t ctx;
+	uint64_t now = at_data_timestamp (CLOCK_MONOTONIC);
+
+	memset (s, 0, sizeof (*s));
+	s->active = true;
+	ctx.dte_in = dte_in;
+	ctx.dte_out = dte_out;
+	ctx.dce = dce;
+	ctx.mtu = mtu;
+	ctx.session = s;
+	ctx.last_rx = 0;
+	ctx.start[0] = now;
+	ctx.start[1] = at_data_timestamp (CLOCK_THREAD_CPUTIME_ID);
+	ctx.start[2] = at_data_timestamp (CLOCK_PROCESS_CPUTIME_ID);
+	dump_init (&ctx.dump, dte_in, now);
+	data_session (&ctx);
+}
+
+void at_data_session_add (at_data_session_t *total,
+                          const at_data_session_t *s)
+{
+	total->active = s->active;
+	total->real += s->real;
+	total->thread += s->thread;
+	total->process += s->process;
+	total->polls += s->polls;
+
+	for (int i = 0; i < 2; i++)
+	{
+		at_data_stats_t *t = total->dir + i;
+		const at_data_stats_t *st = s->dir + i;
+
+		t->bytes += st->bytes;
+		t->idle += st->idle;
+		t->congest += st->congest;
+		t->reads += st->reads;
+		t->writes += st->writes;
+		for (unsigned k = 0; k < AT_DATA_HIST; k++)
+			t->latency[k] += st->latency[k];
+	}
+}
+
+void at_data_session_log (const at_data_session_t *s)
+{
+	uint64_t real = s->real ? s->real : 1;
+	lldiv_t d;
+
+	d = lldiv (s->real, 1000000000);
+	notice ("In %llu.%09llu seconds:", d.quot, d.rem);
+	for (int i = 0; i < 2; i++)
+	{
+		const at_data_stats_t *st = s->dir + i;
+
+		notice (i ? " received    %"PRIu64" bytes at %.0f bps"
+		          : " transmitted %"PRIu64" bytes at %.0f bps",
+		        st->bytes, (8000000000. * st->bytes) / real);
+		d = lldiv (st->idle, 1000000000);
+		notice ("  idle      %llu.%09llu seconds (%3"PRIu64"%%)",
+		        d.quot, d.rem, 100 * st->idle / real);
+		d = lldiv (st->congest, 1000000000);
+		notice ("  congested %llu.%09llu seconds (%3"PRIu64"%%)",
+		        d.quot, d.rem, 100 * st->congest / real);
+		notice ("  %"PRIu64" reads, %"PRIu64" writes",
+		        st->reads, st->writes);
+	}
+	d = lldiv (s->thread, 1000000000);
+	notice (" thread  consumed %llu.%09llu seconds (%3"PRIu64"%%)",
+	        d.quot, d.rem, 100 * s->thread / real);
+	d = lldiv (s->process, 1000000000);
+	notice (" process consumed %llu.%09llu seconds (%3"PRIu64"%%)",
+	        d.quot, d.rem, 100 * s->process / real);
+}
+
+
+/*** AT@DSTATS ***/
+
+static void print_dstats (at_modem_t *m, const char *name,
+                          const at_data_session_t *s)
+{
+	uint64_t real = s->real ? s->real : 1;
+
+	at_intermediate (m, "\r\n@DSTATS: \"%s\",%d,%"PRIu64",%"PRIu64",%"
+	                 PRIu64",%"PRIu64, name, s->active, s->real / 1000000,
+	                 s->thread / 1000000, s->process / 1000000, s->polls);
+
+	for (int i = 0; i < 2; i++)
+	{
+		const at_data_stats_t *st = s->dir + i;
+
+		at_intermediate (m, "\r\n@DSTATS: \"%s-%s\",%"PRIu64",%.0f,%"PRIu64
+		                 ",%"PRIu64",%"PRIu64",%"PRIu64, name,
+		                 i ? "rx" : "tx", st->bytes,
+		                 (8000000000. * st->bytes) / real,
+		                 st->idle / 1000000, st->congest / 1000000,
+		                 st->reads, st->writes);
+		at_intermediate (m, "\r\n@DSTATS: \"%s-%s-latency\"", name,
+		                 i ? "rx" : "tx");
+		for (unsigned k = 0; k < AT_DATA_HIST; k++)
+			at_intermediate (m, ",%"PRIu64, st->latency[k]);
+	}
+}
+
+static at_error_t set_dstats (at_modem_t *m, const char *req, void *data)
+{
+	at_data_history_t *h = at_get_data_history (m);
+	unsigned mode;
+
+	if (sscanf (req, " %u", &mode) != 1 || mode != 0)
+		return AT_CME_EINVAL;
+
+	memset (&h->total, 0, sizeof (h->total));
+	h->sessions = 0;
+	(void) data;
+	return AT_OK;
+}
+
+static at_error_t get_dstats (at_modem_t *m, void *data)
+{
+	const at_data_history_t *h = at_get_data_history (m);
+
+	at_intermediate (m, "\r\n@DSTATS: %u", h->sessions);
+	print_dstats (m, "last", &h->last);
+	print_dstats (m, "total", &h->total);
+	(void) data;
+	return AT_OK;
+}
+
+static at_error_t list_dstats (at_modem_t *m, void *data)
+{
+	(void) data;
+	return at_intermediate (m, "\r\n@DSTATS: (0)");
+}
+
+const at_command_t at_data_commands[] = {
+	{ "@DSTATS", set_dstats, get_dstats, list_dstats, NULL },
+	{ NULL, NULL, NULL, NULL, NULL },
+};
@@ -0,0 +1,200 @@
+/**
+ * @file data.h
+ * @brief Internal header for the data mode bridge
+ * @ingroup internal
+ */
+
+/* ***** BEGIN LICENSE BLOCK *****
+ * Version: MPL 1.1/GPL 2.0/LGPL 2.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is matd.
+ *
+ * The Initial Developer of the Original Code is
+ * remi.denis-courmont@nokia.com.
+ * Portions created by the Initial Developer are
+ * Copyright (C) 2012 Nokia Corporation and/or its subsidiary(-ies).
+ * All Rights Reserved.
+ *
+ * Contributor(s):
+ *
+ * Alternatively, the contents of this file may be used under the terms of
+ * either the GNU General Public License Version 2 or later (the "GPL"), or
+ * the GNU Lesser General Public License Version 2.1 or later (the "LGPL"),
+ * in which case the provisions of the GPL or the LGPL are applicable instead
+ * of those above. If you wish to allow use of your version of this file only
+ * under the terms of either the GPL or the LGPL, and not to allow others to
+ * use your version of this file under the terms of the MPL, indicate your
+ * decision by deleting the provisions above and replace them with the notice
+ * and other provisions required by the GPL or the LGPL. If you do not delete
+ * the provisions above, a recipient may use your version of this file under
+ * the terms of any one of the MPL, the GPL or the LGPL.
+ *
+ * ***** END LICENSE BLOCK ***** */
+
+#ifndef AT_DATA_H
+# define AT_DATA_H 1
+
+# include <stdbool.h>
+# include <stdint.h>
+# include <time.h>
+# include <at_command.h>
+
+/** Number of buckets in latency histograms */
+# define AT_DATA_HIST 16
+
+/** Per-direction data mode statistics */
+typedef struct at_data_stats
+{
+	uint64_t bytes; /**< Bytes forwarded */
+	uint64_t idle; /**< Nanoseconds with no data pending */
+	uint64_t congest; /**< Nanoseconds with reading stalled by writing */
+	uint64_t reads; /**< Read or splice-in operations */
+	uint64_t writes; /**< Write or splice-out operations */
+	/** Queueing latency histogram: bucket k counts the times data stayed
+	 * queued for 2^k to 2^(k+1) microseconds (the last bucket is open) */
+	uint64_t latency[AT_DATA_HIST];
+} at_data_stats_t;
+
+/** Data mode session statistics */
+typedef struct at_data_session
+{
+	bool active; /**< Whether the session is still running */
+	uint64_t real; /**< Elapsed nanoseconds */
+	uint64_t thread; /**< Nanoseconds of bridge thread CPU time */
+	uint64_t process; /**< Nanoseconds of process CPU time */
+	uint64_t polls; /**< poll() or io_uring_enter() system calls */
+	at_data_stats_t dir[2]; /**< [0] is DTE to DCE, [1] DCE to DTE */
+} at_data_session_t;
+
+/**
+ * Forwards data between the DTE and the DCE until either side reaches end of
+ * stream, an I/O error occurs, or the DTE sends the +++ escape sequence.
+ *
+ * Where both ends of a direction support it, data is moved through a kernel
+ * pipe with splice() rather than copied through user space. Otherwise, or if
+ * splice() fails with EINVAL, the direction falls back to read() and write()
+ * through a ring of MTU-sized slots. Each direction keeps reading while
+ * earlier data is still being written; the queue grows if reads are large.
+ *
+ * If the library was built with io_uring support, data is instead moved with
+ * batched asynchronous reads and writes into registered buffers, unless the
+ * AT_DATA_ENGINE environment variable is set to "poll", or io_uring is not
+ * available at run-time. If AT_DATA_ENGINE is set to "duplex", each direction
+ * is instead forwarded by its own thread with blocking I/O.
+ *
+ * If the AT_STATS_DIR environment variable is set, the session statistics
+ * are written to a file in that directory every second, and at the end.
+ *
+ * @param dte_in file descriptor to read data from the DTE
+ * @param dte_out file descriptor to write data to the DTE
+ * @param dce file descriptor of the DCE data stream
+ * @param mtu maximum bytes transferred per system call
+ * @param s session statistics to reset and update
+ */
+void at_data_bridge (int dte_in, int dte_out, int dce, size_t mtu,
+                     at_data_session_t *s);
+
+/** Escape sequence guard time (S12 = 50, i.e. one second) */
+# define AT_DATA_GUARD_TIME UINT64_C(1000000000)
+
+/** Initial number of MTU-sized slots per direction */
+# define AT_DATA_SLOTS_MIN 2
+/** Maximum number of MTU-sized slots per direction */
+# define AT_DATA_SLOTS_MAX 16
+
+/** Statistics file state */
+struct at_data_dump
+{
+	char *path; /**< Statistics file path, or NULL if disabled */
+	uint64_t last; /**< Time of the last dump */
+	uint64_t bytes[2]; /**< Byte counts at the last dump */
+};
+
+/** Data mode session state shared by the bridge engines */
+typedef struct at_data_ctx
+{
+	int dte_in; /**< DTE input file descriptor */
+	int dte_out; /**< DTE output file descriptor */
+	int dce; /**< DCE data stream file descriptor */
+	size_t mtu; /**< Maximum bytes transferred per system call */
+	at_data_session_t *session; /**< Session statistics */
+	uint64_t last_rx; /**< Time of the last DTE input */
+	uint64_t start[3]; /**< Start real, thread and process times */
+	struct at_data_dump dump; /**< Statistics file */
+} at_data_ctx_t;
+
+/** Reads a clock, in nanoseconds. */
+uint64_t at_data_timestamp (clockid_t clk);
+
+/**
+ * Switches the session file descriptors to blocking mode.
+ * @param flags place to save the original file status flags
+ */
+void at_data_block (const at_data_ctx_t *ctx, int flags[3]);
+
+/**
+ * Restores the file status flags saved by at_data_block().
+ */
+void at_data_unblock (const at_data_ctx_t *ctx, const int flags[3]);
+
+/** Records how long data stayed queued in a direction. */
+void at_data_latency (at_data_stats_t *st, uint64_t ns);
+
+/**
+ * Refreshes the session clocks and the statistics file if it is due.
+ * This must be called from the thread that runs at_data_bridge().
+ */
+void at_data_tick (at_data_ctx_t *ctx, uint64_t now);
+
+/**
+ * Forwards data with one thread per direction and blocking I/O, until the
+ * end of the session. The threads only coordinate on teardown.
+ * @return 0 once the session is over,
+ * -1 if the engine could not be started (then no data was forwarded).
+ */
+int at_data_duplex (at_data_ctx_t *ctx);
+
+# ifdef HAVE_IO_URING
+/**
+ * Forwards data with io_uring, until the end of the session.
+ * @return 0 once the session is over,
+ * -1 if io_uring is not available (then no data was forwarded).
+ */
+int at_data_uring (at_data_ctx_t *ctx);
+# endif
+
+/**
+ * Adds the statistics of a session to cumulative statistics.
+ */
+void at_data_session_add (at_data_session_t *total,
+                          const at_data_session_t *s);
+
+/**
+ * Logs a summary of a session.
+ */
+void at_data_session_log (const at_data_session_t *s);
+
+/** Data mode statistics of an AT modem */
+typedef struct at_data_history
+{
+	at_data_session_t last; /**< Current or last session */
+	at_data_session_t total; /**< Cumulative statistics */
+	unsigned sessions; /**< Number of sessions */
+} at_data_history_t;
+
+/**
+ * Retrieves the data mode statistics of an AT modem.
+ */
+at_data_history_t *at_get_data_history (at_modem_t *);
+
+#endif
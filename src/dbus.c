@@ -468,7 +468,7 @@ int at_dbus_add_filter (DBusBusType bus, DBusHandleMessageFunction filter_cb,
 		ret = 0;
 
 	at_cancel_enable (canc);
-	return 0;
+	return ret;
 }
 
 
@@ -477,9 +477,9 @@ void at_dbus_remove_filter (DBusBusType bus,
 {
 	int canc = at_cancel_disable ();
 	DBusConnection *conn = at_dbus_get (bus);
-	assert (conn != NULL); /* cannot fail as add_filter succeeded */
-
-	dbus_connection_remove_filter (conn, filter_cb, opaque);
+	/* NULL if the bus was never available, then add_filter failed too */
+	if (conn != NULL)
+		dbus_connection_remove_filter (conn, filter_cb, opaque);
 	at_cancel_enable (canc);
 }
 
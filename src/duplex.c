@@ -0,0 +1,329 @@
+/**
+ * @file duplex.c
+ * @brief Full-duplex engine for the data mode bridge
+ * @ingroup internal
+ */
+
+/* ***** BEGIN LICENSE BLOCK *****
+ * Version: MPL 1.1/GPL 2.0/LGPL 2.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is matd.
+ *
+ * The Initial Developer of the Original Code is
+ * remi.denis-courmont@nokia.com.
+ * Portions created by the Initial Developer are
+ * Copyright (C) 2012 Nokia Corporation and/or its subsidiary(-ies).
+ * All Rights Reserved.
+ *
+ * Contributor(s):
+ *
+ * Alternatively, the contents of this file may be used under the terms of
+ * either the GNU General Public License Version 2 or later (the "GPL"), or
+ * the GNU Lesser General Public License Version 2.1 or later (the "LGPL"),
+ * in which case the provisions of the GPL or the LGPL are applicable instead
+ * of those above. If you wish to allow use of your version of this file only
+ * under the terms of either the GPL or the LGPL, and not to allow others to
+ * use your version of this file under the terms of the MPL, indicate your
+ * decision by deleting the provisions above and replace them with the notice
+ * and other provisions required by the GPL or the LGPL. If you do not delete
+ * the provisions above, a recipient may use your version of this file under
+ * the terms of any one of the MPL, the GPL or the LGPL.
+ *
+ * ***** END LICENSE BLOCK ***** */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+
+#include <at_command.h>
+#include <at_log.h>
+#include <at_thread.h>
+#include "data.h"
+
+/** Internal state of one direction of the full-duplex engine. */
+struct duplex_flow
+{
+	int in; /**< Source file descriptor */
+	int out; /**< Sink file descriptor */
+	unsigned dir; /**< Index of the direction */
+	uint8_t *buf; /**< MTU-sized buffer */
+	uint64_t now; /**< Time of the last completed system call */
+	uint64_t flushed; /**< Time the statistics were last published */
+	at_data_stats_t stats; /**< Statistics, owned by the direction thread */
+};
+
+/** Internal state of the full-duplex engine. */
+struct duplex
+{
+	at_data_ctx_t *ctx;
+	pthread_mutex_t lock; /**< Protects the session statistics */
+	pthread_t worker; /**< DCE to DTE direction thread */
+	int wake[2]; /**< Signals the end of the DCE to DTE direction */
+	int flags[3]; /**< Original file status flags */
+	uint64_t polls;
+	struct duplex_flow flows[2];
+};
+
+/**
+ * Publishes the statistics of a direction to the session. The modem thread
+ * (DTE to DCE direction) also refreshes the statistics file if it is due,
+ * as the session clocks are relative to its CPU time. The other direction
+ * may be up to one second behind in the file.
+ */
+static void duplex_publish (struct duplex *d, struct duplex_flow *f)
+{
+	at_data_session_t *s = d->ctx->session;
+	int canc = at_cancel_disable ();
+
+	pthread_mutex_lock (&d->lock);
+	s->dir[f->dir] = f->stats;
+	if (f->dir == 0)
+	{
+		s->polls = d->polls;
+		at_data_tick (d->ctx, f->now);
+	}
+	pthread_mutex_unlock (&d->lock);
+	at_cancel_enable (canc);
+	f->flushed = f->now;
+}
+
+/** Reads a chunk of data from the source of a direction. */
+static ssize_t duplex_read (struct duplex_flow *f, size_t mtu)
+{
+	ssize_t val = read (f->in, f->buf, mtu);
+	uint64_t now = at_data_timestamp (CLOCK_MONOTONIC);
+
+	f->stats.reads++;
+	f->stats.idle += now - f->now;
+	f->now = now;
+	return val;
+}
+
+/**
+ * Writes a chunk of data to the sink of a direction, blocking until it is
+ * entirely written.
+ * @return 0 on success, -1 on error.
+ */
+static int duplex_write (struct duplex_flow *f, size_t len)
+{
+	for (size_t offset = 0; offset < len;)
+	{
+		ssize_t val = write (f->out, f->buf + offset, len - offset);
+
+		f->stats.writes++;
+		if (val == -1)
+		{
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		offset += val;
+		f->stats.bytes += val;
+	}
+
+	uint64_t now = at_data_timestamp (CLOCK_MONOTONIC);
+
+	/* Reading is stalled until the write completes */
+	f->stats.congest += now - f->now;
+	at_data_latency (&f->stats, now - f->now);
+	f->now = now;
+	return 0;
+}
+
+/**
+ * Forwards data from the DCE to the DTE, until end of stream or error, or
+ * until the thread is cancelled.
+ */
+static void *duplex_thread (void *data)
+{
+	struct duplex *d = data;
+	struct duplex_flow *f = d->flows + 1;
+	size_t mtu = d->ctx->mtu;
+
+	for (;;)
+	{
+		ssize_t val = duplex_read (f, mtu);
+		if (val == -1)
+		{
+			if (errno == EINTR)
+				continue;
+			warning ("DCE data read error (%m)");
+			break;
+		}
+		if (val == 0)
+		{
+			notice ("DCE data stream end");
+			break;
+		}
+		if (duplex_write (f, val))
+		{
+			warning ("DTE data write error (%m)");
+			break;
+		}
+		if ((f->now - f->flushed) >= UINT64_C(1000000000))
+			duplex_publish (d, f);
+	}
+
+	/* Wake the DTE to DCE direction up */
+	while (write (d->wake[1], "", 1) == -1 && errno == EINTR);
+	return NULL;
+}
+
+static void cleanup_duplex (void *data)
+{
+	struct duplex *d = data;
+	at_data_session_t *s = d->ctx->session;
+	int canc = at_cancel_disable ();
+
+	pthread_cancel (d->worker);
+	pthread_join (d->worker, NULL);
+	at_cancel_enable (canc);
+
+	for (int i = 0; i < 2; i++)
+	{
+		s->dir[i] = d->flows[i].stats;
+		free (d->flows[i].buf);
+	}
+	s->polls = d->polls;
+
+	at_data_unblock (d->ctx, d->flags);
+	close (d->wake[1]);
+	close (d->wake[0]);
+	pthread_mutex_destroy (&d->lock);
+}
+
+int at_data_duplex (at_data_ctx_t *ctx)
+{
+	struct duplex d;
+	uint64_t now = at_data_timestamp (CLOCK_MONOTONIC);
+
+	d.ctx = ctx;
+	d.polls = 0;
+	for (unsigned i = 0; i < 2; i++)
+	{
+		struct duplex_flow *f = d.flows + i;
+
+		f->dir = i;
+		f->buf = malloc (ctx->mtu);
+		f->now = now;
+		f->flushed = now;
+		memset (&f->stats, 0, sizeof (f->stats));
+	}
+	d.flows[0].in = ctx->dte_in;
+	d.flows[0].out = ctx->dce;
+	d.flows[1].in = ctx->dce;
+	d.flows[1].out = ctx->dte_out;
+
+	if (d.flows[0].buf == NULL || d.flows[1].buf == NULL)
+		goto error;
+	if (pipe2 (d.wake, O_CLOEXEC))
+		goto error;
+
+	pthread_mutex_init (&d.lock, NULL);
+	at_data_block (ctx, d.flags);
+	if (at_thread_create (&d.worker, duplex_thread, &d))
+	{
+		warning ("Cannot create data thread (%m)");
+		at_data_unblock (ctx, d.flags);
+		pthread_mutex_destroy (&d.lock);
+		close (d.wake[1]);
+		close (d.wake[0]);
+		goto error;
+	}
+
+	debug ("Using full-duplex data engine");
+	pthread_cleanup_push (cleanup_duplex, &d);
+
+	struct duplex_flow *f = d.flows;
+	struct pollfd ufd[2] = {
+		{ .fd = ctx->dte_in, .events = POLLIN },
+		{ .fd = d.wake[0], .events = POLLIN },
+	};
+	/* Refresh the statistics file every second */
+	int timeout = (ctx->dump.path != NULL) ? 1000 : -1;
+
+	for (;;)
+	{
+		/* Only wait for the DTE here, so that the +++ escape sequence and
+		 * the end of the other direction can be seen. */
+		if (poll (ufd, 2, timeout) < 0)
+		{
+			d.polls++;
+			continue;
+		}
+		d.polls++;
+
+		if (ufd[1].revents)
+			break; /* the DCE to DTE direction is over */
+
+		if (ufd[0].revents)
+		{
+			ssize_t val = duplex_read (f, ctx->mtu);
+			if (val == -1)
+			{
+				if (errno == EINTR || errno == EAGAIN)
+					continue;
+				warning ("DTE data read error (%m)");
+				break;
+			}
+			if (val == 0)
+			{
+				notice ("DTE data stream end");
+				break;
+			}
+
+			/* +++ escape handling */
+			if ((f->now - ctx->last_rx) >= AT_DATA_GUARD_TIME
+			 && val == 3 && !memcmp (f->buf, "+++", 3))
+			{
+				debug ("Caught +++ escape sequence");
+				break;
+			}
+			ctx->last_rx = f->now;
+
+			if (duplex_write (f, val))
+			{
+				warning ("DCE data write error (%m)");
+				break;
+			}
+		}
+		else
+		{
+			uint64_t now = at_data_timestamp (CLOCK_MONOTONIC);
+
+			f->stats.idle += now - f->now;
+			f->now = now;
+		}
+
+		if ((f->now - f->flushed) >= UINT64_C(1000000000))
+			duplex_publish (&d, f);
+	}
+
+	pthread_cleanup_pop (1);
+	return 0;
+
+error:
+	free (d.flows[1].buf);
+	free (d.flows[0].buf);
+	return -1;
+}
@@ -0,0 +1,269 @@
+/**
+ * @file format.c
+ * @brief Locale-independent output formatting
+ * @ingroup internal
+ */
+
+/* ***** BEGIN LICENSE BLOCK *****
+ * Version: MPL 1.1/GPL 2.0/LGPL 2.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is matd.
+ *
+ * The Initial Developer of the Original Code is
+ * remi.denis-courmont@nokia.com.
+ * Portions created by the Initial Developer are
+ * Copyright (C) 2012 Nokia Corporation and/or its subsidiary(-ies).
+ * All Rights Reserved.
+ *
+ * Contributor(s):
+ *
+ * Alternatively, the contents of this file may be used under the terms of
+ * either the GNU General Public License Version 2 or later (the "GPL"), or
+ * the GNU Lesser General Public License Version 2.1 or later (the "LGPL"),
+ * in which case the provisions of the GPL or the LGPL are applicable instead
+ * of those above. If you wish to allow use of your version of this file only
+ * under the terms of either the GPL or the LGPL, and not to allow others to
+ * use your version of this file under the terms of the MPL, indicate your
+ * decision by deleting the provisions above and replace them with the notice
+ * and other provisions required by the GPL or the LGPL. If you do not delete
+ * the provisions above, a recipient may use your version of this file under
+ * the terms of any one of the MPL, the GPL or the LGPL.
+ *
+ * ***** END LICENSE BLOCK ***** */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/types.h>
+
+#include "format.h"
+
+/** Integer argument sizes */
+enum
+{
+	AT_FMT_INT,
+	AT_FMT_CHAR,
+	AT_FMT_SHORT,
+	AT_FMT_LONG,
+	AT_FMT_LLONG,
+	AT_FMT_SIZE,
+	AT_FMT_MAX,
+};
+
+static intmax_t at_arg_signed (va_list *ap, unsigned size)
+{
+	switch (size)
+	{
+		case AT_FMT_CHAR:	return (signed char)va_arg (*ap, int);
+		case AT_FMT_SHORT:	return (short)va_arg (*ap, int);
+		case AT_FMT_LONG:	return va_arg (*ap, long);
+		case AT_FMT_LLONG:	return va_arg (*ap, long long);
+		case AT_FMT_SIZE:	return va_arg (*ap, ssize_t);
+		case AT_FMT_MAX:	return va_arg (*ap, intmax_t);
+	}
+	return va_arg (*ap, int);
+}
+
+static uintmax_t at_arg_unsigned (va_list *ap, unsigned size)
+{
+	switch (size)
+	{
+		case AT_FMT_CHAR:	return (unsigned char)va_arg (*ap, unsigned);
+		case AT_FMT_SHORT:	return (unsigned short)va_arg (*ap, unsigned);
+		case AT_FMT_LONG:	return va_arg (*ap, unsigned long);
+		case AT_FMT_LLONG:	return va_arg (*ap, unsigned long long);
+		case AT_FMT_SIZE:	return va_arg (*ap, size_t);
+		case AT_FMT_MAX:	return va_arg (*ap, uintmax_t);
+	}
+	return va_arg (*ap, unsigned);
+}
+
+int at_vformat (char *buf, size_t size, const char *fmt, va_list ap)
+{
+	size_t len = 0;
+	va_list aq;
+
+	/* va_list may be an array type: work on a copy to pass it around */
+	va_copy (aq, ap);
+#define PUT(c) \
+	do { if (len < size) buf[len] = (c); len++; } while (0)
+
+	for (const char *p = fmt; *p; p++)
+	{
+		if (*p != '%')
+		{
+			PUT (*p);
+			continue;
+		}
+		p++;
+
+		/* Flags and field width */
+		bool left = false, zero = false;
+		unsigned width = 0;
+		int prec = -1;
+
+		for (;; p++)
+			if (*p == '-')
+				left = true;
+			else if (*p == '0')
+				zero = true;
+			else
+				break;
+
+		if (*p == '*')
+		{
+			int w = va_arg (aq, int);
+			if (w < 0)
+			{
+				left = true;
+				w = -w;
+			}
+			width = w;
+			p++;
+		}
+		else
+			while (*p >= '0' && *p <= '9')
+				width = width * 10 + (*(p++) - '0');
+
+		if (*p == '.')
+		{
+			p++;
+			if (*p == '*')
+			{
+				prec = va_arg (aq, int);
+				p++;
+			}
+			else
+				for (prec = 0; *p >= '0' && *p <= '9'; p++)
+					prec = prec * 10 + (*p - '0');
+		}
+
+		/* Length modifier */
+		unsigned isize = AT_FMT_INT;
+
+		switch (*p)
+		{
+			case 'h':
+				isize = (p[1] == 'h') ? AT_FMT_CHAR : AT_FMT_SHORT;
+				p += (p[1] == 'h') ? 2 : 1;
+				break;
+			case 'l':
+				isize = (p[1] == 'l') ? AT_FMT_LLONG : AT_FMT_LONG;
+				p += (p[1] == 'l') ? 2 : 1;
+				break;
+			case 'z':
+				isize = AT_FMT_SIZE;
+				p++;
+				break;
+			case 'j':
+				isize = AT_FMT_MAX;
+				p++;
+				break;
+		}
+
+		/* Conversion */
+		char tmp[3 * sizeof (uintmax_t)], *end = tmp + sizeof (tmp);
+		const char *s = end;
+		size_t n;
+		bool neg = false;
+
+		switch (*p)
+		{
+			case '%':
+			case 'c':
+				*--end = (*p == '%') ? '%' : va_arg (aq, int);
+				s = end;
+				n = 1;
+				zero = false;
+				break;
+
+			case 's':
+				s = va_arg (aq, const char *);
+				if (s == NULL)
+					s = "(null)";
+				n = (prec >= 0) ? strnlen (s, prec) : strlen (s);
+				zero = false;
+				break;
+
+			case 'd':
+			case 'i':
+			case 'u':
+			case 'x':
+			case 'X':
+			{
+				if (prec >= 0)
+					goto unsupported;
+
+				uintmax_t v;
+				unsigned base = 10;
+				const char *digits = "0123456789abcdef";
+
+				if (*p == 'd' || *p == 'i')
+				{
+					intmax_t sv = at_arg_signed (&aq, isize);
+
+					neg = sv < 0;
+					v = neg ? -(uintmax_t)sv : (uintmax_t)sv;
+				}
+				else
+				{
+					v = at_arg_unsigned (&aq, isize);
+					if (*p != 'u')
+						base = 16;
+					if (*p == 'X')
+						digits = "0123456789ABCDEF";
+				}
+
+				do
+				{
+					*--end = digits[v % base];
+					v /= base;
+				}
+				while (v > 0);
+				s = end;
+				n = tmp + sizeof (tmp) - end;
+				break;
+			}
+
+			default:
+				goto unsupported;
+		}
+
+		size_t pad = neg + n;
+		pad = (width > pad) ? width - pad : 0;
+
+		if (!left && !zero)
+			for (; pad > 0; pad--)
+				PUT (' ');
+		if (neg)
+			PUT ('-');
+		if (!left)
+			for (; pad > 0; pad--)
+				PUT ('0');
+		for (size_t i = 0; i < n; i++)
+			PUT (s[i]);
+		for (; pad > 0; pad--)
+			PUT (' ');
+	}
+#undef PUT
+	va_end (aq);
+	return len;
+
+unsupported:
+	va_end (aq);
+	return -1;
+}
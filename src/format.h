@@ -0,0 +1,65 @@
+/**
+ * @file format.h
+ * @brief Internal header for locale-independent output formatting
+ * @ingroup internal
+ */
+
+/* ***** BEGIN LICENSE BLOCK *****
+ * Version: MPL 1.1/GPL 2.0/LGPL 2.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is matd.
+ *
+ * The Initial Developer of the Original Code is
+ * remi.denis-courmont@nokia.com.
+ * Portions created by the Initial Developer are
+ * Copyright (C) 2012 Nokia Corporation and/or its subsidiary(-ies).
+ * All Rights Reserved.
+ *
+ * Contributor(s):
+ *
+ * Alternatively, the contents of this file may be used under the terms of
+ * either the GNU General Public License Version 2 or later (the "GPL"), or
+ * the GNU Lesser General Public License Version 2.1 or later (the "LGPL"),
+ * in which case the provisions of the GPL or the LGPL are applicable instead
+ * of those above. If you wish to allow use of your version of this file only
+ * under the terms of either the GPL or the LGPL, and not to allow others to
+ * use your version of this file under the terms of the MPL, indicate your
+ * decision by deleting the provisions above and replace them with the notice
+ * and other provisions required by the GPL or the LGPL. If you do not delete
+ * the provisions above, a recipient may use your version of this file under
+ * the terms of any one of the MPL, the GPL or the LGPL.
+ *
+ * ***** END LICENSE BLOCK ***** */
+
+#ifndef AT_FORMAT_H
+# define AT_FORMAT_H 1
+
+# include <stdarg.h>
+# include <stddef.h>
+
+/**
+ * Formats a string without heap allocation and regardless of the locale.
+ * Only the flags -, 0, width and precision (including *), the length
+ * modifiers hh, h, l, ll, z and j and the conversions d, i, u, x, X, c, s
+ * and % are supported; integer precision is not.
+ * Like vsnprintf(), output is truncated to the buffer size, but unlike it,
+ * no nul terminator is appended.
+ * @param buf output buffer
+ * @param size output buffer byte size
+ * @param ap format arguments (not consumed: they can be used again)
+ * @return the length of the complete output (which does not fit in the
+ * buffer if it is larger than size), or -1 if the format is not supported.
+ */
+int at_vformat (char *buf, size_t size, const char *fmt, va_list ap);
+
+#endif
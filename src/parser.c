@@ -45,12 +45,18 @@
 #endif
 
 #include <stddef.h>
+#include <limits.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
 #include <ctype.h>
 #include <assert.h>
 
+#if defined (__SSE2__)
+# include <emmintrin.h>
+#endif
+
+#include <at_command.h>
 #include "parser.h"
 #include <at_log.h>
 
@@ -83,92 +89,218 @@ void at_parser_init (at_parser_t *p)
 {
 	p->length = 0;
 	p->oldlength = 0;
+	p->buf = p->lines[0];
+	p->old = p->lines[1];
 }
 
 /**
- * Pushes a byte to the AT command line parser.
- *
- * @param p parser as created by at_parser_create()
- * @param c character to push to the parser
- * @param plen pointer to the byte length of the command line [OUT]
- * @return NULL if no command pending, otherwise a nul-terminated AT command
- * len of *plen bytes.
+ * Computes the length of the initial span of "plain" characters, i.e.
+ * printable 7-bits characters other than forward slash. Those are simply
+ * appended to the command line. Anything else needs special treatment.
  */
-char *at_parser_push (at_parser_t *restrict p, unsigned char c,
-                            size_t *restrict plen)
+static size_t at_span_plain (const unsigned char *buf, size_t len)
 {
-	/* Quite confusing. The ITU-T Recommendation V.250 § 5.1 says:
-	 *  "Only the low-order seven bits each character are significant to
-	 *   the DCE; any eighth or higher-order bit(s), if present, are ignored
-	 *   for the purpose of identifying commands and parameters."
-	 * But 3GPP 27.007 version 9.2, AT+CSCS says:
-	 *  "This character set [UTF-8] requires an 8-bit TA-TE interface."
-	 * (and so do ISO-8859 and IBM PC code pages though not stated).
-	 * So we will assume that the higher order bit is ignored in AT commands,
-	 * but not necessarily in responses (from DCE), nor in text entry mode
-	 * (at_getline()), and obviously not in data mode (PPP).
-	 */
-	c &= 0x7f; /* Ignore high-order bit */
-
-	/* HACK: handle Delete the same way as Backspace. */
-	if (c == 127)
-		c = S5;
-
-	/* HACK: treat Line Feed as Carriage Return
-	 * (work around many broken DTE implementations) */
-	if (c == S4)
-		c = S3;
-
-	/* Handle backspace */
-	if (c == S5)
+	size_t n = 0;
+
+#if defined (__SSE2__)
+	const __m128i lo = _mm_set1_epi8 (31), hi = _mm_set1_epi8 (127);
+	const __m128i slash = _mm_set1_epi8 ('/');
+
+	while (len - n >= 16)
 	{
-		if (p->length > 0)
-			p->length--;
-		return NULL;
+		/* Signed comparisons: bytes with the high bit set are negative */
+		__m128i v = _mm_loadu_si128 ((const __m128i *)(buf + n));
+		__m128i ok = _mm_and_si128 (_mm_cmpgt_epi8 (v, lo),
+		                            _mm_cmplt_epi8 (v, hi));
+		ok = _mm_andnot_si128 (_mm_cmpeq_epi8 (v, slash), ok);
+
+		unsigned mask = ~_mm_movemask_epi8 (ok) & 0xffff;
+		if (mask)
+			return n + __builtin_ctz (mask);
+		n += 16;
 	}
+#else
+	/* One machine word at a time, see "Bit Twiddling Hacks" */
+	const size_t ones = ((size_t)-1) / 255, highs = ones * 0x80;
 
-	/* Repeat previous command with just A and forward slash */
-	if (c == '/' && p->length >= 1
-	 && (p->buf[p->length - 1] == 'A' || p->buf[p->length - 1] == 'a'))
+	while (len - n >= sizeof (size_t))
 	{
-		p->length = 0;
-		if (p->oldlength == 0)
-			return NULL; /* no previous command! */
-		*plen = p->oldlength;
-		return p->old;
+		size_t x, slashes;
+
+		memcpy (&x, buf + n, sizeof (x));
+		slashes = x ^ (ones * '/');
+		if (((x - ones * 32) & ~x & highs) /* less than 32 */
+		 || (((x + ones) | x) & highs) /* more than 126 */
+		 || ((slashes - ones) & ~slashes & highs)) /* slash */
+			break;
+		n += sizeof (size_t);
 	}
+#endif
+	while (n < len && buf[n] >= 32 && buf[n] < 127 && buf[n] != '/')
+		n++;
+	return n;
+}
 
-	if (c != S3)
+/**
+ * Computes the length of the initial span of text entry input without any
+ * control character or Delete. Those need to be checked for Backspace,
+ * Carriage Return, Ctrl+Z or ESC; anything else is text.
+ */
+size_t at_span_text (const unsigned char *buf, size_t len)
+{
+	size_t n = 0;
+
+#if defined (__SSE2__)
+	const __m128i ctrl = _mm_set1_epi8 (31), del = _mm_set1_epi8 (127);
+
+	while (len - n >= 16)
 	{
-		/* Ignore control characters (V.250 §5.2.2) */
-		if (c < 32)
-			return NULL;
-
-		if (p->length < sizeof (p->buf))
-			p->buf[p->length] = c;
-		p->length++;
-		return NULL; /* not a new line -> need more data */
+		__m128i v = _mm_loadu_si128 ((const __m128i *)(buf + n));
+		/* Unsigned v <= 31 if and only if min (v, 31) == v */
+		__m128i stop = _mm_or_si128 (
+			_mm_cmpeq_epi8 (_mm_min_epu8 (v, ctrl), v),
+			_mm_cmpeq_epi8 (v, del));
+
+		unsigned mask = _mm_movemask_epi8 (stop);
+		if (mask)
+			return n + __builtin_ctz (mask);
+		n += 16;
 	}
+#else
+	const size_t ones = ((size_t)-1) / 255, highs = ones * 0x80;
 
-	/* Execute complete command line! */
-	if (p->length >= sizeof (p->buf)) // overflow
+	while (len - n >= sizeof (size_t))
 	{
-		error ("AT command line too long");
-		p->oldlength = 0;
-		p->length = 0;
-		return NULL; // Uho! fail silent!
+		size_t x, dels;
+
+		memcpy (&x, buf + n, sizeof (x));
+		dels = x ^ (ones * 127);
+		if (((x - ones * 32) & ~x & highs) /* less than 32 */
+		 || ((dels - ones) & ~dels & highs)) /* Delete */
+			break;
+		n += sizeof (size_t);
 	}
+#endif
+	while (n < len && buf[n] >= 32 && buf[n] != 127)
+		n++;
+	return n;
+}
 
-	p->buf[p->length] = '\0';
-	*plen = p->length;
+/**
+ * Pushes bytes to the AT command line parser, up to the end of the first
+ * complete command line (if any).
+ *
+ * @param p parser as initialized by at_parser_init()
+ * @param buf bytes to push to the parser
+ * @param pcount pointer to the number of bytes available [IN]
+ *               and the number of bytes consumed [OUT]
+ * @param plen pointer to the byte length of the command line [OUT]
+ * @return NULL if no command pending, otherwise a nul-terminated AT command
+ * len of *plen bytes. It remains valid until the next call.
+ */
+char *at_parser_scan (at_parser_t *restrict p,
+                      const unsigned char *restrict buf,
+                      size_t *restrict pcount, size_t *restrict plen)
+{
+	const unsigned char *s = buf, *end = buf + *pcount;
+	char *ret = NULL;
 
-	char *ret = at_find_prefix (p->buf, plen);
-	if (ret != NULL)
+	while (s < end)
 	{
-		memcpy (p->old, ret, *plen + 1);
-		p->oldlength = *plen;
+		/* Fast path: append ordinary characters in bulk */
+		size_t n = at_span_plain (s, end - s);
+		if (n > 0)
+		{
+			if (p->length < AT_MAXLINE)
+			{
+				size_t room = AT_MAXLINE - p->length;
+
+				memcpy (p->buf + p->length, s, (n < room) ? n : room);
+			}
+			p->length += n;
+			s += n;
+			continue;
+		}
+
+		/* Quite confusing. The ITU-T Recommendation V.250 § 5.1 says:
+		 *  "Only the low-order seven bits each character are significant
+		 *   to the DCE; any eighth or higher-order bit(s), if present, are
+		 *   ignored for the purpose of identifying commands and
+		 *   parameters."
+		 * But 3GPP 27.007 version 9.2, AT+CSCS says:
+		 *  "This character set [UTF-8] requires an 8-bit TA-TE interface."
+		 * (and so do ISO-8859 and IBM PC code pages though not stated).
+		 * So we will assume that the higher order bit is ignored in AT
+		 * commands, but not necessarily in responses (from DCE), nor in text
+		 * entry mode (at_getline()), and obviously not in data mode (PPP).
+		 */
+		unsigned char c = *(s++) & 0x7f; /* Ignore high-order bit */
+
+		/* HACK: handle Delete the same way as Backspace. */
+		if (c == 127)
+			c = S5;
+
+		/* HACK: treat Line Feed as Carriage Return
+		 * (work around many broken DTE implementations) */
+		if (c == S4)
+			c = S3;
+
+		/* Handle backspace */
+		if (c == S5)
+		{
+			if (p->length > 0)
+				p->length--;
+			continue;
+		}
+
+		/* Repeat previous command with just A and forward slash */
+		if (c == '/' && p->length >= 1 && p->length <= AT_MAXLINE
+		 && (p->buf[p->length - 1] == 'A' || p->buf[p->length - 1] == 'a'))
+		{
+			p->length = 0;
+			if (p->oldlength == 0)
+				continue; /* no previous command! */
+			*plen = p->oldlength;
+			ret = p->old;
+			break;
+		}
+
+		if (c != S3)
+		{
+			/* Ignore control characters (V.250 §5.2.2) */
+			if (c < 32)
+				continue;
+
+			if (p->length < AT_MAXLINE)
+				p->buf[p->length] = c;
+			p->length++;
+			continue; /* not a new line -> need more data */
+		}
+
+		/* Execute complete command line! */
+		if (p->length >= AT_MAXLINE) // overflow
+		{
+			error ("AT command line too long");
+			p->oldlength = 0;
+			p->length = 0;
+			continue; // Uho! fail silent!
+		}
+
+		p->buf[p->length] = '\0';
+		*plen = p->length;
+		p->length = 0;
+
+		ret = at_find_prefix (p->buf, plen);
+		if (ret != NULL)
+		{	/* Keep the line for A/, receive the next one in the other buffer */
+			p->buf = (p->buf == p->lines[0]) ? p->lines[1] : p->lines[0];
+			p->old = ret;
+			p->oldlength = *plen;
+			break;
+		}
 	}
-	p->length = 0;
+
+	*pcount = s - buf;
 	return ret;
 }
 
@@ -317,3 +449,98 @@ char *at_iterate_next (char **restrict bufp,
 
 	return l ? buf : NULL;
 }
+
+
+/*** Parameters ***/
+
+static const char *skip_blanks (const char *str)
+{
+	while (*str == ' ')
+		str++;
+	return str;
+}
+
+/**
+ * Parses a decimal numeric constant.
+ * @return true if the whole parameter is a number that fits.
+ */
+static bool parse_number (const char *str, size_t len, unsigned *pnum)
+{
+	unsigned num = 0;
+
+	for (size_t i = 0; i < len; i++)
+	{
+		unsigned d = str[i] - '0';
+
+		if (d >= 10 || num > (UINT_MAX - d) / 10)
+			return false;
+		num = num * 10 + d;
+	}
+	*pnum = num;
+	return true;
+}
+
+int at_tokenize (const char *str, at_param_t *params, unsigned max)
+{
+	unsigned n = 0;
+
+	str = skip_blanks (str);
+	if (*str == '\0')
+		return 0;
+
+	for (;;)
+	{
+		if (n >= max)
+			return -1;
+
+		at_param_t *p = params + n++;
+
+		str = skip_blanks (str);
+		p->number = 0;
+		if (*str == '"')
+		{
+			const char *end = strchr (++str, '"');
+			if (end == NULL)
+				return -1; /* unterminated string */
+
+			p->type = AT_PARAM_STRING;
+			p->str = str;
+			p->len = end - str;
+			str = skip_blanks (end + 1);
+		}
+		else
+		{
+			size_t len = strcspn (str, ",");
+
+			p->str = str;
+			str += len;
+			while (len > 0 && str[-1] == ' ')
+				len--; /* trailing blanks */
+			p->len = len;
+
+			if (len == 0)
+				p->type = AT_PARAM_OMITTED;
+			else
+			if (parse_number (p->str, len, &p->number))
+				p->type = AT_PARAM_NUMBER;
+			else
+				p->type = AT_PARAM_TOKEN;
+		}
+
+		if (*str == '\0')
+			return n;
+		if (*str != ',')
+			return -1; /* junk after a string */
+		str++;
+	}
+}
+
+char *at_param_copy (const at_param_t *p, char *buf, size_t size)
+{
+	if (p->type == AT_PARAM_NUMBER || p->len >= size)
+		return NULL;
+
+	memcpy (buf, p->str, p->len);
+	buf[p->len] = '\0';
+	return buf;
+}
@@ -51,12 +51,16 @@ typedef struct at_parser at_parser_t;
 struct at_parser
 {
 	size_t length, oldlength;
-	char buf[AT_MAXLINE];
-	char old[AT_MAXLINE];
+	char *buf; /**< Command line being received (in lines) */
+	char *old; /**< Previous command line for A/ (in lines) */
+	char lines[2][AT_MAXLINE];
 };
 
 void at_parser_init (at_parser_t *);
-char *at_parser_push (at_parser_t *, unsigned char, size_t *);
+char *at_parser_scan (at_parser_t *, const unsigned char *, size_t *,
+                      size_t *);
+
+size_t at_span_text (const unsigned char *, size_t);
 
 char *at_iterate_first (char **, size_t *, size_t *);
 char *at_iterate_next (char **, size_t *, size_t *);
@@ -0,0 +1,386 @@
+/**
+ * @file perf.c
+ * @brief AT commands execution statistics
+ * @ingroup internal
+ */
+
+/* ***** BEGIN LICENSE BLOCK *****
+ * Version: MPL 1.1/GPL 2.0/LGPL 2.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is matd.
+ *
+ * The Initial Developer of the Original Code is
+ * remi.denis-courmont@nokia.com.
+ * Portions created by the Initial Developer are
+ * Copyright (C) 2012 Nokia Corporation and/or its subsidiary(-ies).
+ * All Rights Reserved.
+ *
+ * Contributor(s):
+ *
+ * Alternatively, the contents of this file may be used under the terms of
+ * either the GNU General Public License Version 2 or later (the "GPL"), or
+ * the GNU Lesser General Public License Version 2.1 or later (the "LGPL"),
+ * in which case the provisions of the GPL or the LGPL are applicable instead
+ * of those above. If you wish to allow use of your version of this file only
+ * under the terms of either the GPL or the LGPL, and not to allow others to
+ * use your version of this file under the terms of the MPL, indicate your
+ * decision by deleting the provisions above and replace them with the notice
+ * and other provisions required by the GPL or the LGPL. If you do not delete
+ * the provisions above, a recipient may use your version of this file under
+ * the terms of any one of the MPL, the GPL or the LGPL.
+ *
+ * ***** END LICENSE BLOCK ***** */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <stdbool.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include <at_command.h>
+#include <at_modem.h>
+#include <at_log.h>
+#include "commands.h"
+#include "perf.h"
+
+/** Number of distinct commands with statistics (must be a power of two) */
+#define AT_PERF_MAX 256
+
+/** Number of distinct results counted per command (must be a power of two) */
+#define AT_PERF_RESULTS 16
+
+/** Count of one command result */
+typedef struct at_perf_result
+{
+	unsigned code; /**< at_error_t value plus one, or zero if free */
+	uint64_t count;
+} at_perf_result_t;
+
+/** Statistics of one command, shared by all AT modems of the process */
+typedef struct at_perf_entry
+{
+	unsigned used; /**< whether the entry is allocated (set once) */
+	char name[AT_NAME_MAX];
+	uint64_t calls;
+	uint64_t total; /**< nanoseconds */
+	uint64_t max; /**< nanoseconds */
+	/** Results by at_error_t value (open addressing), and the count of
+	 * results that did not fit */
+	at_perf_result_t results[AT_PERF_RESULTS];
+	uint64_t other;
+	/** Latency histogram: bucket k counts the commands that took 2^k to
+	 * 2^(k+1) microseconds (the last bucket is open) */
+	uint64_t latency[AT_PERF_HIST];
+	/** Superseded unsolicited state reports (not delivered) */
+	uint64_t coalesced;
+} at_perf_entry_t;
+
+unsigned at_perf_mode = 0;
+static at_perf_entry_t entries[AT_PERF_MAX];
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * Finds or allocates the statistics entry for a command. Entries are never
+ * freed, so look-ups do not need the lock.
+ */
+static at_perf_entry_t *at_perf_lookup (const char *name)
+{
+	unsigned hash = 2166136261u;
+
+	for (const char *p = name; *p; p++)
+		hash = (hash ^ (unsigned char)*p) * 16777619u;
+
+	for (unsigned i = 0; i < AT_PERF_MAX; i++)
+	{
+		at_perf_entry_t *e = entries + ((hash + i) % AT_PERF_MAX);
+
+		if (!__atomic_load_n (&e->used, __ATOMIC_ACQUIRE))
+		{
+			pthread_mutex_lock (&lock);
+			if (!e->used)
+			{
+				strcpy (e->name, name);
+				__atomic_store_n (&e->used, 1, __ATOMIC_RELEASE);
+			}
+			pthread_mutex_unlock (&lock);
+		}
+		if (!strcmp (e->name, name))
+			return e;
+	}
+	return NULL; /* table full */
+}
+
+static void at_perf_add (uint64_t *counter, uint64_t value)
+{
+	__atomic_fetch_add (counter, value, __ATOMIC_RELAXED);
+}
+
+/**
+ * Finds or allocates the counter for a result of a command.
+ * @return the counter, or the overflow counter if the table is full.
+ */
+static uint64_t *at_perf_result (at_perf_entry_t *e, at_error_t res)
+{
+	unsigned code = res + 1;
+
+	for (unsigned i = 0; i < AT_PERF_RESULTS; i++)
+	{
+		at_perf_result_t *r = e->results + ((res + i) % AT_PERF_RESULTS);
+		unsigned cur = __atomic_load_n (&r->code, __ATOMIC_ACQUIRE);
+
+		if (cur == 0)
+		{
+			__atomic_compare_exchange_n (&r->code, &cur, code, false,
+			                             __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+			if (cur == 0)
+				return &r->count; /* allocated */
+		}
+		if (cur == code)
+			return &r->count;
+	}
+	return &e->other;
+}
+
+void at_perf_record (const char *name, at_error_t res, uint64_t ns)
+{
+	at_perf_entry_t *e = at_perf_lookup (name);
+	if (e == NULL)
+		return;
+
+	uint64_t us = ns / 1000;
+	unsigned k = 0;
+
+	while ((us >>= 1) > 0 && k < (AT_PERF_HIST - 1))
+		k++;
+
+	at_perf_add (&e->calls, 1);
+	at_perf_add (&e->total, ns);
+	at_perf_add (at_perf_result (e, res), 1);
+	at_perf_add (e->latency + k, 1);
+
+	uint64_t max = __atomic_load_n (&e->max, __ATOMIC_RELAXED);
+	while (ns > max
+	    && !__atomic_compare_exchange_n (&e->max, &max, ns, true,
+	                                     __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+}
+
+void at_perf_coalesced (const char *name)
+{
+	at_perf_entry_t *e = at_perf_lookup (name);
+	if (e != NULL)
+		at_perf_add (&e->coalesced, 1);
+}
+
+/** Clears all statistics (but keeps the entries allocated). */
+static void at_perf_reset (void)
+{
+	for (unsigned i = 0; i < AT_PERF_MAX; i++)
+	{
+		at_perf_entry_t *e = entries + i;
+
+		__atomic_store_n (&e->calls, 0, __ATOMIC_RELAXED);
+		__atomic_store_n (&e->total, 0, __ATOMIC_RELAXED);
+		__atomic_store_n (&e->max, 0, __ATOMIC_RELAXED);
+		__atomic_store_n (&e->coalesced, 0, __ATOMIC_RELAXED);
+		__atomic_store_n (&e->other, 0, __ATOMIC_RELAXED);
+		for (unsigned r = 0; r < AT_PERF_RESULTS; r++)
+			__atomic_store_n (&e->results[r].count, 0, __ATOMIC_RELAXED);
+		for (unsigned k = 0; k < AT_PERF_HIST; k++)
+			__atomic_store_n (e->latency + k, 0, __ATOMIC_RELAXED);
+	}
+}
+
+/** Takes a consistent enough copy of an entry, if it has any data. */
+static bool at_perf_read (unsigned i, at_perf_entry_t *e)
+{
+	const at_perf_entry_t *src = entries + i;
+
+	if (!__atomic_load_n (&src->used, __ATOMIC_ACQUIRE))
+		return false;
+
+	e->calls = __atomic_load_n (&src->calls, __ATOMIC_RELAXED);
+	e->coalesced = __atomic_load_n (&src->coalesced, __ATOMIC_RELAXED);
+	if (e->calls == 0 && e->coalesced == 0)
+		return false;
+
+	strcpy (e->name, src->name);
+	e->total = __atomic_load_n (&src->total, __ATOMIC_RELAXED);
+	e->max = __atomic_load_n (&src->max, __ATOMIC_RELAXED);
+	e->other = __atomic_load_n (&src->other, __ATOMIC_RELAXED);
+	for (unsigned r = 0; r < AT_PERF_RESULTS; r++)
+	{
+		e->results[r].code = __atomic_load_n (&src->results[r].code,
+		                                      __ATOMIC_ACQUIRE);
+		e->results[r].count = __atomic_load_n (&src->results[r].count,
+		                                       __ATOMIC_RELAXED);
+	}
+	for (unsigned k = 0; k < AT_PERF_HIST; k++)
+		e->latency[k] = __atomic_load_n (src->latency + k, __ATOMIC_RELAXED);
+	return true;
+}
+
+void at_log_command_stats (void)
+{
+	unsigned count = 0;
+
+	for (unsigned i = 0; i < AT_PERF_MAX; i++)
+	{
+		at_perf_entry_t e;
+
+		if (!at_perf_read (i, &e))
+			continue;
+		if (e.coalesced > 0)
+			notice ("%s: %"PRIu64" report(s) coalesced", e.name,
+			        e.coalesced);
+		if (e.calls == 0)
+			continue;
+
+		char hist[AT_PERF_HIST * 21], *p = hist;
+		char results[AT_PERF_RESULTS * 32 + 32], *q = results;
+		uint64_t failed = e.other;
+
+		for (unsigned k = 0; k < AT_PERF_HIST; k++)
+			p += sprintf (p, "%s%"PRIu64, k ? "," : "", e.latency[k]);
+		*q = '\0';
+		for (unsigned r = 0; r < AT_PERF_RESULTS; r++)
+		{
+			unsigned code = e.results[r].code;
+
+			if (code == 0 || e.results[r].count == 0)
+				continue;
+			code--;
+			if (code != AT_OK && code != AT_CONNECT)
+				failed += e.results[r].count;
+			q += sprintf (q, " %u:%"PRIu64, code, e.results[r].count);
+		}
+		if (e.other > 0)
+			sprintf (q, " other:%"PRIu64, e.other);
+
+		notice ("AT%s: %"PRIu64" calls, %"PRIu64" failed, "
+		        "%"PRIu64" us average, %"PRIu64" us max, latency %s, "
+		        "results%s", e.name, e.calls, failed,
+		        e.total / e.calls / 1000, e.max / 1000, hist, results);
+		count++;
+	}
+	notice ("Statistics for %u command(s)%s", count,
+	        at_perf_active () ? "" : " (recording disabled)");
+}
+
+
+/*** AT@PERF ***/
+
+/* AT@PERF? lists, for each command:
+ *  @PERF: "<name>",<calls>,<total us>,<max us>
+ *  @PERF: "<name>-results"[,<result>,<count>[...]]
+ *  @PERF: "<name>-latency",<histogram buckets>
+ * where <result> is the at_error_t value: a V.250 numeric result code
+ * (0-8), 256 + a +CME ERROR code, 512 + a +CMS ERROR code, or -1 for other
+ * results if too many distinct ones were seen.
+ *
+ * AT@PERF=0 clears the statistics, whether recording is enabled or not.
+ * AT@PERF=1 clears them and enables recording, AT@PERF=2 disables recording
+ * and keeps them. The first line of AT@PERF? shows whether recording is
+ * enabled (1) or not (0).
+ */
+
+static at_error_t set_perf (at_modem_t *m, const char *req, void *data)
+{
+	unsigned mode;
+
+	if (sscanf (req, " %u", &mode) != 1)
+		return AT_CME_EINVAL;
+
+	switch (mode)
+	{
+		case 0:
+			at_perf_reset ();
+			break;
+		case 1:
+			at_perf_reset ();
+			__atomic_store_n (&at_perf_mode, 1, __ATOMIC_RELAXED);
+			break;
+		case 2:
+			__atomic_store_n (&at_perf_mode, 0, __ATOMIC_RELAXED);
+			break;
+		default:
+			return AT_CME_EINVAL;
+	}
+	(void) m; (void) data;
+	return AT_OK;
+}
+
+static at_error_t get_perf (at_modem_t *m, void *data)
+{
+	at_intermediate (m, "\r\n@PERF: %u",
+	                 __atomic_load_n (&at_perf_mode, __ATOMIC_RELAXED));
+
+	for (unsigned i = 0; i < AT_PERF_MAX; i++)
+	{
+		at_perf_entry_t e;
+
+		if (!at_perf_read (i, &e))
+			continue;
+		if (e.coalesced > 0)
+			at_intermediate (m, "\r\n@PERF: \"%s-coalesced\",%"PRIu64,
+			                 e.name, e.coalesced);
+		if (e.calls == 0)
+			continue;
+
+		at_intermediate (m, "\r\n@PERF: \"%s\",%"PRIu64",%"PRIu64",%"
+		                 PRIu64, e.name, e.calls, e.total / 1000,
+		                 e.max / 1000);
+		at_intermediate (m, "\r\n@PERF: \"%s-results\"", e.name);
+		for (unsigned r = 0; r < AT_PERF_RESULTS; r++)
+			if (e.results[r].code != 0 && e.results[r].count > 0)
+				at_intermediate (m, ",%u,%"PRIu64, e.results[r].code - 1,
+				                 e.results[r].count);
+		if (e.other > 0)
+			at_intermediate (m, ",-1,%"PRIu64, e.other);
+		at_intermediate (m, "\r\n@PERF: \"%s-latency\"", e.name);
+		for (unsigned k = 0; k < AT_PERF_HIST; k++)
+			at_intermediate (m, ",%"PRIu64, e.latency[k]);
+	}
+	(void) data;
+	return AT_OK;
+}
+
+static at_error_t list_perf (at_modem_t *m, void *data)
+{
+	(void) data;
+	return at_intermediate (m, "\r\n@PERF: (0-2)");
+}
+
+const at_command_t at_perf_commands[] = {
+	{ "@PERF", set_perf, get_perf, list_perf, NULL },
+	{ NULL, NULL, NULL, NULL, NULL },
+};
+
+static void at_perf_getenv (void)
+{
+	const char *env = getenv ("AT_PERF");
+
+	if (env != NULL && atoi (env) > 0)
+		at_perf_mode = 1;
+}
+
+void at_perf_init (void)
+{
+	static pthread_once_t once = PTHREAD_ONCE_INIT;
+
+	pthread_once (&once, at_perf_getenv);
+}
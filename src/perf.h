@@ -0,0 +1,83 @@
+/**
+ * @file perf.h
+ * @brief Internal header for AT commands execution statistics
+ * @ingroup internal
+ */
+
+/* ***** BEGIN LICENSE BLOCK *****
+ * Version: MPL 1.1/GPL 2.0/LGPL 2.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is matd.
+ *
+ * The Initial Developer of the Original Code is
+ * remi.denis-courmont@nokia.com.
+ * Portions created by the Initial Developer are
+ * Copyright (C) 2012 Nokia Corporation and/or its subsidiary(-ies).
+ * All Rights Reserved.
+ *
+ * Contributor(s):
+ *
+ * Alternatively, the contents of this file may be used under the terms of
+ * either the GNU General Public License Version 2 or later (the "GPL"), or
+ * the GNU Lesser General Public License Version 2.1 or later (the "LGPL"),
+ * in which case the provisions of the GPL or the LGPL are applicable instead
+ * of those above. If you wish to allow use of your version of this file only
+ * under the terms of either the GPL or the LGPL, and not to allow others to
+ * use your version of this file under the terms of the MPL, indicate your
+ * decision by deleting the provisions above and replace them with the notice
+ * and other provisions required by the GPL or the LGPL. If you do not delete
+ * the provisions above, a recipient may use your version of this file under
+ * the terms of any one of the MPL, the GPL or the LGPL.
+ *
+ * ***** END LICENSE BLOCK ***** */
+
+#ifndef AT_PERF_H
+# define AT_PERF_H 1
+
+# include <stdbool.h>
+# include <stdint.h>
+# include <at_command.h>
+
+/** Number of buckets in command latency histograms */
+# define AT_PERF_HIST 20
+
+/** Whether command statistics are recorded (AT@PERF=1) */
+extern unsigned at_perf_mode;
+
+static inline bool at_perf_active (void)
+{
+	return __atomic_load_n (&at_perf_mode, __ATOMIC_RELAXED) != 0;
+}
+
+/**
+ * Enables command statistics from the start if the AT_PERF environment
+ * variable is set to a positive value.
+ */
+void at_perf_init (void);
+
+/**
+ * Records the execution of an elementary AT command.
+ * @param name command name (without the AT prefix)
+ * @param res command result
+ * @param ns command execution time in nanoseconds
+ */
+void at_perf_record (const char *name, at_error_t res, uint64_t ns);
+
+/**
+ * Counts an unsolicited state report superseded before it was delivered.
+ * This is recorded even if command statistics are not.
+ * @param name state report key
+ */
+void at_perf_coalesced (const char *name);
+
+#endif
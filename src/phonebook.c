@@ -80,17 +80,20 @@ static at_phonebook_t *pb_byname (at_phonebooks_t *pbs, const char *name)
 static at_error_t pb_select (at_modem_t *m, const char *req, void *data)
 {
 	at_phonebooks_t *pbs = data;
+	at_param_t p[2];
 	char storage[3], pw[9];
 
-	switch (sscanf (req, " \"%2[A-Za-z]\" , \"%8[^\"]\"", storage, pw))
-	{
-		case 1:
-			*pw = '\0';
-		case 2:
-			break;
-		default:
-			return AT_CME_EINVAL;
-	}
+	int n = at_tokenize (req, p, 2);
+	if (n < 1 || p[0].type != AT_PARAM_STRING || p[0].len == 0
+	 || at_param_copy (p, storage, sizeof (storage)) == NULL)
+		return AT_CME_EINVAL;
+
+	if (n < 2)
+		*pw = '\0';
+	else
+	if (p[1].type != AT_PARAM_STRING
+	 || at_param_copy (p + 1, pw, sizeof (pw)) == NULL)
+		return AT_CME_EINVAL;
 
 	at_phonebook_t *pb = pb_byname(pbs, storage);
 	if (pb == NULL)
@@ -146,18 +149,23 @@ static at_error_t pb_read (at_modem_t *m, const char *req, void *data)
 {
 	at_phonebooks_t *pbs = data;
 	at_phonebook_t *pb = pbs->active;
-	unsigned start, end;
+	at_param_t p[2];
 
-	switch (sscanf (req, " %u , %u", &start, &end))
+	switch (at_tokenize (req, p, 2))
 	{
 		case 1:
-			end = start;
+			p[1] = p[0];
+			/* fallthrough */
 		case 2:
-			break;
+			if (p[0].type == AT_PARAM_NUMBER && p[1].type == AT_PARAM_NUMBER)
+				break;
+			/* fallthrough */
 		default:
 			return AT_CME_EINVAL;
 	}
 
+	unsigned start = p[0].number, end = p[1].number;
+
 	if (pb->read_cb == NULL)
 		return AT_CME_ENOTSUP;
 
@@ -185,9 +193,11 @@ static at_error_t pb_find (at_modem_t *m, const char *req, void *data)
 {
 	at_phonebooks_t *pbs = data;
 	at_phonebook_t *pb = pbs->active;
+	at_param_t p;
 	char needle[256];
 
-	if (sscanf (req, " \"%255[^\"]\"", needle) != 1)
+	if (at_tokenize (req, &p, 1) != 1 || p.type != AT_PARAM_STRING
+	 || p.len == 0 || at_param_copy (&p, needle, sizeof (needle)) == NULL)
 		return AT_CME_EINVAL;
 
 	if (pb->find_cb == NULL)
@@ -210,63 +220,90 @@ static at_error_t pb_find_test (at_modem_t *m, void *data)
 
 
 /*** AT+CPBW ***/
+enum
+{
+	PBW_INDEX,
+	PBW_NUMBER,
+	PBW_TYPE,
+	PBW_TEXT,
+	PBW_GROUP,
+	PBW_ADNUMBER,
+	PBW_ADTYPE,
+	PBW_ADTEXT,
+	PBW_EMAIL,
+	PBW_SIP,
+	PBW_TEL,
+	PBW_HIDDEN,
+	PBW_MAX
+};
+
+/** AT+CPBW numeric parameters */
+#define PBW_NUMERIC \
+	((1 << PBW_INDEX) | (1 << PBW_TYPE) | (1 << PBW_ADTYPE) | (1 << PBW_HIDDEN))
+
 static at_error_t pb_write (at_modem_t *m, const char *req, void *data)
 {
 	at_phonebooks_t *pbs = data;
 	at_phonebook_t *pb = pbs->active;
-	unsigned idx, type, adtype;
 	at_error_t ret;
-	unsigned char hidden;
-	char number[32], adnumber[32], text[256], group[256], adtext[256];
-	char email[256], sip[256], tel[256];
-
-	int val = sscanf (req, " %u , \"%31[^\"]\" , %u , \"%255[^\"]\" , "
-                      "\"%255[^\"]\" , \"%31[^\"]\" , %u , \"%255[^\"]\" , "
-	                  "\"%255[^\"]\" , \"%255[^\"]\" , \"%255[^\"]\" , %hhu",
-	                  &idx, number, &type, text, group, adnumber, &adtype,
-	                  adtext, email, sip, tel, &hidden);
-	if (val == 0)
-	{	/* Index is optional */
-		idx = UINT_MAX;
-		val = sscanf (req, " , \"%31[^\"]\" , %u , \"%255[^\"]\" , "
-                      "\"%255[^\"]\" , \"%31[^\"]\" , %u , \"%255[^\"]\" , "
-	                  "\"%255[^\"]\" , \"%255[^\"]\" , \"%255[^\"]\" , %hhu",
-                      number, &type, text, group, adnumber, &adtype,
-	                  adtext, email, sip, tel, &hidden);
-		if (val > 0)
-			val++;
-	}
+	at_param_t p[PBW_MAX];
 
-	switch (val)
+	int n = at_tokenize (req, p, PBW_MAX);
+	if (n <= 0)
+		return AT_CME_EINVAL;
+
+	/* Strings are copied back-to-back, each with its nul terminator */
+	char buf[strlen (req) + PBW_MAX], *ptr = buf;
+	const char *str[PBW_MAX];
+	unsigned num[PBW_MAX];
+
+	for (unsigned i = 0; i < PBW_MAX; i++)
 	{
-		case 1:
-			*number = '\0';
-		case 2:
-			type = (number[0] == '+') ? 145 : 129;
-		case 3:
-			*text = '\0';
-		case 4:
-			*group = '\0';
-		case 5:
-			*adnumber = '\0';
-		case 6:
-			adtype = (adnumber[0] == '+') ? 145 : 129;
-		case 7:
-			*adtext = '\0';
-		case 8:
-			*email = '\0';
-		case 9:
-			*sip = '\0';
-		case 10:
-			*tel = '\0';
-		case 11:
-			hidden = 0;
-		case 12:
-			break;
-		default:
-			return AT_CME_EINVAL;
+		bool numeric = (PBW_NUMERIC >> i) & 1;
+
+		str[i] = "";
+		num[i] = UINT_MAX;
+		if ((int)i >= n)
+			continue;
+
+		switch (p[i].type)
+		{
+			case AT_PARAM_OMITTED:
+				break;
+			case AT_PARAM_NUMBER:
+				if (!numeric)
+					return AT_CME_EINVAL;
+				num[i] = p[i].number;
+				break;
+			case AT_PARAM_STRING:
+				if (numeric)
+					return AT_CME_EINVAL;
+				if (p[i].len > ((i == PBW_NUMBER || i == PBW_ADNUMBER)
+				                ? 31 : 255))
+					return AT_CME_E2BIG;
+				str[i] = at_param_copy (p + i, ptr, p[i].len + 1);
+				ptr += p[i].len + 1;
+				break;
+			default:
+				return AT_CME_EINVAL;
+		}
 	}
 
+	unsigned idx = num[PBW_INDEX];
+	const char *number = str[PBW_NUMBER], *adnumber = str[PBW_ADNUMBER];
+	unsigned type = num[PBW_TYPE], adtype = num[PBW_ADTYPE];
+	unsigned hidden = num[PBW_HIDDEN];
+	const char *text = str[PBW_TEXT], *group = str[PBW_GROUP];
+	const char *adtext = str[PBW_ADTEXT], *email = str[PBW_EMAIL];
+	const char *sip = str[PBW_SIP], *tel = str[PBW_TEL];
+
+	if (type == UINT_MAX)
+		type = (number[0] == '+') ? 145 : 129;
+	if (adtype == UINT_MAX)
+		adtype = (adnumber[0] == '+') ? 145 : 129;
+	if (hidden == UINT_MAX)
+		hidden = 0;
+
 	if ((type != ((number[0] == '+') ? 145 : 129))
 	 || (adtype != ((adnumber[0] == '+') ? 145 : 129))
 	 || (hidden > 1)
@@ -337,6 +374,18 @@ void at_phonebooks_deinit (at_phonebooks_t *pbs)
 	}
 }
 
+void at_phonebooks_reset (at_phonebooks_t *pbs)
+{
+	/* Same default as at_phonebooks_register(): ME or the first one */
+	for (at_phonebook_t *pb = pbs->first; pb != NULL; pb = pb->next)
+	{
+		pbs->active = pb;
+		if (!memcmp (pb->name, "ME", 2))
+			break;
+	}
+	pbs->written_index = UINT_MAX;
+}
+
 
 /*** Phonebook registration ***/
 int at_phonebooks_register (at_commands_t *set, at_phonebooks_t *pbs,
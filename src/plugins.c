@@ -46,6 +46,7 @@
 
 #include <stdio.h>
 #include <string.h>
+#include <strings.h>
 #include <stdlib.h>
 #include <limits.h>
 #include <dirent.h>
@@ -56,7 +57,10 @@
 #include <at_command.h>
 #include <at_log.h>
 #include <at_modem.h>
+#include <at_thread.h>
+#include "commands.h"
 #include "plugins.h"
+#include "trie.h"
 
 /*** Plugin loader/unloader ***/
 
@@ -65,6 +69,8 @@ struct at_module
 	void *handle;
 	void *(*register_cb) (at_commands_t *);
 	void (*unregister_cb) (void *);
+	void (*reset_cb) (void *);
+	const at_command_t *table; /**< static commands (or NULL) */
 };
 
 static int filter_so (const struct dirent *d)
@@ -82,17 +88,43 @@ static int filter_so (const struct dirent *d)
 
 static size_t load_plugins (struct at_module **lp, const char *dir)
 {
+	size_t builtins = 0;
+#ifdef ENABLE_BUILTIN_PLUGINS
+	while (at_builtin_plugins[builtins].name != NULL)
+		builtins++;
+#endif
+
 	/* Load all plugins */
-	struct dirent **list;
+	struct dirent **list = NULL;
 	int n = scandir (dir, &list, filter_so, alphasort);
 	if (n == -1)
 	{
-		error ("Cannot scan plugins directory %s (%m)", dir);
-		return 0;
+		if (builtins == 0)
+		{
+			error ("Cannot scan plugins directory %s (%m)", dir);
+			return 0;
+		}
+		debug ("Cannot scan plugins directory %s (%m)", dir);
+		n = 0;
 	}
 
 	size_t count = 0;
-	struct at_module *plugins = malloc (n * sizeof (*plugins));
+	struct at_module *plugins = malloc ((builtins + n) * sizeof (*plugins));
+
+#ifdef ENABLE_BUILTIN_PLUGINS
+	for (size_t i = 0; i < builtins && plugins != NULL; i++)
+	{
+		const at_builtin_t *b = at_builtin_plugins + i;
+
+		debug ("Using built-in plugin %s (%zu)...", b->name, i);
+		plugins[count].handle = NULL;
+		plugins[count].register_cb = b->register_cb;
+		plugins[count].unregister_cb = b->unregister_cb;
+		plugins[count].reset_cb = b->reset_cb;
+		plugins[count].table = b->table;
+		count++;
+	}
+#endif
 
 	for (int i = 0; i < n; i++)
 	{
@@ -113,9 +145,10 @@ static size_t load_plugins (struct at_module **lp, const char *dir)
 			continue;
 		}
 
+		const at_command_t *table = dlsym (h, "at_plugin_table");
 		void *(*register_cb) (at_commands_t *);
 		register_cb = dlsym (h, "at_plugin_register");
-		if (register_cb == NULL)
+		if (register_cb == NULL && table == NULL)
 		{
 			const char *msg = dlerror ();
 			warning ("Cannot load %s (%s)", path, msg ? msg : "?");
@@ -128,6 +161,8 @@ static size_t load_plugins (struct at_module **lp, const char *dir)
 		plugins[count].handle = h;
 		plugins[count].register_cb = register_cb;
 		plugins[count].unregister_cb = dlsym (h, "at_plugin_unregister");
+		plugins[count].reset_cb = dlsym (h, "at_plugin_reset");
+		plugins[count].table = table;
 		count++;
 	}
 	free (list);
@@ -138,18 +173,140 @@ static size_t load_plugins (struct at_module **lp, const char *dir)
 static void unload_plugins (struct at_module *plugins, size_t n)
 {
 	for (size_t i = 0; i < n; i++)
-		dlclose (plugins[i].handle);
+		if (plugins[i].handle != NULL) /* not built-in */
+			dlclose (plugins[i].handle);
 	free (plugins);
 }
 
 
+/*** Static commands table ***/
+
+/**
+ * Checks an extended command from a static table.
+ * @return NULL if valid, otherwise a description of the problem.
+ */
+static const char *check_command (const at_command_t *cmd)
+{
+	char c = cmd->name[0];
+
+	if (strlen (cmd->name) >= AT_NAME_MAX)
+		return "name too long";
+	if (c == '\0' || c == '&' || ((unsigned)(c | 0x20) - 'a') < 26)
+		return "not an extended command";
+	if (cmd->set == NULL)
+		return "no handler";
+	return NULL;
+}
+
+static void add_commands (at_entry_t *tab, size_t *count,
+                          const at_command_t *cmd, size_t plugin)
+{
+	for (; cmd->name != NULL; cmd++)
+	{
+		const char *problem = check_command (cmd);
+		if (problem != NULL)
+		{
+			warning ("Ignoring AT%s from plugin %zu (%s)", cmd->name, plugin,
+			         problem);
+			continue;
+		}
+
+		at_entry_t *e = tab + (*count)++;
+
+		strcpy (e->name, cmd->name);
+		e->cmd = cmd;
+		e->plugin = plugin;
+	}
+}
+
+static size_t count_commands (const at_command_t *cmd)
+{
+	size_t n = 0;
+
+	if (cmd != NULL)
+		while (cmd[n].name != NULL)
+			n++;
+	return n;
+}
+
+static int cmp_entry (const void *a, const void *b)
+{
+	const at_entry_t *ea = a, *eb = b;
+	int val = strcasecmp (ea->name, eb->name);
+
+	if (val == 0) /* The core first, then the plugins in load order */
+		val = (ea->plugin + 1 > eb->plugin + 1)
+		    - (ea->plugin + 1 < eb->plugin + 1);
+	return val;
+}
+
+/**
+ * Merges the extended commands of the core and of the plugins into a single
+ * sorted table with a lookup tree.
+ */
+static size_t build_table (at_entry_t **tabp, at_trie_t **triep,
+                           const struct at_module *plugins, size_t n)
+{
+	size_t max = 0, count = 0;
+
+	for (const at_command_t *const *t = at_core_commands; *t != NULL; t++)
+		max += count_commands (*t);
+	for (size_t i = 0; i < n; i++)
+		max += count_commands (plugins[i].table);
+
+	at_entry_t *tab = malloc ((max + 1) * sizeof (*tab));
+	if (tab == NULL)
+		goto error;
+
+	for (const at_command_t *const *t = at_core_commands; *t != NULL; t++)
+		add_commands (tab, &count, *t, AT_PLUGIN_CORE);
+	for (size_t i = 0; i < n; i++)
+		if (plugins[i].table != NULL)
+			add_commands (tab, &count, plugins[i].table, i);
+
+	qsort (tab, count, sizeof (*tab), cmp_entry);
+
+	/* Remove duplicates, keeping the first one */
+	size_t unique = 0;
+	for (size_t i = 0; i < count; i++)
+	{
+		if (unique > 0 && !strcasecmp (tab[unique - 1].name, tab[i].name))
+		{
+			warning ("Duplicate registration for AT%s", tab[i].name);
+			continue;
+		}
+		tab[unique++] = tab[i];
+	}
+
+	at_trie_t *trie = at_trie_build (tab->name, unique, sizeof (*tab));
+	if (trie == NULL)
+	{
+		free (tab);
+		goto error;
+	}
+
+	*tabp = tab;
+	*triep = trie;
+	return unique;
+
+error:
+	error ("Cannot build commands table (%m)");
+	*tabp = NULL;
+	*triep = NULL;
+	return 0;
+}
+
+
 static struct
 {
 	struct at_module *modules;
 	size_t count;
+	at_entry_t *commands; /**< static extended commands, sorted by name */
+	size_t command_count;
+	at_trie_t *trie; /**< lookup tree of the static extended commands */
 	pthread_mutex_t lock;
 	unsigned refs;
-} modules = { NULL, 0, PTHREAD_MUTEX_INITIALIZER, 0, };
+} modules = { NULL, 0, NULL, 0, NULL, PTHREAD_MUTEX_INITIALIZER, 0, };
 
 int at_load_plugins (void)
 {
@@ -164,6 +321,10 @@ int at_load_plugins (void)
 			if (dir == NULL)
 				dir = PKGLIBDIR"/plugins";
 			modules.count = load_plugins (&modules.modules, dir);
+			modules.command_count = build_table (&modules.commands,
+			                                     &modules.trie,
+			                                     modules.modules,
+			                                     modules.count);
 		}
 		modules.refs++;
 		ret = 0;
@@ -177,37 +338,164 @@ void at_unload_plugins (void)
 	pthread_mutex_lock (&modules.lock);
 	assert (modules.refs != 0);
 	if (--modules.refs == 0)
+	{
+		at_trie_destroy (modules.trie);
+		free (modules.commands);
+		modules.trie = NULL;
+		modules.commands = NULL;
+		modules.command_count = 0;
 		unload_plugins (modules.modules, modules.count);
+	}
 	pthread_mutex_unlock (&modules.lock);
 }
 
+const at_entry_t *at_plugins_match (const char *str)
+{
+	if (modules.trie == NULL)
+		return NULL;
+
+	int idx = at_trie_find (modules.trie, str);
+	return (idx >= 0) ? (modules.commands + idx) : NULL;
+}
+
+const at_entry_t *at_plugins_find (const char *name)
+{
+	size_t lo = 0, hi = modules.command_count;
+
+	while (lo < hi)
+	{
+		size_t mid = (lo + hi) / 2;
+		int val = strcasecmp (name, modules.commands[mid].name);
+
+		if (val == 0)
+			return modules.commands + mid;
+		if (val < 0)
+			hi = mid;
+		else
+			lo = mid + 1;
+	}
+	return NULL;
+}
+
+const at_entry_t *at_plugins_list (size_t *count)
+{
+	*count = modules.command_count;
+	return modules.commands;
+}
+
+
+/*** Plugin instances ***/
+
+/**
+ * Plugin instances of an AT modem: one data pointer per plugin, whatever the
+ * number of commands.
+ */
+typedef struct at_instances
+{
+	at_commands_t *bank;
+	struct
+	{
+		void *opaque;
+		bool active;
+	} tab[];
+} at_instances_t;
+
 void *at_instantiate_plugins (at_commands_t *set)
 {
 	size_t n = modules.count;
-	void **tab = malloc (sizeof (*tab) * n);
-	if (tab == NULL)
+	at_instances_t *inst = malloc (sizeof (*inst) + n * sizeof (inst->tab[0]));
+	if (inst == NULL)
 		return NULL;
 
+	inst->bank = set;
 	for (size_t i = 0; i < n; i++)
 	{
+		const struct at_module *mod = modules.modules + i;
+
+		inst->tab[i].opaque = NULL;
+		inst->tab[i].active = false;
+
+		if (mod->table != NULL)
+		{
+			debug ("Deferring plugin %zu...", i);
+			continue;
+		}
+
 		debug ("Initializing plugin %zu...", i);
-		tab[i] = modules.modules[i].register_cb (set);
+		inst->tab[i].opaque = mod->register_cb (set);
+		inst->tab[i].active = true;
+	}
+	return inst;
+}
+
+int at_plugin_data (void *opaque, size_t i, void **data)
+{
+	at_instances_t *inst = opaque;
+
+	if (inst == NULL)
+		return -1;
+
+	if (!inst->tab[i].active)
+	{
+		void *(*register_cb) (at_commands_t *) = modules.modules[i].register_cb;
+
+		if (register_cb != NULL)
+		{
+			int canc = at_cancel_disable ();
+
+			debug ("Initializing plugin %zu...", i);
+			inst->tab[i].opaque = register_cb (inst->bank);
+			at_cancel_enable (canc);
+			if (inst->tab[i].opaque == NULL)
+			{
+				error ("Plugin %zu initialization failed", i);
+				return -1;
+			}
+		}
+		inst->tab[i].active = true;
 	}
 
-	return tab;
+	*data = inst->tab[i].opaque;
+	return 0;
 }
 
 void at_deinstantiate_plugins (void *opaque)
 {
-	void **opaques = opaque;
+	at_instances_t *inst = opaque;
 	size_t n = modules.count;
 
+	if (inst == NULL)
+		return;
+
 	for (size_t i = 0; i < n; i++)
 	{
 		void (*unregister_cb) (void *)= modules.modules[i].unregister_cb;
 
-		if (unregister_cb != NULL)
-			unregister_cb (opaques[i]);
+		if (inst->tab[i].active && unregister_cb != NULL)
+			unregister_cb (inst->tab[i].opaque);
+	}
+	free (inst);
+}
+
+int at_reset_plugins (void *opaque)
+{
+	at_instances_t *inst = opaque;
+	size_t n = modules.count;
+
+	/* Plugin instances with data must all support resetting */
+	for (size_t i = 0; i < n; i++)
+		if (inst->tab[i].opaque != NULL && modules.modules[i].reset_cb == NULL)
+			return -1;
+
+	for (size_t i = 0; i < n; i++)
+	{
+		void (*reset_cb) (void *) = modules.modules[i].reset_cb;
+
+		if (inst->tab[i].active && reset_cb != NULL)
+		{
+			debug ("Resetting plugin %zu...", i);
+			reset_cb (inst->tab[i].opaque);
+		}
 	}
-	free (opaques);
+	return 0;
 }
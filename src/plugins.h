@@ -44,11 +44,72 @@
 /**
  * Instantiate AT commands plugins, i.e. invoke their registration
  * function. It is assumed that plugins have already been loaded with
- * at_load_plugins() first.
+ * at_load_plugins() first. Plugins with a table of commands are only
+ * instantiated when one of their commands executes (see at_plugin_data()).
  */
 void *at_instantiate_plugins (at_commands_t *);
 
+/**
+ * Gets the data of a plugin instance, instantiating the plugin if needed.
+ * @param instances plugin instances from at_instantiate_plugins()
+ * @param plugin index of the plugin
+ * @param data where to store the value returned by at_plugin_register()
+ * @return 0 on success, -1 if the plugin could not be instantiated.
+ */
+int at_plugin_data (void *instances, size_t plugin, void **data);
+
 /**
  * Destroy AT commands plugin instances as created by at_instantiate_plugins().
  */
 void at_deinstantiate_plugins (void *);
+
+/**
+ * Restores the default settings of AT commands plugin instances.
+ * @return 0 on success, -1 if a plugin instance cannot be reset; then it
+ * must be destroyed and instantiated again.
+ */
+int at_reset_plugins (void *);
+
+/** Owner of the extended commands of the core */
+#define AT_PLUGIN_CORE ((size_t)-1)
+
+/** Extended command from a static table (core or at_plugin_table) */
+typedef struct at_entry
+{
+	char name[AT_NAME_MAX];
+	const at_command_t *cmd;
+	size_t plugin; /**< index of the plugin, or AT_PLUGIN_CORE */
+} at_entry_t;
+
+/**
+ * Looks up the longest statically registered extended command that an AT
+ * command starts with. The plugins must be loaded.
+ * @param str nul-terminated command (with the AT prefix removed)
+ * @return the command, or NULL if none matched.
+ */
+const at_entry_t *at_plugins_match (const char *str);
+
+/**
+ * Looks up a statically registered extended command by name.
+ * @return the command, or NULL if not found.
+ */
+const at_entry_t *at_plugins_find (const char *name);
+
+/**
+ * Lists the statically registered extended commands, sorted by name.
+ * @param count where to store the number of commands
+ */
+const at_entry_t *at_plugins_list (size_t *count);
+
+/** Plugin linked into libmatd (see --enable-builtin-plugins) */
+typedef struct at_builtin
+{
+	const char *name;
+	void *(*register_cb) (at_commands_t *);
+	void (*unregister_cb) (void *);
+	void (*reset_cb) (void *);
+	const at_command_t *table;
+} at_builtin_t;
+
+/** Generated table of built-in plugins, terminated by a NULL name */
+extern const at_builtin_t at_builtin_plugins[];
@@ -0,0 +1,172 @@
+/**
+ * @file trie.c
+ * @brief Extended commands lookup trie
+ * @ingroup internal
+ */
+
+/* ***** BEGIN LICENSE BLOCK *****
+ * Version: MPL 1.1/GPL 2.0/LGPL 2.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is matd.
+ *
+ * The Initial Developer of the Original Code is
+ * remi.denis-courmont@nokia.com.
+ * Portions created by the Initial Developer are
+ * Copyright (C) 2012 Nokia Corporation and/or its subsidiary(-ies).
+ * All Rights Reserved.
+ *
+ * Contributor(s):
+ *
+ * Alternatively, the contents of this file may be used under the terms of
+ * either the GNU General Public License Version 2 or later (the "GPL"), or
+ * the GNU Lesser General Public License Version 2.1 or later (the "LGPL"),
+ * in which case the provisions of the GPL or the LGPL are applicable instead
+ * of those above. If you wish to allow use of your version of this file only
+ * under the terms of either the GPL or the LGPL, and not to allow others to
+ * use your version of this file under the terms of the MPL, indicate your
+ * decision by deleting the provisions above and replace them with the notice
+ * and other provisions required by the GPL or the LGPL. If you do not delete
+ * the provisions above, a recipient may use your version of this file under
+ * the terms of any one of the MPL, the GPL or the LGPL.
+ *
+ * ***** END LICENSE BLOCK ***** */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <errno.h>
+
+#include "trie.h"
+
+/** Trie node, i.e. a character within one or more names */
+struct at_trie_node
+{
+	uint8_t key; /**< lower case character */
+	uint8_t count; /**< number of children */
+	uint16_t first; /**< index of the first child */
+	uint16_t value; /**< index of the name ending here plus one, or zero */
+};
+
+struct at_trie
+{
+	size_t count; /**< number of nodes in use */
+	struct at_trie_node nodes[]; /**< nodes, the root first */
+};
+
+static inline unsigned char at_trie_fold (unsigned char c)
+{
+	return ((unsigned)(c - 'A') < 26) ? (c + 'a' - 'A') : c;
+}
+
+#define NAME(i) ((const unsigned char *)names + (i) * stride)
+
+/**
+ * Fills a node for names [lo, hi[ sharing their first depth characters.
+ * The children of a node are adjacent and sorted, so that the tree is
+ * walked with only a few cache lines.
+ */
+static void at_trie_fill (at_trie_t *t, size_t node, const char *names,
+                          size_t stride, size_t lo, size_t hi, size_t depth)
+{
+	struct at_trie_node *n = t->nodes + node;
+
+	n->value = 0;
+	if (lo < hi && NAME(lo)[depth] == '\0')
+		n->value = ++lo; /* the shortest name sorts first */
+
+	unsigned count = 0;
+	for (size_t i = lo; i < hi; count++)
+	{
+		unsigned char c = at_trie_fold (NAME(i)[depth]);
+
+		while (i < hi && at_trie_fold (NAME(i)[depth]) == c)
+			i++;
+	}
+
+	n->first = t->count;
+	n->count = count;
+	t->count += count;
+
+	for (size_t i = lo, child = n->first; i < hi; child++)
+	{
+		unsigned char c = at_trie_fold (NAME(i)[depth]);
+		size_t j = i;
+
+		while (j < hi && at_trie_fold (NAME(j)[depth]) == c)
+			j++;
+		t->nodes[child].key = c;
+		at_trie_fill (t, child, names, stride, i, j, depth + 1);
+		i = j;
+	}
+}
+
+at_trie_t *at_trie_build (const char *names, size_t count, size_t stride)
+{
+	/* Every character can be a node, plus the root */
+	size_t max = 1;
+
+	for (size_t i = 0; i < count; i++)
+		for (const unsigned char *p = NAME(i); *p; p++)
+			max++;
+
+	if (count >= UINT16_MAX || max > UINT16_MAX)
+	{
+		errno = E2BIG;
+		return NULL;
+	}
+
+	at_trie_t *t = malloc (sizeof (*t) + max * sizeof (t->nodes[0]));
+	if (t == NULL)
+		return NULL;
+
+	t->nodes[0].key = '\0';
+	t->count = 1;
+	at_trie_fill (t, 0, names, stride, 0, count, 0);
+	return t;
+}
+
+void at_trie_destroy (at_trie_t *t)
+{
+	free (t);
+}
+
+int at_trie_find (const at_trie_t *t, const char *str)
+{
+	const struct at_trie_node *n = t->nodes;
+	unsigned value = 0;
+
+	for (;;)
+	{
+		unsigned char c = at_trie_fold (*(str++));
+
+		if (n->value && !isalnum (c))
+			value = n->value;
+		if (c == '\0')
+			break;
+
+		const struct at_trie_node *child = t->nodes + n->first;
+		const struct at_trie_node *end = child + n->count;
+
+		while (child < end && child->key < c)
+			child++;
+		if (child == end || child->key != c)
+			break;
+		n = child;
+	}
+	return (int)value - 1;
+}
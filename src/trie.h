@@ -0,0 +1,77 @@
+/**
+ * @file trie.h
+ * @brief Internal header for the extended commands lookup trie
+ * @ingroup internal
+ */
+
+/* ***** BEGIN LICENSE BLOCK *****
+ * Version: MPL 1.1/GPL 2.0/LGPL 2.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is matd.
+ *
+ * The Initial Developer of the Original Code is
+ * remi.denis-courmont@nokia.com.
+ * Portions created by the Initial Developer are
+ * Copyright (C) 2012 Nokia Corporation and/or its subsidiary(-ies).
+ * All Rights Reserved.
+ *
+ * Contributor(s):
+ *
+ * Alternatively, the contents of this file may be used under the terms of
+ * either the GNU General Public License Version 2 or later (the "GPL"), or
+ * the GNU Lesser General Public License Version 2.1 or later (the "LGPL"),
+ * in which case the provisions of the GPL or the LGPL are applicable instead
+ * of those above. If you wish to allow use of your version of this file only
+ * under the terms of either the GPL or the LGPL, and not to allow others to
+ * use your version of this file under the terms of the MPL, indicate your
+ * decision by deleting the provisions above and replace them with the notice
+ * and other provisions required by the GPL or the LGPL. If you do not delete
+ * the provisions above, a recipient may use your version of this file under
+ * the terms of any one of the MPL, the GPL or the LGPL.
+ *
+ * ***** END LICENSE BLOCK ***** */
+
+#ifndef AT_TRIE_H
+# define AT_TRIE_H 1
+
+/**
+ * Case-insensitive prefix tree of command names. It is immutable: adding a
+ * name requires building a new tree.
+ */
+typedef struct at_trie at_trie_t;
+
+/**
+ * Builds a prefix tree from a table of names.
+ * @param names first name of the table
+ * @param count number of names in the table
+ * @param stride bytes between two consecutive names in the table
+ * @note The names must be unique and sorted with strcasecmp().
+ * @return the prefix tree, or NULL on error (errno is set).
+ */
+at_trie_t *at_trie_build (const char *names, size_t count, size_t stride);
+
+/**
+ * Destroys a prefix tree.
+ */
+void at_trie_destroy (at_trie_t *);
+
+/**
+ * Looks up the longest name that an AT command starts with, ignoring case.
+ * The name must not be immediately followed by an alphanumeric character,
+ * so that "+CRC=1" does not match "+CR".
+ * @param str nul-terminated command (with the AT prefix removed)
+ * @return the index of the name in the table, or -1 if none matched.
+ */
+int at_trie_find (const at_trie_t *, const char *str);
+
+#endif
@@ -0,0 +1,200 @@
+/**
+ * @file urc.c
+ * @brief Unsolicited results queue
+ * @ingroup internal
+ */
+
+/* ***** BEGIN LICENSE BLOCK *****
+ * Version: MPL 1.1/GPL 2.0/LGPL 2.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is matd.
+ *
+ * The Initial Developer of the Original Code is
+ * remi.denis-courmont@nokia.com.
+ * Portions created by the Initial Developer are
+ * Copyright (C) 2012 Nokia Corporation and/or its subsidiary(-ies).
+ * All Rights Reserved.
+ *
+ * Contributor(s):
+ *
+ * Alternatively, the contents of this file may be used under the terms of
+ * either the GNU General Public License Version 2 or later (the "GPL"), or
+ * the GNU Lesser General Public License Version 2.1 or later (the "LGPL"),
+ * in which case the provisions of the GPL or the LGPL are applicable instead
+ * of those above. If you wish to allow use of your version of this file only
+ * under the terms of either the GPL or the LGPL, and not to allow others to
+ * use your version of this file under the terms of the MPL, indicate your
+ * decision by deleting the provisions above and replace them with the notice
+ * and other provisions required by the GPL or the LGPL. If you do not delete
+ * the provisions above, a recipient may use your version of this file under
+ * the terms of any one of the MPL, the GPL or the LGPL.
+ *
+ * ***** END LICENSE BLOCK ***** */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <stdbool.h>
+#include <string.h>
+
+#include "urc.h"
+#include "perf.h"
+
+/*
+ * Each slot carries a sequence number: it equals the push position when the
+ * slot is free, and the push position plus one once the result is written.
+ * Producers claim a position by advancing the head, write the slot, then
+ * publish the sequence number. The consumer releases the slot for the next
+ * round by adding the queue size.
+ */
+
+void at_urc_init (at_urc_queue_t *q)
+{
+	q->head = 0;
+	q->tail = 0;
+	for (unsigned i = 0; i < AT_URC_SLOTS; i++)
+		q->slots[i].seq = i;
+}
+
+int at_urc_push (at_urc_queue_t *q, const void *blob, size_t len)
+{
+	if (len > AT_URC_MAX)
+		return -1;
+
+	unsigned pos = __atomic_load_n (&q->head, __ATOMIC_RELAXED);
+
+	for (;;)
+	{
+		unsigned seq = __atomic_load_n (&q->slots[pos % AT_URC_SLOTS].seq,
+		                                __ATOMIC_ACQUIRE);
+		int diff = (int)(seq - pos);
+
+		if (diff == 0)
+		{
+			if (__atomic_compare_exchange_n (&q->head, &pos, pos + 1, true,
+			                                 __ATOMIC_RELAXED,
+			                                 __ATOMIC_RELAXED))
+				break;
+		}
+		else if (diff < 0)
+			return -1; /* full */
+		else
+			pos = __atomic_load_n (&q->head, __ATOMIC_RELAXED);
+	}
+
+	memcpy (q->slots[pos % AT_URC_SLOTS].buf, blob, len);
+	q->slots[pos % AT_URC_SLOTS].len = len;
+	__atomic_store_n (&q->slots[pos % AT_URC_SLOTS].seq, pos + 1,
+	                  __ATOMIC_RELEASE);
+	return 0;
+}
+
+const void *at_urc_peek (at_urc_queue_t *q, size_t *len)
+{
+	unsigned pos = q->tail;
+
+	if (__atomic_load_n (&q->slots[pos % AT_URC_SLOTS].seq, __ATOMIC_ACQUIRE)
+	     != pos + 1)
+		return NULL; /* empty, or oldest result not written yet */
+
+	*len = q->slots[pos % AT_URC_SLOTS].len;
+	return q->slots[pos % AT_URC_SLOTS].buf;
+}
+
+void at_urc_pop (at_urc_queue_t *q)
+{
+	unsigned pos = q->tail++;
+
+	__atomic_store_n (&q->slots[pos % AT_URC_SLOTS].seq, pos + AT_URC_SLOTS,
+	                  __ATOMIC_RELEASE);
+}
+
+void at_urc_states_init (at_urc_states_t *st, uint64_t window)
+{
+	pthread_mutex_init (&st->lock, NULL);
+	st->window = window;
+	for (unsigned i = 0; i < AT_URC_KEYS; i++)
+	{
+		st->keys[i].key[0] = '\0';
+		st->keys[i].pending = false;
+	}
+}
+
+void at_urc_states_deinit (at_urc_states_t *st)
+{
+	pthread_mutex_destroy (&st->lock);
+}
+
+int at_urc_states_update (at_urc_states_t *st, const char *key,
+                          const void *blob, size_t len)
+{
+	int ret = -1;
+
+	if (len > AT_URC_MAX || strlen (key) >= AT_URC_KEY_MAX)
+		return -1;
+
+	pthread_mutex_lock (&st->lock);
+	for (unsigned i = 0; i < AT_URC_KEYS; i++)
+	{
+		if (st->keys[i].key[0] == '\0')
+		{	/* New key */
+			strcpy (st->keys[i].key, key);
+			st->keys[i].sent = 0;
+		}
+		else if (strcmp (st->keys[i].key, key))
+			continue;
+
+		if (st->keys[i].pending)
+			at_perf_coalesced (key);
+		memcpy (st->keys[i].buf, blob, len);
+		st->keys[i].len = len;
+		st->keys[i].pending = true;
+		ret = 0;
+		break;
+	}
+	pthread_mutex_unlock (&st->lock);
+	return ret;
+}
+
+size_t at_urc_states_take (at_urc_states_t *st, uint64_t now,
+                           void *buf, size_t size, uint64_t *next)
+{
+	size_t len = 0;
+
+	*next = 0;
+	pthread_mutex_lock (&st->lock);
+	for (unsigned i = 0; i < AT_URC_KEYS; i++)
+	{
+		if (!st->keys[i].pending)
+			continue;
+
+		uint64_t due = st->keys[i].sent + st->window;
+
+		if (now >= due && st->keys[i].len <= size - len)
+		{
+			memcpy ((char *)buf + len, st->keys[i].buf, st->keys[i].len);
+			len += st->keys[i].len;
+			st->keys[i].pending = false;
+			st->keys[i].sent = now;
+			continue;
+		}
+
+		if (due <= now)
+			due = now + 1; /* did not fit */
+		if (*next == 0 || due < *next)
+			*next = due;
+	}
+	pthread_mutex_unlock (&st->lock);
+	return len;
+}
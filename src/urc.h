@@ -0,0 +1,138 @@
+/**
+ * @file urc.h
+ * @brief Internal header for the unsolicited results queue
+ * @ingroup internal
+ */
+
+/* ***** BEGIN LICENSE BLOCK *****
+ * Version: MPL 1.1/GPL 2.0/LGPL 2.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is matd.
+ *
+ * The Initial Developer of the Original Code is
+ * remi.denis-courmont@nokia.com.
+ * Portions created by the Initial Developer are
+ * Copyright (C) 2012 Nokia Corporation and/or its subsidiary(-ies).
+ * All Rights Reserved.
+ *
+ * Contributor(s):
+ *
+ * Alternatively, the contents of this file may be used under the terms of
+ * either the GNU General Public License Version 2 or later (the "GPL"), or
+ * the GNU Lesser General Public License Version 2.1 or later (the "LGPL"),
+ * in which case the provisions of the GPL or the LGPL are applicable instead
+ * of those above. If you wish to allow use of your version of this file only
+ * under the terms of either the GPL or the LGPL, and not to allow others to
+ * use your version of this file under the terms of the MPL, indicate your
+ * decision by deleting the provisions above and replace them with the notice
+ * and other provisions required by the GPL or the LGPL. If you do not delete
+ * the provisions above, a recipient may use your version of this file under
+ * the terms of any one of the MPL, the GPL or the LGPL.
+ *
+ * ***** END LICENSE BLOCK ***** */
+
+#ifndef AT_URC_H
+# define AT_URC_H 1
+
+# include <stdbool.h>
+# include <stddef.h>
+# include <stdint.h>
+# include <pthread.h>
+
+/** Number of unsolicited results an AT modem can hold back */
+# define AT_URC_SLOTS 32
+/** Maximum byte length of a queued unsolicited result */
+# define AT_URC_MAX 256
+
+/**
+ * Bounded queue of unsolicited results. Any number of threads can push
+ * results without locking, but only one thread at a time may pop them.
+ */
+typedef struct at_urc_queue
+{
+	unsigned head; /**< next slot to push to */
+	unsigned tail; /**< next slot to pop from */
+	struct
+	{
+		unsigned seq; /**< slot sequence number */
+		uint16_t len; /**< byte length of the result */
+		char buf[AT_URC_MAX];
+	} slots[AT_URC_SLOTS];
+} at_urc_queue_t;
+
+void at_urc_init (at_urc_queue_t *q);
+
+/**
+ * Adds an unsolicited result to the queue.
+ * @return 0 on success, -1 if the queue is full or the result too long.
+ */
+int at_urc_push (at_urc_queue_t *q, const void *blob, size_t len);
+
+/**
+ * Looks up the oldest unsolicited result in the queue.
+ * @param len [OUT] byte length of the result
+ * @return the result, or NULL if the queue is empty.
+ */
+const void *at_urc_peek (at_urc_queue_t *q, size_t *len);
+
+/**
+ * Removes the oldest unsolicited result from the queue (after at_urc_peek()).
+ */
+void at_urc_pop (at_urc_queue_t *q);
+
+/** Number of distinct state report keys per AT modem */
+# define AT_URC_KEYS 8
+/** Maximum byte length of a state report key (including nul) */
+# define AT_URC_KEY_MAX 12
+
+/**
+ * Latest state reports (e.g. +CREG) per key. Only the latest report of a
+ * given key is delivered, and at most once per coalescing window.
+ */
+typedef struct at_urc_states
+{
+	pthread_mutex_t lock;
+	uint64_t window; /**< coalescing window (nanoseconds) */
+	struct
+	{
+		char key[AT_URC_KEY_MAX];
+		bool pending; /**< whether the report is not delivered yet */
+		uint64_t sent; /**< time the last report was delivered */
+		uint16_t len; /**< byte length of the report */
+		char buf[AT_URC_MAX];
+	} keys[AT_URC_KEYS];
+} at_urc_states_t;
+
+void at_urc_states_init (at_urc_states_t *st, uint64_t window);
+void at_urc_states_deinit (at_urc_states_t *st);
+
+/**
+ * Replaces the pending state report for a key.
+ * @return 0 on success, -1 if there are too many keys or the report is
+ * too long.
+ */
+int at_urc_states_update (at_urc_states_t *st, const char *key,
+                          const void *blob, size_t len);
+
+/**
+ * Takes the pending state reports whose coalescing window has elapsed.
+ * @param now current monotonic time (nanoseconds)
+ * @param buf buffer to copy the reports to
+ * @param size buffer byte size (reports that do not fit are left pending)
+ * @param next [OUT] time the next pending report is due, or 0 if none
+ * @return the byte length of the reports copied to the buffer
+ */
+size_t at_urc_states_take (at_urc_states_t *st, uint64_t now,
+                           void *buf, size_t size, uint64_t *next);
+
+#endif
@@ -0,0 +1,514 @@
+/**
+ * @file uring.c
+ * @brief io_uring engine for the data mode bridge
+ * @ingroup internal
+ */
+
+/* ***** BEGIN LICENSE BLOCK *****
+ * Version: MPL 1.1/GPL 2.0/LGPL 2.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is matd.
+ *
+ * The Initial Developer of the Original Code is
+ * remi.denis-courmont@nokia.com.
+ * Portions created by the Initial Developer are
+ * Copyright (C) 2012 Nokia Corporation and/or its subsidiary(-ies).
+ * All Rights Reserved.
+ *
+ * Contributor(s):
+ *
+ * Alternatively, the contents of this file may be used under the terms of
+ * either the GNU General Public License Version 2 or later (the "GPL"), or
+ * the GNU Lesser General Public License Version 2.1 or later (the "LGPL"),
+ * in which case the provisions of the GPL or the LGPL are applicable instead
+ * of those above. If you wish to allow use of your version of this file only
+ * under the terms of either the GPL or the LGPL, and not to allow others to
+ * use your version of this file under the terms of the MPL, indicate your
+ * decision by deleting the provisions above and replace them with the notice
+ * and other provisions required by the GPL or the LGPL. If you do not delete
+ * the provisions above, a recipient may use your version of this file under
+ * the terms of any one of the MPL, the GPL or the LGPL.
+ *
+ * ***** END LICENSE BLOCK ***** */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+
+#include <at_command.h>
+#include <at_log.h>
+#include "data.h"
+
+/** Slots per direction (buffers are registered once, so never grown) */
+#define SLOTS AT_DATA_SLOTS_MAX
+
+/** Completion tag of cancellation requests */
+#define CANCEL_TAG 4
+
+/** Internal state of one direction of the io_uring engine. */
+struct uring_flow
+{
+	int in; /**< Source file descriptor */
+	int out; /**< Sink file descriptor */
+	uint8_t *buf; /**< MTU-sized slots */
+	size_t len[SLOTS]; /**< Bytes in each slot */
+	uint64_t stamp[SLOTS]; /**< Time each slot was filled */
+	unsigned head; /**< Oldest filled slot */
+	unsigned count; /**< Filled slots */
+	size_t offset; /**< Write offset in the oldest slot */
+	bool reading; /**< Whether a read is in flight */
+	bool writing; /**< Whether a write is in flight */
+};
+
+/** Internal state of the io_uring engine. */
+struct uring
+{
+	int fd; /**< io_uring file descriptor */
+	void *sq_ring;
+	size_t sq_size;
+	void *cq_ring;
+	size_t cq_size;
+	struct io_uring_sqe *sqes;
+	size_t sqes_size;
+	unsigned *sq_tail, *sq_mask, *sq_array;
+	unsigned *cq_head, *cq_tail, *cq_mask;
+	struct io_uring_cqe *cqes;
+	unsigned queued; /**< Queued but not submitted entries */
+	bool fixed; /**< Whether the buffers are registered */
+	size_t mtu;
+	uint8_t *buf;
+	const at_data_ctx_t *ctx;
+	int flags[3]; /**< Original file status flags */
+	struct uring_flow flows[2];
+};
+
+static int uring_setup (unsigned entries, struct io_uring_params *p)
+{
+	return syscall (__NR_io_uring_setup, entries, p);
+}
+
+static int uring_enter (int fd, unsigned submit, unsigned complete,
+                        unsigned flags)
+{
+	return syscall (__NR_io_uring_enter, fd, submit, complete, flags,
+	                NULL, 0);
+}
+
+static int uring_register (int fd, unsigned op, const void *arg, unsigned n)
+{
+	return syscall (__NR_io_uring_register, fd, op, arg, n);
+}
+
+static void uring_unmap (struct uring *u)
+{
+	munmap (u->sqes, u->sqes_size);
+	if (u->cq_ring != u->sq_ring)
+		munmap (u->cq_ring, u->cq_size);
+	munmap (u->sq_ring, u->sq_size);
+	close (u->fd);
+}
+
+static int uring_map (struct uring *u)
+{
+	struct io_uring_params p;
+
+	memset (&p, 0, sizeof (p));
+	/* Two reads, two writes and their cancellations at most */
+	u->fd = uring_setup (8, &p);
+	if (u->fd == -1)
+	{
+		debug ("Cannot set up io_uring (%m)");
+		return -1;
+	}
+	fcntl (u->fd, F_SETFD, FD_CLOEXEC);
+
+	u->sq_size = p.sq_off.array + p.sq_entries * sizeof (unsigned);
+	u->cq_size = p.cq_off.cqes + p.cq_entries * sizeof (struct io_uring_cqe);
+	if (p.features & IORING_FEAT_SINGLE_MMAP)
+	{
+		if (u->cq_size > u->sq_size)
+			u->sq_size = u->cq_size;
+		u->cq_size = u->sq_size;
+	}
+	u->sqes_size = p.sq_entries * sizeof (struct io_uring_sqe);
+
+	u->sq_ring = mmap (NULL, u->sq_size, PROT_READ|PROT_WRITE,
+	                   MAP_SHARED|MAP_POPULATE, u->fd, IORING_OFF_SQ_RING);
+	if (u->sq_ring == MAP_FAILED)
+		goto error;
+
+	if (p.features & IORING_FEAT_SINGLE_MMAP)
+		u->cq_ring = u->sq_ring;
+	else
+	{
+		u->cq_ring = mmap (NULL, u->cq_size, PROT_READ|PROT_WRITE,
+		                   MAP_SHARED|MAP_POPULATE, u->fd, IORING_OFF_CQ_RING);
+		if (u->cq_ring == MAP_FAILED)
+		{
+			munmap (u->sq_ring, u->sq_size);
+			goto error;
+		}
+	}
+
+	u->sqes = mmap (NULL, u->sqes_size, PROT_READ|PROT_WRITE,
+	                MAP_SHARED|MAP_POPULATE, u->fd, IORING_OFF_SQES);
+	if (u->sqes == MAP_FAILED)
+	{
+		if (u->cq_ring != u->sq_ring)
+			munmap (u->cq_ring, u->cq_size);
+		munmap (u->sq_ring, u->sq_size);
+		goto error;
+	}
+
+	uint8_t *sq = u->sq_ring, *cq = u->cq_ring;
+
+	u->sq_tail = (unsigned *)(sq + p.sq_off.tail);
+	u->sq_mask = (unsigned *)(sq + p.sq_off.ring_mask);
+	u->sq_array = (unsigned *)(sq + p.sq_off.array);
+	u->cq_head = (unsigned *)(cq + p.cq_off.head);
+	u->cq_tail = (unsigned *)(cq + p.cq_off.tail);
+	u->cq_mask = (unsigned *)(cq + p.cq_off.ring_mask);
+	u->cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+	u->queued = 0;
+	return 0;
+
+error:
+	debug ("Cannot map io_uring (%m)");
+	close (u->fd);
+	return -1;
+}
+
+/** Queues a submission entry; it is submitted by the next uring_enter(). */
+static struct io_uring_sqe *uring_sqe (struct uring *u, uint8_t opcode,
+                                       int fd, uint64_t tag)
+{
+	unsigned tail = *u->sq_tail;
+	unsigned idx = tail & *u->sq_mask;
+	struct io_uring_sqe *sqe = u->sqes + idx;
+
+	memset (sqe, 0, sizeof (*sqe));
+	sqe->opcode = opcode;
+	sqe->fd = fd;
+	sqe->user_data = tag;
+	u->sq_array[idx] = idx;
+	__atomic_store_n (u->sq_tail, tail + 1, __ATOMIC_RELEASE);
+	u->queued++;
+	return sqe;
+}
+
+/** Dequeues a completion entry, if any. */
+static bool uring_reap (struct uring *u, struct io_uring_cqe *cqe)
+{
+	unsigned head = *u->cq_head;
+
+	if (head == __atomic_load_n (u->cq_tail, __ATOMIC_ACQUIRE))
+		return false;
+	*cqe = u->cqes[head & *u->cq_mask];
+	__atomic_store_n (u->cq_head, head + 1, __ATOMIC_RELEASE);
+	return true;
+}
+
+static bool uring_empty (struct uring *u)
+{
+	return *u->cq_head == __atomic_load_n (u->cq_tail, __ATOMIC_ACQUIRE);
+}
+
+/** Queues a read into the first free slot of a direction. */
+static void uring_read (struct uring *u, unsigned i)
+{
+	struct uring_flow *f = u->flows + i;
+	unsigned slot = (f->head + f->count) % SLOTS;
+	struct io_uring_sqe *sqe;
+
+	sqe = uring_sqe (u, u->fixed ? IORING_OP_READ_FIXED : IORING_OP_READ,
+	                 f->in, i << 1);
+	sqe->addr = (uintptr_t)(f->buf + slot * u->mtu);
+	sqe->len = u->mtu;
+	sqe->buf_index = i;
+	f->reading = true;
+}
+
+/** Queues a write of the oldest slot of a direction. */
+static void uring_write (struct uring *u, unsigned i)
+{
+	struct uring_flow *f = u->flows + i;
+	struct io_uring_sqe *sqe;
+
+	sqe = uring_sqe (u, u->fixed ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE,
+	                 f->out, (i << 1) | 1);
+	sqe->addr = (uintptr_t)(f->buf + f->head * u->mtu + f->offset);
+	sqe->len = f->len[f->head] - f->offset;
+	sqe->buf_index = i;
+	f->writing = true;
+}
+
+static int uring_open (struct uring *u, const at_data_ctx_t *ctx)
+{
+	size_t size = SLOTS * ctx->mtu;
+
+	if (uring_map (u))
+		return -1;
+
+	if (posix_memalign ((void **)&u->buf, sysconf (_SC_PAGESIZE), 2 * size))
+	{
+		uring_unmap (u);
+		return -1;
+	}
+
+	struct iovec iov[2] = {
+		{ u->buf, size },
+		{ u->buf + size, size },
+	};
+
+	u->fixed = !uring_register (u->fd, IORING_REGISTER_BUFFERS, iov, 2);
+	if (!u->fixed)
+		debug ("Cannot register data buffers (%m)");
+
+	u->mtu = ctx->mtu;
+	for (int i = 0; i < 2; i++)
+	{
+		struct uring_flow *f = u->flows + i;
+
+		f->buf = iov[i].iov_base;
+		f->head = 0;
+		f->count = 0;
+		f->offset = 0;
+		f->reading = false;
+		f->writing = false;
+	}
+	u->flows[0].in = ctx->dte_in;
+	u->flows[0].out = ctx->dce;
+	u->flows[1].in = ctx->dce;
+	u->flows[1].out = ctx->dte_out;
+
+	/* The kernel must wait for readiness rather than fail with EAGAIN */
+	u->ctx = ctx;
+	at_data_block (ctx, u->flags);
+	return 0;
+}
+
+/**
+ * Cancels the operations in flight and waits for them to complete, so that
+ * the kernel no longer accesses the buffers.
+ * @return 0 on success, -1 if operations may still be in flight.
+ */
+static int uring_quiesce (struct uring *u)
+{
+	unsigned inflight = 0;
+
+	for (unsigned i = 0; i < 2; i++)
+	{
+		struct uring_flow *f = u->flows + i;
+
+		if (f->reading)
+			uring_sqe (u, IORING_OP_ASYNC_CANCEL, -1,
+			           CANCEL_TAG)->addr = i << 1;
+		if (f->writing)
+			uring_sqe (u, IORING_OP_ASYNC_CANCEL, -1,
+			           CANCEL_TAG)->addr = (i << 1) | 1;
+		inflight += f->reading + f->writing;
+	}
+
+	while (inflight > 0)
+	{
+		struct io_uring_cqe cqe;
+		int val = uring_enter (u->fd, u->queued, 1, IORING_ENTER_GETEVENTS);
+
+		if (val >= 0)
+			u->queued -= val;
+		else
+		if (errno != EINTR)
+		{
+			error ("Cannot cancel data transfers (%m)");
+			return -1;
+		}
+
+		while (uring_reap (u, &cqe))
+			if (cqe.user_data != CANCEL_TAG)
+				inflight--;
+	}
+	return 0;
+}
+
+static void cleanup_uring (void *data)
+{
+	struct uring *u = data;
+
+	at_data_unblock (u->ctx, u->flags);
+	if (uring_quiesce (u))
+		return; /* leak rather than let the kernel corrupt memory */
+	uring_unmap (u);
+	free (u->buf);
+}
+
+int at_data_uring (at_data_ctx_t *ctx)
+{
+	struct uring u;
+
+	if (uring_open (&u, ctx))
+		return -1;
+
+	at_data_session_t *s = ctx->session;
+	uint64_t now = at_data_timestamp (CLOCK_MONOTONIC);
+
+	/* Refresh the statistics file every second */
+	int timeout = (ctx->dump.path != NULL) ? 1000 : -1;
+
+	debug ("Using io_uring data engine");
+	pthread_cleanup_push (cleanup_uring, &u);
+
+	for (;;)
+	{
+		bool fill[2], pending[2];
+
+		/* Keep one read in flight while there is a free slot, and one write
+		 * in flight while there is a filled slot. Reads and writes cannot be
+		 * linked, as stream reads are usually short (which breaks links). */
+		for (unsigned i = 0; i < 2; i++)
+		{
+			struct uring_flow *f = u.flows + i;
+
+			fill[i] = f->count < SLOTS;
+			pending[i] = f->count > 0;
+			if (fill[i] && !f->reading)
+				uring_read (&u, i);
+			if (pending[i] && !f->writing)
+				uring_write (&u, i);
+		}
+
+		/* Submit the whole batch at once. Then wait with poll(), which
+		 * unlike io_uring_enter() is a thread cancellation point. */
+		uint64_t delay = now;
+		bool busy = false;
+		if (u.queued > 0)
+		{
+			int val = uring_enter (u.fd, u.queued, 0, 0);
+			if (val >= 0)
+				u.queued -= val;
+			else
+			if (errno == EAGAIN || errno == EBUSY)
+				busy = true; /* wait for completions before retrying */
+			else
+			if (errno != EINTR)
+			{
+				error ("Cannot submit data transfers (%m)");
+				goto out;
+			}
+			s->polls++;
+		}
+		if ((u.queued == 0 || busy) && uring_empty (&u))
+		{
+			struct pollfd ufd = { .fd = u.fd, .events = POLLIN };
+
+			poll (&ufd, 1, timeout);
+			s->polls++;
+		}
+		now = at_data_timestamp (CLOCK_MONOTONIC);
+		delay = now - delay;
+
+		for (int i = 0; i < 2; i++)
+			if (!fill[i])
+				s->dir[i].congest += delay;
+			else if (!pending[i])
+				s->dir[i].idle += delay;
+
+		struct io_uring_cqe cqe;
+
+		while (uring_reap (&u, &cqe))
+		{
+			unsigned i = (cqe.user_data >> 1) & 1;
+			struct uring_flow *f = u.flows + i;
+			at_data_stats_t *st = s->dir + i;
+
+			if (cqe.user_data & 1)
+			{
+				f->writing = false;
+				if (cqe.res < 0)
+				{
+					if (cqe.res == -EINTR || cqe.res == -EAGAIN)
+						continue;
+					errno = -cqe.res;
+					warning ("%s data write error (%m)", i ? "DTE" : "DCE");
+					goto out;
+				}
+
+				st->writes++;
+				st->bytes += cqe.res;
+				f->offset += cqe.res;
+				if (f->offset == f->len[f->head])
+				{
+					at_data_latency (st, now - f->stamp[f->head]);
+					f->head = (f->head + 1) % SLOTS;
+					f->count--;
+					f->offset = 0;
+				}
+			}
+			else
+			{
+				unsigned slot = (f->head + f->count) % SLOTS;
+				const uint8_t *buf = f->buf + slot * u.mtu;
+
+				f->reading = false;
+				if (cqe.res < 0)
+				{
+					if (cqe.res == -EINTR || cqe.res == -EAGAIN)
+						continue;
+					errno = -cqe.res;
+					warning ("%s data read error (%m)", i ? "DCE" : "DTE");
+					goto out;
+				}
+
+				st->reads++;
+				if (cqe.res == 0)
+				{
+					notice ("%s data stream end", i ? "DCE" : "DTE");
+					goto out;
+				}
+
+				if (i == 0)
+				{
+					/* +++ escape handling */
+					if ((now - ctx->last_rx) >= AT_DATA_GUARD_TIME
+					 && cqe.res == 3 && !memcmp (buf, "+++", 3))
+					{
+						debug ("Caught +++ escape sequence");
+						goto out;
+					}
+					ctx->last_rx = now;
+				}
+				f->len[slot] = cqe.res;
+				f->stamp[slot] = now;
+				f->count++;
+			}
+		}
+
+		at_data_tick (ctx, now);
+	}
+out:
+	pthread_cleanup_pop (1);
+	return 0;
+}
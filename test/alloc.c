@@ -0,0 +1,143 @@
+/**
+ * @file alloc.c
+ * @brief Heap allocations on the command response path
+ */
+
+
+/* ***** BEGIN LICENSE BLOCK *****
+ * Version: MPL 1.1/GPL 2.0/LGPL 2.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is matd.
+ *
+ * The Initial Developer of the Original Code is
+ * remi.denis-courmont@nokia.com.
+ * Portions created by the Initial Developer are
+ * Copyright (C) 2012 Nokia Corporation and/or its subsidiary(-ies).
+ * All Rights Reserved.
+ *
+ * Contributor(s):
+ *
+ * Alternatively, the contents of this file may be used under the terms of
+ * either the GNU General Public License Version 2 or later (the "GPL"), or
+ * the GNU Lesser General Public License Version 2.1 or later (the "LGPL"),
+ * in which case the provisions of the GPL or the LGPL are applicable instead
+ * of those above. If you wish to allow use of your version of this file only
+ * under the terms of either the GPL or the LGPL, and not to allow others to
+ * use your version of this file under the terms of the MPL, indicate your
+ * decision by deleting the provisions above and replace them with the notice
+ * and other provisions required by the GPL or the LGPL. If you do not delete
+ * the provisions above, a recipient may use your version of this file under
+ * the terms of any one of the MPL, the GPL or the LGPL.
+ *
+ * ***** END LICENSE BLOCK ***** */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <syslog.h>
+#include <sys/types.h>
+
+#include <at_modem.h>
+
+/*** Counting allocator ***/
+
+extern void *__libc_malloc (size_t);
+extern void *__libc_calloc (size_t, size_t);
+extern void *__libc_realloc (void *, size_t);
+
+static volatile bool counting = false;
+static volatile unsigned allocs = 0;
+
+void *malloc (size_t size)
+{
+	if (counting)
+		allocs++;
+	return __libc_malloc (size);
+}
+
+void *calloc (size_t n, size_t size)
+{
+	if (counting)
+		allocs++;
+	return __libc_calloc (n, size);
+}
+
+void *realloc (void *ptr, size_t size)
+{
+	if (counting)
+		allocs++;
+	return __libc_realloc (ptr, size);
+}
+
+/*** DTE output ***/
+
+static char output[4096];
+static size_t outlen = 0;
+
+static ssize_t sink (void *opaque, const void *buf, size_t len)
+{
+	if (len > sizeof (output) - outlen)
+		len = sizeof (output) - outlen;
+	memcpy (output + outlen, buf, len);
+	outlen += len;
+	(void) opaque;
+	return len;
+}
+
+static int roundtrip (struct at_modem *m, const char *req, const char *resp)
+{
+	outlen = 0;
+	allocs = 0;
+	counting = true;
+	at_modem_feed (m, req, strlen (req));
+	counting = false;
+
+	if (outlen != strlen (resp) || memcmp (output, resp, outlen))
+	{
+		fprintf (stderr, "%s: unexpected response \"%.*s\"\n", req,
+		         (int)outlen, output);
+		return -1;
+	}
+	return 0;
+}
+
+int main (void)
+{
+	static const char req[] = "AT+CMEE?\r";
+	static const char resp[] = "AT+CMEE?\r\r\n+CMEE: 1\r\nOK\r\n";
+
+	/* Debug logging formats with the heap */
+	setlogmask (LOG_UPTO (LOG_INFO));
+
+	struct at_modem *m = at_modem_create (-1, -1, sink, NULL);
+	if (m == NULL)
+		return 1;
+
+	int ret = 1;
+
+	/* First run compiles and caches the command line */
+	if (roundtrip (m, req, resp) || roundtrip (m, req, resp))
+		goto out;
+
+	printf ("%s round trip: %u allocation(s)\n", "AT+CMEE?", allocs);
+	if (allocs == 0)
+		ret = 0;
+out:
+	at_modem_destroy (m);
+	return ret;
+}
@@ -0,0 +1,956 @@
+/**
+ * @file bench.c
+ * @brief Data mode throughput and latency benchmark
+ */
+
+/* ***** BEGIN LICENSE BLOCK *****
+ * Version: MPL 1.1/GPL 2.0/LGPL 2.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is matd.
+ *
+ * The Initial Developer of the Original Code is
+ * remi.denis-courmont@nokia.com.
+ * Portions created by the Initial Developer are
+ * Copyright (C) 2012 Nokia Corporation and/or its subsidiary(-ies).
+ * All Rights Reserved.
+ *
+ * Contributor(s):
+ *
+ * Alternatively, the contents of this file may be used under the terms of
+ * either the GNU General Public License Version 2 or later (the "GPL"), or
+ * the GNU Lesser General Public License Version 2.1 or later (the "LGPL"),
+ * in which case the provisions of the GPL or the LGPL are applicable instead
+ * of those above. If you wish to allow use of your version of this file only
+ * under the terms of either the GPL or the LGPL, and not to allow others to
+ * use your version of this file under the terms of the MPL, indicate your
+ * decision by deleting the provisions above and replace them with the notice
+ * and other provisions required by the GPL or the LGPL. If you do not delete
+ * the provisions above, a recipient may use your version of this file under
+ * the terms of any one of the MPL, the GPL or the LGPL.
+ *
+ * ***** END LICENSE BLOCK ***** */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <signal.h>
+#include <unistd.h>
+#include <spawn.h>
+#include <errno.h>
+#include <ctype.h>
+#include <search.h>
+#include <time.h>
+#include <poll.h>
+#include <sys/uio.h>
+#include <sys/wait.h>
+#include <fcntl.h>
+#include <termios.h>
+
+#include <iconv.h>
+
+#include <at_command.h>
+#include <at_modem.h>
+#include <at_thread.h>
+#include "trie.h"
+
+/** Benchmark parameters */
+struct bench
+{
+	unsigned duration; /**< Seconds per throughput test */
+	unsigned pattern; /**< Payload pattern */
+	unsigned rate; /**< Maximum bytes per second, or 0 for unlimited */
+	unsigned count; /**< Number of round trips */
+	unsigned size; /**< Bytes per round trip */
+	unsigned interval; /**< Microseconds between round trips */
+	bool dispatch; /**< Benchmark command dispatch instead of data mode */
+	bool params; /**< Benchmark parameters parsing instead of data mode */
+	bool charset; /**< Benchmark character sets conversion instead */
+};
+
+/** DTE-side input buffer */
+struct reader
+{
+	int fd;
+	size_t len;
+	char buf[65536];
+};
+
+static uint64_t now_ns (void)
+{
+	struct timespec ts;
+
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * UINT64_C(1000000000) + ts.tv_nsec;
+}
+
+/*** Support functions ***/
+
+static void mat_stop (pid_t pid)
+{
+	int status;
+
+	while (waitpid (pid, &status, 0) == -1);
+}
+
+static pid_t mat_start (int *pfd)
+{
+	int fd = posix_openpt (O_RDWR|O_NOCTTY);
+	if (fd == -1)
+		return -1;
+	fcntl (fd, F_SETFD, FD_CLOEXEC);
+
+	struct termios tp;
+	tcgetattr (fd, &tp);
+	cfmakeraw (&tp);
+	tcsetattr (fd, TCSANOW, &tp);
+
+	pid_t pid = -1;
+	char name[32], *argv[] = {
+		(char *)"mat",
+		(char *)"--",
+		name,
+		NULL,
+	};
+
+	const char *path = getenv ("srcdir") ? "../mat" : BINDIR"/mat";
+	if (ptsname_r (fd, name, sizeof (name)) || unlockpt (fd))
+		goto err;
+	if (posix_spawn (&pid, path, NULL, NULL, argv, environ))
+		goto err;
+
+	*pfd = fd;
+	return pid;
+err:
+	close (fd);
+	return -1;
+}
+
+static int request (int fd, const char *fmt, ...)
+{
+	va_list ap;
+	char *cmd;
+	int len;
+
+	va_start (ap, fmt);
+	len = vasprintf (&cmd, fmt, ap);
+	va_end (ap);
+	if (len < 0)
+		return -1;
+
+	struct iovec iov[2] = {
+		{ cmd, len },
+		{ (char *)"\r", 1 },
+	};
+
+	len = (writev (fd, iov, 2) == len + 1) ? 0 : -1;
+	free (cmd);
+	return len;
+}
+
+/**
+ * Reads from the DTE until a string is seen, or a timeout.
+ * @param count place to add the number of bytes read before the string
+ * @return 0 if the string was seen, -1 otherwise.
+ */
+static int expect (struct reader *r, const char *str, unsigned timeout,
+                   uint64_t *count)
+{
+	size_t len = strlen (str);
+	uint64_t deadline = now_ns () + timeout * UINT64_C(1000000);
+
+	for (;;)
+	{
+		char *p = memmem (r->buf, r->len, str, len);
+		if (p != NULL)
+		{
+			p += len;
+			if (count != NULL)
+				*count += p - r->buf - len;
+			r->len -= p - r->buf;
+			memmove (r->buf, p, r->len);
+			return 0;
+		}
+
+		/* Keep the tail that may be the start of the string */
+		if (r->len >= len)
+		{
+			size_t n = r->len - (len - 1);
+
+			if (count != NULL)
+				*count += n;
+			memmove (r->buf, r->buf + n, len - 1);
+			r->len = len - 1;
+		}
+
+		uint64_t now = now_ns ();
+		if (now >= deadline)
+			return -1;
+
+		struct pollfd ufd = { .fd = r->fd, .events = POLLIN };
+		if (poll (&ufd, 1, (deadline - now) / 1000000 + 1) <= 0)
+			continue;
+
+		ssize_t val = read (r->fd, r->buf + r->len,
+		                    sizeof (r->buf) - r->len);
+		if (val <= 0)
+			return -1;
+		r->len += val;
+	}
+}
+
+/** Starts a data mode test command and waits for CONNECT. */
+static int bench_connect (struct reader *r, const char *cmd,
+                          const struct bench *b, unsigned mtu)
+{
+	if (request (r->fd, "AT%s=%u,%u,%u", cmd, b->pattern, b->rate, mtu)
+	 || expect (r, "\r\nCONNECT\r\n", 2000, NULL))
+	{
+		fprintf (stderr, "Cannot start %s with MTU %u\n", cmd, mtu);
+		return -1;
+	}
+	return 0;
+}
+
+/**
+ * Leaves data mode with the +++ escape sequence.
+ * @param guard whether to wait for the guard time first
+ * @param count place to add the number of bytes received in the meantime
+ */
+static int bench_escape (struct reader *r, bool guard, uint64_t *count)
+{
+	if (guard)
+	{
+		const struct timespec ts = { 1, 100000000 };
+
+		while (nanosleep (&ts, NULL) && errno == EINTR);
+	}
+
+	if (write (r->fd, "+++", 3) != 3
+	 || expect (r, "\r\nNO CARRIER\r\n", 5000, count))
+	{
+		fputs ("Cannot leave data mode\n", stderr);
+		return -1;
+	}
+	return 0;
+}
+
+/** Measures DCE to DTE throughput with AT@CHARGEN. */
+static int bench_chargen (struct reader *r, const struct bench *b,
+                          unsigned mtu, double *bps)
+{
+	uint64_t bytes = 0;
+
+	if (bench_connect (r, "@CHARGEN", b, mtu))
+		return -1;
+
+	uint64_t start = now_ns ();
+
+	/* The payload is read until the escape sequence times out */
+	expect (r, "\r\nNO CARRIER\r\n", b->duration * 1000, &bytes);
+	*bps = 8e9 * bytes / (now_ns () - start);
+	return bench_escape (r, false, NULL);
+}
+
+/** Measures DTE to DCE throughput with AT@DISCARD. */
+static int bench_discard (struct reader *r, const struct bench *b,
+                          unsigned mtu, double *bps)
+{
+	char buf[4096];
+	uint64_t bytes = 0;
+
+	if (bench_connect (r, "@DISCARD", b, mtu))
+		return -1;
+
+	for (size_t i = 0; i < sizeof (buf); i++)
+		buf[i] = 'a' + (i % 26);
+
+	uint64_t start = now_ns (), now;
+	uint64_t end = start + b->duration * UINT64_C(1000000000);
+
+	do
+	{
+		ssize_t val = write (r->fd, buf, sizeof (buf));
+		if (val < 0)
+			return -1;
+		bytes += val;
+		now = now_ns ();
+	}
+	while (now < end);
+
+	*bps = 8e9 * bytes / (now - start);
+	return bench_escape (r, true, NULL);
+}
+
+static int cmp_u64 (const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+	return (x > y) - (x < y);
+}
+
+/** Measures round-trip latencies with AT@ECHO. */
+static int bench_echo (struct reader *r, const struct bench *b,
+                       unsigned mtu, uint64_t *rtt)
+{
+	char *buf = malloc (b->size);
+	int ret = -1;
+
+	if (buf == NULL || bench_connect (r, "@ECHO", b, mtu))
+		goto out;
+
+	for (size_t i = 0; i < b->size; i++)
+		buf[i] = 'a' + (i % 26);
+
+	for (unsigned i = 0; i < b->count; i++)
+	{
+		uint64_t start = now_ns ();
+		size_t got = 0;
+
+		if (write (r->fd, buf, b->size) != (ssize_t)b->size)
+			goto out;
+		while (got < b->size)
+		{
+			ssize_t val = read (r->fd, r->buf, sizeof (r->buf));
+			if (val <= 0)
+				goto out;
+			got += val;
+		}
+		rtt[i] = now_ns () - start;
+
+		if (b->interval)
+			usleep (b->interval);
+	}
+	r->len = 0;
+
+	qsort (rtt, b->count, sizeof (*rtt), cmp_u64);
+	ret = bench_escape (r, true, NULL);
+out:
+	free (buf);
+	return ret;
+}
+
+/*** Extended commands dispatch ***/
+
+/** Extended command name (same layout as the AT commands bank) */
+struct cmd_name
+{
+	char name[15];
+};
+
+/** Former tsearch() comparator for extended commands, for reference */
+static int ext_cmp (const void *a, const void *b)
+{
+	const char *na = a, *nb = b;
+	size_t alen = strlen (na);
+	size_t blen = strlen (nb);
+	int val;
+
+	if (alen > blen)
+	{
+		val = strncasecmp (na, nb, blen);
+		if (val != 0)
+			return val;
+		return +1;
+	}
+	else
+	if (alen < blen)
+	{
+		val = strncasecmp (na, nb, alen);
+		if (val != 0)
+			return val;
+		return -1;
+	}
+	else
+		return strcasecmp (na, nb);
+}
+
+/** Former tfind() comparator for extended commands, for reference */
+static int ext_match (const void *a, const void *b)
+{
+	const char *cmd = a, *name = b;
+	size_t len = strlen (name);
+
+	int val = strncasecmp (cmd, name, len);
+	if (val)
+		return val;
+
+	cmd += len;
+	if (isalnum ((unsigned char)cmd[0]))
+		return 1;
+	return 0;
+}
+
+static int cmp_name (const void *a, const void *b)
+{
+	return strcasecmp (a, b);
+}
+
+static void free_nothing (void *data)
+{
+	(void) data;
+}
+
+/**
+ * Measures extended commands lookups, with the commands listed by AT+CLAC,
+ * i.e. the ones registered by all plugins.
+ */
+static int bench_dispatch (struct reader *r, const struct bench *b)
+{
+	char *end;
+
+	if (request (r->fd, "AT+CLAC"))
+		return -1;
+	while ((end = memmem (r->buf, r->len, "\r\nOK\r\n", 6)) == NULL)
+	{
+		ssize_t val = read (r->fd, r->buf + r->len,
+		                    sizeof (r->buf) - r->len);
+		if (val <= 0)
+			return -1;
+		r->len += val;
+	}
+	*end = '\0';
+
+	/* Parse the list of commands */
+	size_t n = 0;
+	struct cmd_name *names = malloc ((end - r->buf) * sizeof (*names));
+	char (*reqs)[32] = malloc (4 * (end - r->buf) * sizeof (*reqs));
+	void *tree = NULL;
+	at_trie_t *trie = NULL;
+	int ret = -1;
+
+	if (names == NULL || reqs == NULL)
+		goto out;
+
+	char *saveptr;
+	for (const char *tok = strtok_r (r->buf, "\r\n", &saveptr); tok != NULL;
+	     tok = strtok_r (NULL, "\r\n", &saveptr))
+		if (tok[0] == '+' && strlen (tok) < sizeof (names->name))
+			strcpy (names[n++].name, tok);
+	r->len = 0;
+
+	qsort (names, n, sizeof (*names), cmp_name);
+	for (size_t i = 0; i < n; i++)
+	{
+		const char *name = names[i].name;
+
+		snprintf (reqs[4 * i], sizeof (reqs[0]), "%s?", name);
+		snprintf (reqs[4 * i + 1], sizeof (reqs[0]), "%s=?", name);
+		snprintf (reqs[4 * i + 2], sizeof (reqs[0]), "%s=1,\"foo\"", name);
+		snprintf (reqs[4 * i + 3], sizeof (reqs[0]), "%sz=1", name);
+		if (tsearch (name, &tree, ext_cmp) == NULL)
+			goto out;
+	}
+
+	trie = at_trie_build (names->name, n, sizeof (*names));
+	if (trie == NULL)
+		goto out;
+
+	/* Both lookups must agree */
+	for (size_t i = 0; i < 4 * n; i++)
+	{
+		char **p = tfind (reqs[i], &tree, ext_match);
+		int idx = (p != NULL) ? ((struct cmd_name *)*p - names) : -1;
+
+		if (at_trie_find (trie, reqs[i]) != idx)
+		{
+			fprintf (stderr, "Lookup mismatch for AT%s\n", reqs[i]);
+			goto out;
+		}
+	}
+
+	unsigned found = 0;
+	uint64_t start = now_ns ();
+
+	for (unsigned k = 0; k < b->count; k++)
+		for (size_t i = 0; i < 4 * n; i++)
+			found += tfind (reqs[i], &tree, ext_match) != NULL;
+
+	uint64_t mid = now_ns ();
+
+	for (unsigned k = 0; k < b->count; k++)
+		for (size_t i = 0; i < 4 * n; i++)
+			found -= at_trie_find (trie, reqs[i]) >= 0;
+
+	uint64_t stop = now_ns ();
+	double lookups = 4. * n * b->count;
+
+	printf ("%zu commands, %.0f lookups\n", n, lookups);
+	printf ("%8s %10s\n", "Lookup", "ns/lookup");
+	printf ("%8s %10.1f\n", "tsearch", (mid - start) / lookups);
+	printf ("%8s %10.1f\n", "trie", (stop - mid) / lookups);
+	ret = (found == 0) ? 0 : -1;
+out:
+	at_trie_destroy (trie);
+	tdestroy (tree, free_nothing);
+	free (reqs);
+	free (names);
+	return ret;
+}
+
+/*** Parameters parsing ***/
+
+typedef int (*scan_cb) (const char *, const char *, ...);
+
+static int scan_cscs (scan_cb scan, const char *req)
+{
+	char buf[8];
+
+	return scan (req, " \"%7[^\"]\"", buf);
+}
+
+static int scan_cpbr (scan_cb scan, const char *req)
+{
+	unsigned start, end;
+
+	return scan (req, " %u , %u", &start, &end);
+}
+
+static int scan_cpbw (scan_cb scan, const char *req)
+{
+	unsigned idx, type, adtype;
+	unsigned char hidden;
+	char number[32], adnumber[32], text[256], group[256], adtext[256];
+	char email[256], sip[256], tel[256];
+
+	return scan (req, " %u , \"%31[^\"]\" , %u , \"%255[^\"]\" , "
+	             "\"%255[^\"]\" , \"%31[^\"]\" , %u , \"%255[^\"]\" , "
+	             "\"%255[^\"]\" , \"%255[^\"]\" , \"%255[^\"]\" , %hhu",
+	             &idx, number, &type, text, group, adnumber, &adtype,
+	             adtext, email, sip, tel, &hidden);
+}
+
+/** Tokenizes and copies the string parameters, like the core handlers */
+static int tokenize (const char *req)
+{
+	at_param_t p[12];
+	char buf[strlen (req) + 12], *ptr = buf;
+
+	int n = at_tokenize (req, p, 12);
+	for (int i = 0; i < n; i++)
+		if (p[i].type == AT_PARAM_STRING)
+		{
+			at_param_copy (p + i, ptr, p[i].len + 1);
+			ptr += p[i].len + 1;
+		}
+	return n;
+}
+
+/** Compares sscanf(), at_sscanf() and at_tokenize() on core commands. */
+static int bench_params (const struct bench *b)
+{
+	static const struct
+	{
+		const char *name;
+		const char *req;
+		int (*scan) (scan_cb, const char *);
+	} cases[] = {
+		{ "+CSCS", "\"UTF-8\"", scan_cscs },
+		{ "+CPBR", "1,10", scan_cpbr },
+		{ "+CPBW", "1,\"+358401234567\",145,\"John Doe\",\"Friends\","
+		  "\"+358501234567\",145,\"Work\",\"john@example.com\","
+		  "\"sip:john@example.com\",\"tel:+358401234567\",0", scan_cpbw },
+	};
+	unsigned rounds = b->count * 100;
+
+	printf ("%8s %12s %12s %12s (ns/call)\n", "Command", "sscanf",
+	        "at_sscanf", "at_tokenize");
+
+	for (size_t i = 0; i < sizeof (cases) / sizeof (cases[0]); i++)
+	{
+		const char *req = cases[i].req;
+		int n = cases[i].scan (sscanf, req);
+
+		if (cases[i].scan (at_sscanf, req) != n || tokenize (req) != n)
+		{
+			fprintf (stderr, "Parsing mismatch for AT%s=%s\n",
+			         cases[i].name, req);
+			return -1;
+		}
+
+		uint64_t t[4];
+		unsigned total = 0;
+
+		t[0] = now_ns ();
+		for (unsigned k = 0; k < rounds; k++)
+			total += cases[i].scan (sscanf, req);
+		t[1] = now_ns ();
+		for (unsigned k = 0; k < rounds; k++)
+			total += cases[i].scan (at_sscanf, req);
+		t[2] = now_ns ();
+		for (unsigned k = 0; k < rounds; k++)
+			total += tokenize (req);
+		t[3] = now_ns ();
+
+		if (total != 3 * n * rounds)
+			return -1;
+		printf ("%8s %12.1f %12.1f %12.1f\n", cases[i].name,
+		        (double)(t[1] - t[0]) / rounds,
+		        (double)(t[2] - t[1]) / rounds,
+		        (double)(t[3] - t[2]) / rounds);
+	}
+	return 0;
+}
+
+/*** Character sets ***/
+
+/** Former iconv_open() per call conversion, for reference */
+static char *ref_convert (const char *tocode, const char *fromcode,
+                          const char *in, size_t inlen, size_t *restrict lenp)
+{
+	size_t outlen = 4 * inlen + 4;
+	char *out = malloc (outlen), *inp = (char *)in, *outp = out;
+	if (out == NULL)
+		return NULL;
+
+	iconv_t hd = iconv_open (tocode, fromcode);
+	if (hd == (iconv_t)(-1))
+		goto error;
+
+	size_t ret = iconv (hd, &inp, &inlen, &outp, &outlen);
+
+	iconv_close (hd);
+	if (ret == (size_t)(-1) || inlen > 0)
+		goto error;
+	*lenp = outp - out;
+	return out;
+error:
+	free (out);
+	return NULL;
+}
+
+static int hexval (char c)
+{
+	if (c >= '0' && c <= '9')
+		return c - '0';
+	c |= 0x20;
+	if (c >= 'a' && c <= 'f')
+		return c - 'a' + 10;
+	return -1;
+}
+
+static char *ref_to_utf8 (const char *cp, bool hex, const char *in)
+{
+	size_t len = strlen (in);
+	char raw[len / 2 + 1], *out;
+
+	if (hex)
+	{
+		len /= 2;
+		for (size_t i = 0; i < len; i++)
+		{
+			int hi = hexval (in[2 * i]), lo = hexval (in[2 * i + 1]);
+
+			if (hi < 0 || lo < 0)
+				return NULL;
+			raw[i] = (hi << 4) | lo;
+		}
+		in = raw;
+	}
+
+	out = ref_convert ("UTF-8", cp, in, len, &len);
+	if (out != NULL)
+		out[len] = '\0';
+	return out;
+}
+
+static char *ref_from_utf8 (const char *cp, bool hex, const char *in)
+{
+	size_t len;
+	char *raw = ref_convert (cp, "UTF-8", in, strlen (in) + 1, &len);
+	if (raw == NULL || !hex)
+		return raw;
+
+	/* Strip the UTF-16 nul terminator */
+	len -= 2;
+
+	char *out = malloc (2 * len + 1);
+	if (out != NULL)
+	{
+		for (size_t i = 0; i < len; i++)
+		{
+			out[2 * i] = "0123456789ABCDEF"[(unsigned char)raw[i] >> 4];
+			out[2 * i + 1] = "0123456789ABCDEF"[raw[i] & 0xF];
+		}
+		out[2 * len] = '\0';
+	}
+	free (raw);
+	return out;
+}
+
+static ssize_t discard (void *opaque, const void *buf, size_t len)
+{
+	(void) opaque; (void) buf;
+	return len;
+}
+
+static bool same (char *a, char *b)
+{
+	bool ok = (a == NULL) ? (b == NULL) : (b != NULL && !strcmp (a, b));
+
+	free (a);
+	free (b);
+	return ok;
+}
+
+/**
+ * Compares at_to_utf8() and at_from_utf8() with one iconv_open() per call,
+ * as they used to be.
+ */
+static int bench_charset (const struct bench *b)
+{
+	static const struct
+	{
+		const char *name;
+		const char *iconv;
+		bool hex;
+	} sets[] = {
+		{ "UTF-8", "UTF-8", false },
+		{ "IRA", "ASCII//TRANSLIT", false },
+		{ "UCS2", "UTF-16BE", true },
+		{ "8859-1", "ISO_8859-1//TRANSLIT", false },
+		{ "PCCP437", "IBM437//TRANSLIT", false },
+	};
+	static const char *const texts[] = {
+		"John Doe", "J\xC3\xB6rg M\xC3\xBCller", "\xCE\xA9\xCE\xBC\xCE\xAD",
+		"\xF0\x9F\x93\x9E", "\xC3\x28", "\xED\xA0\x80", "\xC0\xAF",
+		"\xFF", "D83D", "D83DDCDE", "00E", "0G41", "",
+	};
+	unsigned rounds = b->count * 10;
+	int ret = -1;
+
+	struct at_modem *m = at_modem_create (-1, -1, discard, NULL);
+	if (m == NULL)
+		return -1;
+
+	printf ("%8s %12s %12s %12s %12s (ns/call)\n", "Charset", "iconv_open",
+	        "at_to_utf8", "iconv_open", "at_from_utf8");
+
+	for (size_t i = 0; i < sizeof (sets) / sizeof (sets[0]); i++)
+	{
+		const char *cp = sets[i].iconv;
+		bool hex = sets[i].hex;
+
+		if (at_execute (m, "+CSCS=\"%s\"", sets[i].name) != AT_OK)
+			goto out;
+
+		/* Both conversions must agree, also on invalid input */
+		for (size_t j = 0; j < sizeof (texts) / sizeof (texts[0]); j++)
+		{
+			const char *text = texts[j];
+
+			if (!same (ref_to_utf8 (cp, hex, text), at_to_utf8 (m, text))
+			 || !same (ref_from_utf8 (cp, hex, text),
+			           at_from_utf8 (m, text)))
+			{
+				fprintf (stderr, "Conversion mismatch for \"%s\" in %s\n",
+				         text, sets[i].name);
+				goto out;
+			}
+		}
+
+		const char *text = texts[0];
+		char *enc = at_from_utf8 (m, text);
+		uint64_t t[5];
+
+		if (enc == NULL)
+			goto out;
+
+		t[0] = now_ns ();
+		for (unsigned k = 0; k < rounds; k++)
+			free (ref_to_utf8 (cp, hex, enc));
+		t[1] = now_ns ();
+		for (unsigned k = 0; k < rounds; k++)
+			free (at_to_utf8 (m, enc));
+		t[2] = now_ns ();
+		for (unsigned k = 0; k < rounds; k++)
+			free (ref_from_utf8 (cp, hex, text));
+		t[3] = now_ns ();
+		for (unsigned k = 0; k < rounds; k++)
+			free (at_from_utf8 (m, text));
+		t[4] = now_ns ();
+		free (enc);
+
+		printf ("%8s %12.1f %12.1f %12.1f %12.1f\n", sets[i].name,
+		        (double)(t[1] - t[0]) / rounds,
+		        (double)(t[2] - t[1]) / rounds,
+		        (double)(t[3] - t[2]) / rounds,
+		        (double)(t[4] - t[3]) / rounds);
+	}
+	ret = 0;
+out:
+	at_modem_destroy (m);
+	return ret;
+}
+
+/** Returns a percentile of sorted values, in microseconds. */
+static double percentile (const uint64_t *v, size_t n, double q)
+{
+	size_t k = q * n;
+
+	return v[(k < n) ? k : (n - 1)] / 1000.;
+}
+
+static void usage (const char *path)
+{
+	printf (
+"Usage: %s [options]\n"
+"Benchmarks the data mode of the AT modem emulation.\n"
+"\n"
+"  -a               benchmark parameters parsing instead\n"
+"  -c               benchmark extended commands dispatch instead\n"
+"  -x               benchmark character sets conversion instead\n"
+"  -m MTU[,MTU...]  MTUs to sweep (default 64,512,1500,4096,16384)\n"
+"  -t SECONDS       duration of throughput tests (default 2)\n"
+"  -p PATTERN       payload pattern (0: counter, 1: text, 2: zero, 3: random)\n"
+"  -r RATE          data source and sink rate in bytes/s (default unlimited)\n"
+"  -n COUNT         number of round trips or lookup rounds (default 1000)\n"
+"  -s SIZE          bytes per round trip (default 64)\n"
+"  -i MICROSECONDS  delay between round trips (default 0)\n",
+	        path);
+}
+
+int main (int argc, char *argv[])
+{
+	struct bench b = {
+		.duration = 2,
+		.pattern = 0,
+		.rate = 0,
+		.count = 1000,
+		.size = 64,
+		.interval = 0,
+		.dispatch = false,
+		.params = false,
+		.charset = false,
+	};
+	char *mtus = strdup ("64,512,1500,4096,16384");
+	int c;
+
+	while ((c = getopt (argc, argv, "achi:m:n:p:r:s:t:x")) != -1)
+		switch (c)
+		{
+			case 'a':
+				b.params = true;
+				break;
+			case 'c':
+				b.dispatch = true;
+				break;
+			case 'i':
+				b.interval = strtoul (optarg, NULL, 10);
+				break;
+			case 'm':
+				free (mtus);
+				mtus = strdup (optarg);
+				break;
+			case 'n':
+				b.count = strtoul (optarg, NULL, 10);
+				break;
+			case 'p':
+				b.pattern = strtoul (optarg, NULL, 10);
+				break;
+			case 'r':
+				b.rate = strtoul (optarg, NULL, 10);
+				break;
+			case 's':
+				b.size = strtoul (optarg, NULL, 10);
+				break;
+			case 't':
+				b.duration = strtoul (optarg, NULL, 10);
+				break;
+			case 'x':
+				b.charset = true;
+				break;
+			case 'h':
+				usage (argv[0]);
+				return 0;
+			default:
+				usage (argv[0]);
+				return 2;
+		}
+
+	if (b.params)
+	{
+		free (mtus);
+		return bench_params (&b) ? 1 : 0;
+	}
+	if (b.charset)
+	{
+		free (mtus);
+		return bench_charset (&b) ? 1 : 0;
+	}
+
+	uint64_t *rtt = malloc (b.count * sizeof (*rtt));
+	if (mtus == NULL || rtt == NULL || b.count == 0 || b.size == 0)
+		return 2;
+
+	struct reader *r = malloc (sizeof (*r));
+	if (r == NULL)
+		return 2;
+	r->len = 0;
+
+	signal (SIGPIPE, SIG_IGN);
+	pid_t pid = mat_start (&r->fd);
+	if (pid == -1)
+	{
+		fputs ("Cannot start AT emulation\n", stderr);
+		return 2;
+	}
+
+	int ret = 1;
+
+	if (request (r->fd, "ATE0") || expect (r, "OK\r\n", 5000, NULL))
+		goto out;
+
+	if (b.dispatch)
+	{
+		ret = bench_dispatch (r, &b) ? 1 : 0;
+		goto out;
+	}
+
+	printf ("%6s %14s %14s %10s %10s %10s\n", "MTU", "CHARGEN bps",
+	        "DISCARD bps", "p50 us", "p99 us", "p999 us");
+
+	char *saveptr;
+	for (const char *tok = strtok_r (mtus, ",", &saveptr); tok != NULL;
+	     tok = strtok_r (NULL, ",", &saveptr))
+	{
+		unsigned mtu = strtoul (tok, NULL, 10);
+		double rx, tx;
+
+		if (bench_chargen (r, &b, mtu, &rx)
+		 || bench_discard (r, &b, mtu, &tx)
+		 || bench_echo (r, &b, mtu, rtt))
+			goto out;
+
+		printf ("%6u %14.0f %14.0f %10.1f %10.1f %10.1f\n", mtu, rx, tx,
+		        percentile (rtt, b.count, .5),
+		        percentile (rtt, b.count, .99),
+		        percentile (rtt, b.count, .999));
+		fflush (stdout);
+	}
+	ret = 0;
+out:
+	close (r->fd);
+	mat_stop (pid);
+	free (r);
+	free (rtt);
+	free (mtus);
+	return ret;
+}
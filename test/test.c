@@ -52,6 +52,7 @@
 #include <string.h>
 #include <stdarg.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <signal.h>
 #include <unistd.h>
 #include <spawn.h>
@@ -358,6 +359,29 @@ CASE(charset)
 	if (ok (line))
 		return -1;
 
+	/* Parameters syntax */
+	REQUEST ("AT+CSCS=UTF-8");
+	RESPONSE ();
+	if (ok (line))
+		return -1;
+	REQUEST ("AT+CSCS=\"UTF-8\",1");
+	RESPONSE ();
+	if (ok (line))
+		return -1;
+	REQUEST ("AT+CSCS=\"UTF-8");
+	RESPONSE ();
+	if (ok (line))
+		return -1;
+	REQUEST ("AT+CSCS= \"IRA\" ;+CSCS?");
+	RESPONSE ();
+	if (strcmp (line, "+CSCS: \"IRA\"\r\n"))
+		return -1;
+	RESPONSE ();
+	CHECK_OK ();
+	REQUEST ("AT+CSCS=\"UTF-8\"");
+	RESPONSE ();
+	CHECK_OK ();
+
 	REQUEST ("AT+CSCS?");
 	RESPONSE ();
 	if (strcmp (line, "+CSCS: \"UTF-8\"\r\n"))
@@ -371,6 +395,40 @@ CASE(charset)
 		return -1;
 	RESPONSE ();
 	CHECK_OK ();
+
+	/* GSM 7-bit default alphabet, packed */
+	REQUEST ("AT@GSM7=\"hellohello\"");
+	RESPONSE ();
+	if (strcmp (line, "@GSM7: 10,\"E8329BFD4697D9EC37\"\r\n"))
+		return -1;
+	RESPONSE ();
+	CHECK_OK ();
+	REQUEST ("AT@GSM7=\"{|}\",1");
+	RESPONSE ();
+	if (strcmp (line, "@GSM7: 6,\"36A80D709302\"\r\n"))
+		return -1;
+	RESPONSE ();
+	CHECK_OK ();
+	REQUEST ("AT@GSM7=\"`\"");
+	RESPONSE ();
+	if (ok (line))
+		return -1;
+
+	REQUEST ("AT+CSCS=\"GSM\";+CSCS?");
+	RESPONSE ();
+	if (strcmp (line, "+CSCS: \"GSM\"\r\n"))
+		return -1;
+	RESPONSE ();
+	CHECK_OK ();
+	REQUEST ("AT@GSM7=\"[`\"");
+	RESPONSE ();
+	if (strcmp (line, "@GSM7: 2,\"5B30\"\r\n"))
+		return -1;
+	RESPONSE ();
+	CHECK_OK ();
+	REQUEST ("AT+CSCS=\"UTF-8\"");
+	RESPONSE ();
+	CHECK_OK ();
 	return 0;
 }
 
@@ -563,6 +621,53 @@ CASE (cmee)
 	return 0;
 }
 
+CASE (repeat)
+{
+	/* Same lines again, with results depending on the current state */
+	for (unsigned i = 0; i < 3; i++)
+	{
+		REQUEST ("AT+CMEE=%u", i);
+		RESPONSE ();
+		CHECK_OK ();
+
+		for (unsigned j = 0; j < 2; j++)
+		{
+			if (j)
+			{
+				REQUEST ("A/"); // repeat
+			}
+			else
+			{
+				REQUEST ("AT+CMEE?;+CMEE=?");
+			}
+			RESPONSE ();
+			if (strncmp ("+CMEE: ", line, 7) || atoi (line + 7) != (int)i)
+				return -1;
+			RESPONSE ();
+			if (strcmp ("+CMEE: (0-2)\r\n", line))
+				return -1;
+			RESPONSE ();
+			CHECK_OK ();
+		}
+	}
+
+	/* More distinct lines than fit in the plan cache */
+	for (unsigned i = 0; i < 20; i++)
+	{
+		REQUEST ("AT+CMEE=%0*u;+CMEE?", (int)i + 1, i % 3);
+		RESPONSE ();
+		if (strncmp ("+CMEE: ", line, 7) || atoi (line + 7) != (int)(i % 3))
+			return -1;
+		RESPONSE ();
+		CHECK_OK ();
+	}
+
+	REQUEST ("AT+CMEE=1");
+	RESPONSE ();
+	CHECK_OK ();
+	return 0;
+}
+
 CASE (shell)
 {
 	/* Coverage tests for data mode */
@@ -591,6 +696,372 @@ CASE (shell)
 	return 0;
 }
 
+static uint8_t mux_fcs (const uint8_t *p, size_t len)
+{
+	uint8_t crc = 0xFF;
+
+	while (len-- > 0)
+	{
+		crc ^= *(p++);
+		for (unsigned i = 0; i < 8; i++)
+			crc = (crc & 1) ? ((crc >> 1) ^ 0xE0) : (crc >> 1);
+	}
+	return 0xFF - crc;
+}
+
+/** Sends a 27.010 basic option frame, as the initiator. */
+static int mux_send (FILE *out, unsigned dlci, uint8_t ctrl,
+                     const void *data, size_t len)
+{
+	uint8_t hdr[3] = { (dlci << 2) | 3, ctrl, (len << 1) | 1 };
+
+	assert (len <= 127);
+	if (fputc (0xF9, out) == EOF
+	 || fwrite (hdr, 1, 3, out) != 3
+	 || fwrite (data, 1, len, out) != len
+	 || fputc (mux_fcs (hdr, 3), out) == EOF
+	 || fputc (0xF9, out) == EOF
+	 || fflush (out))
+		return -1;
+	return 0;
+}
+
+/** Receives a 27.010 basic option frame. */
+static int mux_recv (FILE *in, unsigned *dlci, uint8_t *ctrl,
+                     uint8_t *data, size_t *len)
+{
+	uint8_t hdr[4];
+	size_t hlen = 3;
+	int c;
+
+	do
+		c = getc (in);
+	while (c == 0xF9);
+	if (c == EOF)
+		return -1;
+	hdr[0] = c;
+	if (fread (hdr + 1, 1, 2, in) != 2)
+		return -1;
+	*len = hdr[2] >> 1;
+	if (!(hdr[2] & 1))
+	{
+		if (fread (hdr + 3, 1, 1, in) != 1)
+			return -1;
+		*len |= hdr[3] << 7;
+		hlen = 4;
+	}
+	if (*len > 64 || fread (data, 1, *len, in) != *len
+	 || getc (in) != mux_fcs (hdr, hlen) || getc (in) != 0xF9)
+		return -1;
+	*dlci = hdr[0] >> 2;
+	*ctrl = hdr[1];
+	return 0;
+}
+
+/**
+ * Sends a command line on a DLC, waits for OK and checks that the response
+ * includes a given string.
+ */
+static int mux_request (FILE *out, FILE *in, unsigned dlci, const char *req,
+                        const char *res)
+{
+	char buf[256];
+	size_t total = 0;
+
+	if (mux_send (out, dlci, 0xEF, req, strlen (req)))
+		return -1;
+	fprintf (stderr, "SENDING ON DLC %u... %s\n", dlci, req);
+
+	while (total < 6 || memcmp (buf + total - 6, "\r\nOK\r\n", 6))
+	{
+		uint8_t data[64];
+		size_t len;
+		unsigned n;
+		uint8_t ctrl;
+
+		if (mux_recv (in, &n, &ctrl, data, &len))
+			return -1;
+		if (n != dlci || ctrl != 0xEF || total + len > sizeof (buf))
+			return -1;
+		memcpy (buf + total, data, len);
+		total += len;
+	}
+	fprintf (stderr, "RECEIVED ON DLC %u... %.*s\n", dlci, (int)total, buf);
+	return (memmem (buf, total, res, strlen (res)) != NULL) ? 0 : -1;
+}
+
+CASE (cmux)
+{
+	uint8_t data[64], ctrl;
+	size_t len;
+	unsigned dlci;
+
+	REQUEST ("AT+CMUX=?");
+	RESPONSE ();
+	if (strcmp (line, "+CMUX: (0),(0),(1-6),(1-32767),(1-255),(0-100),"
+	                  "(2-255),(1-255),(1-7)\r\n"))
+		return -1;
+	RESPONSE ();
+	CHECK_OK ();
+
+	REQUEST ("AT+CMUX=1");
+	RESPONSE ();
+	CHECK_CME_ERROR ();
+
+	REQUEST ("AT+CMUX=0,0,5,64");
+	RESPONSE ();
+	CHECK_OK ();
+
+	/* Open the control channel, then two DLCs */
+	for (unsigned i = 0; i < 3; i++)
+		if (mux_send (out, i, 0x3F /* SABM|P */, NULL, 0)
+		 || mux_recv (in, &dlci, &ctrl, data, &len)
+		 || dlci != i || ctrl != 0x73 /* UA|F */)
+			return -1;
+
+	/* Each DLC has its own AT modem */
+	if (mux_request (out, in, 1, "ATE0\r", "ATE0\r")
+	 || mux_request (out, in, 2, "AT+CMUX?\r", "+CMUX: 0,0,5,31,")
+	 || mux_request (out, in, 1, "AT\r", "\r\nOK\r\n"))
+		return -1;
+
+	/* Test command */
+	static const uint8_t test[] = { 0x23, 0x07, 'a', 'b', 'c' };
+	if (mux_send (out, 0, 0xEF, test, sizeof (test))
+	 || mux_recv (in, &dlci, &ctrl, data, &len)
+	 || dlci != 0 || len != 5 || data[0] != 0x21 || memcmp (data + 1,
+	                                                         test + 1, 4))
+		return -1;
+
+	/* Parameter negotiation: UIH frames only, N1 capped */
+	static const uint8_t pn[] = { 0x83, 0x11, 2, 0x11, 0, 10, 200, 0, 3, 2 };
+	if (mux_send (out, 0, 0xEF, pn, sizeof (pn))
+	 || mux_recv (in, &dlci, &ctrl, data, &len)
+	 || dlci != 0 || len != 10 || data[0] != 0x81 || data[3] != 0
+	 || data[6] != 64 || data[7] != 0)
+		return -1;
+
+	/* Close DLC 1, then close down the multiplexer */
+	if (mux_send (out, 1, 0x53 /* DISC|P */, NULL, 0)
+	 || mux_recv (in, &dlci, &ctrl, data, &len)
+	 || dlci != 1 || ctrl != 0x73)
+		return -1;
+
+	static const uint8_t cld[] = { 0xC3, 0x01 };
+	if (mux_send (out, 0, 0xEF, cld, sizeof (cld))
+	 || mux_recv (in, &dlci, &ctrl, data, &len)
+	 || dlci != 0 || len != 2 || data[0] != 0xC1)
+		return -1;
+
+	/* Back to command mode */
+	REQUEST ("AT");
+	RESPONSE ();
+	CHECK_OK ();
+	return 0;
+}
+
+CASE (data_stats)
+{
+	unsigned before, after;
+
+	REQUEST ("AT@DSTATS=?");
+	RESPONSE ();
+	if (strcmp ("@DSTATS: (0)\r\n", line))
+		return -1;
+	RESPONSE ();
+	CHECK_OK ();
+
+	REQUEST ("AT@DSTATS?");
+	RESPONSE ();
+	if (sscanf (line, "@DSTATS: %u", &before) != 1)
+		return -1;
+	do
+		RESPONSE ();
+	while (!ok (line));
+
+	REQUEST ("AT@ECHO");
+	RESPONSE ();
+	if (strcmp ("CONNECT\r\n", line))
+		return -1;
+	if (fwrite ("hello\n", 6, 1, out) != 1 || fflush (out))
+		return -1;
+	RESPONSE ();
+	if (strcmp ("hello\n", line))
+		return -1;
+	sleep (1); /* guard time */
+	if (fwrite ("+++", 3, 1, out) != 1 || fflush (out))
+		return -1;
+	do
+		RESPONSE ();
+	while (strcmp (line, "NO CARRIER\r\n"));
+
+	REQUEST ("AT@DSTATS?");
+	RESPONSE ();
+	if (sscanf (line, "@DSTATS: %u", &after) != 1 || after != before + 1)
+		return -1;
+	RESPONSE ();
+	if (strncmp ("@DSTATS: \"last\",0,", line, 18))
+		return -1;
+	RESPONSE ();
+	if (strncmp ("@DSTATS: \"last-tx\",6,", line, 21))
+		return -1;
+	RESPONSE ();
+	RESPONSE ();
+	if (strncmp ("@DSTATS: \"last-rx\",6,", line, 21))
+		return -1;
+	do
+		RESPONSE ();
+	while (!ok (line));
+
+	REQUEST ("AT@DSTATS=0");
+	RESPONSE ();
+	CHECK_OK ();
+	REQUEST ("AT@DSTATS?");
+	RESPONSE ();
+	if (strcmp ("@DSTATS: 0\r\n", line))
+		return -1;
+	do
+		RESPONSE ();
+	while (!ok (line));
+
+	REQUEST ("AT@DSTATS=1");
+	RESPONSE ();
+	CHECK_CME_ERROR ();
+	return 0;
+}
+
+CASE (perf)
+{
+	REQUEST ("AT@PERF=?");
+	RESPONSE ();
+	if (strcmp ("@PERF: (0-2)\r\n", line))
+		return -1;
+	RESPONSE ();
+	CHECK_OK ();
+
+	REQUEST ("AT@PERF=1");
+	RESPONSE ();
+	CHECK_OK ();
+	REQUEST ("AT+CMEE?");
+	do
+		RESPONSE ();
+	while (!ok (line));
+	REQUEST ("AT+CSCS=\"UTF-9\"");
+	RESPONSE ();
+	CHECK_CME_ERROR ();
+
+	REQUEST ("AT@PERF?");
+	RESPONSE ();
+	if (strcmp ("@PERF: 1\r\n", line))
+		return -1;
+
+	unsigned found = 0;
+	do
+	{
+		RESPONSE ();
+		if (!strncmp ("@PERF: \"+CMEE\",1,", line, 17))
+			found |= 1;
+		/* Results are counted by value: OK, +CME ERROR: 4 */
+		if (!strcmp ("@PERF: \"+CMEE-results\",0,1\r\n", line))
+			found |= 2;
+		if (!strcmp ("@PERF: \"+CSCS-results\",260,1\r\n", line))
+			found |= 4;
+	}
+	while (!ok (line));
+	if (found != 7)
+		return -1;
+
+	/* Reset: recording goes on */
+	REQUEST ("AT@PERF=0");
+	RESPONSE ();
+	CHECK_OK ();
+	REQUEST ("AT@PERF?");
+	RESPONSE ();
+	if (strcmp ("@PERF: 1\r\n", line))
+		return -1;
+	found = 0;
+	do
+	{
+		RESPONSE ();
+		if (!strncmp ("@PERF: \"+CMEE", line, 13))
+			return -1;
+		if (!strncmp ("@PERF: \"@PERF\",1,", line, 17))
+			found |= 1;
+	}
+	while (!ok (line));
+	if (found != 1)
+		return -1;
+
+	/* Stop recording */
+	REQUEST ("AT@PERF=2");
+	RESPONSE ();
+	CHECK_OK ();
+	REQUEST ("AT@PERF?");
+	RESPONSE ();
+	if (strcmp ("@PERF: 0\r\n", line))
+		return -1;
+	do
+		RESPONSE ();
+	while (!ok (line));
+
+	REQUEST ("AT@PERF=3");
+	RESPONSE ();
+	CHECK_CME_ERROR ();
+	return 0;
+}
+
+CASE (urc)
+{
+	unsigned n;
+
+	REQUEST ("AT@URC=3");
+	RESPONSE ();
+	if (strcmp ("@URC: 0\r\n", line))
+		return -1;
+	RESPONSE ();
+	CHECK_OK ();
+
+	for (unsigned i = 1; i <= 3; i++)
+	{
+		do
+			RESPONSE ();
+		while (!strcmp (line, "\r\n"));
+		if (sscanf (line, "@URC: %u", &n) != 1 || n != i)
+			return -1;
+	}
+
+	/* State reports: only the last one is delivered */
+	REQUEST ("AT@URC=3,1");
+	RESPONSE ();
+	if (strcmp ("@URC: 0\r\n", line))
+		return -1;
+	RESPONSE ();
+	CHECK_OK ();
+	do
+		RESPONSE ();
+	while (!strcmp (line, "\r\n"));
+	if (strcmp ("@URC: 3\r\n", line))
+		return -1;
+
+	/* Within the coalescing window: delivered when the window ends */
+	REQUEST ("AT@URC=1,1");
+	RESPONSE ();
+	if (strcmp ("@URC: 0\r\n", line))
+		return -1;
+	RESPONSE ();
+	CHECK_OK ();
+	do
+		RESPONSE ();
+	while (!strcmp (line, "\r\n"));
+	if (strcmp ("@URC: 1\r\n", line))
+		return -1;
+
+	REQUEST ("AT");
+	RESPONSE ();
+	CHECK_OK ();
+	return 0;
+}
+
 CASE (event_report)
 {
 	REQUEST ("AT+CMER=?");
@@ -865,6 +1336,24 @@ CASE (setting)
 	RESPONSE ();
 	CHECK_ERROR ();
 
+	/* ATZ restores default values */
+	REQUEST ("ATS7=10");
+	RESPONSE ();
+	CHECK_OK ();
+	REQUEST ("ATZ");
+	RESPONSE ();
+	CHECK_OK ();
+	REQUEST ("ATE0S7?");
+	RESPONSE ();
+	if (strcmp (line, "050\r\n"))
+	{
+		fprintf (stderr, "Bad reset value: %s\n", line);
+		return -1;
+	}
+	RESPONSE ();
+	RESPONSE ();
+	CHECK_OK ();
+
 	return 0;
 }
 
@@ -1130,7 +1619,9 @@ static const struct test_case casev[] = {
 	{ "clock", test_clock },
 	{ "cmec", test_cmec },
 	{ "cmee", test_cmee },
+	{ "cmux", test_cmux },
 	{ "connect", test_shell },
+	{ "data-stats", test_data_stats },
 	{ "event-report", test_event_report },
 	{ "framing", test_framing },
 	{ "function", test_function },
@@ -1139,14 +1630,17 @@ static const struct test_case casev[] = {
 	{ "list", test_list },
 	{ "msisdn", test_cnum },
 	{ "parser", test_parser },
+	{ "perf", test_perf },
 	{ "product", test_product },
 	{ "quiet", test_quiet },
 	{ "rate", test_rate },
+	{ "repeat", test_repeat },
 	{ "screen-size", test_screen_size },
 	{ "setting", test_setting },
 	{ "sms-count", test_cpms },
 	{ "speaker", test_audio_volume },
 	{ "touchscreen", test_touchscreen },
+	{ "urc", test_urc },
 	{ "vendor", test_vendor },
 	{ "verbose", test_verbose },
 	{ "version", test_version },